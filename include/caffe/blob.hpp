@@ -51,6 +51,15 @@ class Blob {
   void Reshape(const vector<int>& shape);
   void Reshape(const BlobShape& shape);
   void ReshapeLike(const Blob& other);
+  /**
+   * @brief Make sure the blob can hold at least count elements, so that later
+   *        calls to Reshape up to that size do not reallocate.
+   *
+   * The shape is left unchanged. If the storage has to grow, its current
+   * contents are discarded.
+   */
+  void Reserve(const int count);
+  inline int capacity() const { return capacity_; }
   inline string shape_string() const {
     ostringstream stream;
     for (int i = 0; i < shape_.size(); ++i) {
@@ -19,6 +19,11 @@ namespace caffe {
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
  * way to keep parallel training deterministic.
+ *
+ * With data_param.num_readers > 1, records are parsed by that many shard
+ * threads, each striding through the database with its own cursor. The
+ * reading thread then only hands free items to the shards and collects them
+ * back in record order, unless data_param.deterministic_read is false.
  */
 template <typename T>
 class DataReader {
@@ -32,6 +37,10 @@ class DataReader {
   inline BlockingQueue<T*>& full() const {
     return queue_pair_->full_;
   }
+  // Database key of the record an item taken from full() was read from
+  inline const string& key(const T* t) const {
+    return queue_pair_->keys_.at(t);
+  }
 
  protected:
   // Queue pairs are shared between a body and its readers
@@ -42,6 +51,15 @@ class DataReader {
 
     BlockingQueue<T*> free_;
     BlockingQueue<T*> full_;
+    // One entry per item, created up front so that the map itself is never
+    // modified. An entry is only written by the thread holding the item.
+    map<const T*, string> keys_;
+
+    inline void set_key(const T* t, const string& key) {
+      typename map<const T*, string>::iterator it = keys_.find(t);
+      DCHECK(it != keys_.end());
+      it->second = key;
+    }
 
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
@@ -53,8 +71,14 @@ class DataReader {
     virtual ~Body();
 
    protected:
+    // Parses every stride-th record of the source with its own cursor
+    class Shard;
+
     void InternalThreadEntry();
     void read_one(db::Cursor* cursor, QueuePair* qp);
+    void read_sharded(db::DB* db, int first_record,
+        const vector<shared_ptr<QueuePair> >& qps);
+    static void skip(db::Cursor* cursor, int count);
 
     const LayerParameter param_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
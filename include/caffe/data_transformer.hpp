@@ -8,6 +8,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/stage_stats.hpp"
 #ifdef USE_OPENCV
 #include <opencv2/opencv.hpp>
 #endif
@@ -31,6 +32,12 @@ namespace caffe {
      */
     void InitRand();
 
+    /**
+     * @brief Accumulates the time spent decoding, distorting, expanding,
+     *    cropping and transforming into stats. Pass NULL to stop timing.
+     */
+    void set_stats(StageStats* stats) { stats_ = stats; }
+
     /**
      * @brief Applies the transformation defined in the data layer's
      * transform_param block to the data.
@@ -120,6 +127,14 @@ namespace caffe {
     void CropImage_Sampling(const AnnotatedDatum& anno_datum, const NormalizedBBox& bbox,
                     AnnotatedDatum* cropped_anno_datum);
 
+    /**
+     * @brief Crops only the AnnotationGroup of anno_datum according to bbox,
+     *    like CropImage does along with the datum.
+     */
+    void CropAnnotation(const AnnotatedDatum& anno_datum,
+                    const NormalizedBBox& bbox,
+                    AnnotatedDatum* cropped_anno_datum);
+
     void Transform(const AnnoFaceAttributeDatum& anno_datum,
                     Blob<Dtype>* transformed_blob,
                     AnnoFaceAttribute* transformed_annoface_all,
@@ -163,6 +178,19 @@ namespace caffe {
                     AnnotatedDatum* expanded_anno_datum);
 
 
+    /**
+     * @brief Draws the same random expansion as ExpandImage, but only
+     *    applies it to the AnnotationGroup and the size of the datum, which
+     *    must be set. No pixel is decoded or copied.
+     *
+     * @param expand_bbox
+     *    The expanded image in the normalized coordinates of the original
+     *    one, or [0, 0, 1, 1] if the image was not expanded.
+     */
+    void ExpandAnnotation(const AnnotatedDatum& anno_datum,
+                    NormalizedBBox* expand_bbox,
+                    AnnotatedDatum* expanded_anno_datum);
+
     void ExpandImage(const AnnoFaceAttributeDatum& anno_datum,
                         AnnoFaceAttributeDatum* expanded_anno_datum);
     void ExpandImage(const AnnotatedCCpdDatum& anno_datum,
@@ -199,6 +227,51 @@ namespace caffe {
     void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob,
                     NormalizedBBox* crop_bbox, bool* do_mirror);
     void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob);
+    /**
+     * @brief Like Transform(anno_datum, ...), but takes the pixels from
+     *    cv_img instead of anno_datum.datum(), which only has to hold the
+     *    size of cv_img.
+     */
+    void Transform(const cv::Mat& cv_img, const AnnotatedDatum& anno_datum,
+                    Blob<Dtype>* transformed_blob,
+                    vector<AnnotationGroup>* transformed_anno_vec);
+    void Transform(const cv::Mat& cv_img,
+                    const AnnoFaceAttributeDatum& anno_datum,
+                    Blob<Dtype>* transformed_blob,
+                    AnnoFaceAttribute* transformed_anno_vec);
+    void Transform(const cv::Mat& cv_img, const AnnotatedCCpdDatum& anno_datum,
+                    Blob<Dtype>* transformed_blob,
+                    LicensePlate* transformed_anno_vec);
+
+    /**
+     * @brief Like the datum versions, but hand the image of an encoded datum
+     *    from one step to the next in img instead of encoding it again.
+     *
+     * img holds the image of the input datum, or is empty to decode it from
+     * the datum, and receives the image of the output datum. The output
+     * datum then only gets the size and label of img, no data, so keep the
+     * two together up to the cv::Mat Transform. A raw datum is processed as
+     * by the datum versions and leaves img empty.
+     */
+    void DistortImage(const Datum& datum, Datum* distort_datum, cv::Mat* img);
+    void ExpandImage(const Datum& datum, const float expand_ratio,
+                    NormalizedBBox* expand_bbox, Datum* expanded_datum,
+                    cv::Mat* img);
+    void ExpandImage(const AnnotatedDatum& anno_datum,
+                    AnnotatedDatum* expanded_anno_datum, cv::Mat* img);
+    void ExpandImage(const AnnoFaceAttributeDatum& anno_datum,
+                    AnnoFaceAttributeDatum* expanded_anno_datum, cv::Mat* img);
+    void ExpandImage(const AnnotatedCCpdDatum& anno_datum,
+                    AnnotatedCCpdDatum* expanded_anno_datum, cv::Mat* img);
+    void CropImage(const Datum& datum, const NormalizedBBox& bbox,
+                    Datum* crop_datum, cv::Mat* img);
+    void CropImageAnchor(const Datum& datum, const NormalizedBBox& bbox,
+                    Datum* crop_datum, cv::Mat* img);
+    void CropImage(const AnnotatedDatum& anno_datum, const NormalizedBBox& bbox,
+                    AnnotatedDatum* cropped_anno_datum, cv::Mat* img);
+    void CropImage_Sampling(const AnnotatedDatum& anno_datum,
+                    const NormalizedBBox& bbox,
+                    AnnotatedDatum* cropped_anno_datum, cv::Mat* img);
 
     /**
      * @brief Crops img according to bbox.
@@ -214,6 +287,18 @@ namespace caffe {
     void ExpandImage(const cv::Mat& img, const float expand_ratio,
                     NormalizedBBox* expand_bbox, cv::Mat* expand_img);
 
+    /**
+     * @brief Produces the crop_bbox region of the image of the encoded datum
+     *    expanded to expand_bbox (see ExpandAnnotation), the same as
+     *    ExpandImage followed by CropImage but without building the expanded
+     *    image. Only the pixels inside the crop are distorted if
+     *    distort_param is set, and if resize_param sets reduced_decode the
+     *    JPEG is decoded at a reduced size as long as the crop still covers
+     *    the resize. Does not support mean_file.
+     */
+    void ExpandCropImage(const Datum& datum, const NormalizedBBox& expand_bbox,
+                    const NormalizedBBox& crop_bbox, cv::Mat* crop_img);
+
     void TransformInv(const Blob<Dtype>* blob, vector<cv::Mat>* cv_imgs);
     void TransformInv(const Dtype* data, cv::Mat* cv_img, const int height,
                         const int width, const int channels);
@@ -281,6 +366,24 @@ namespace caffe {
      *    cv::Mat containing the data to be transformed.
      */
     vector<int> InferBlobShape(const cv::Mat& cv_img);
+
+    /**
+     * @brief Decodes an encoded datum in color or gray as requested by
+     *    force_color and force_gray.
+     *
+     * If an image was attached to the datum with SetDecodedImage, that image
+     * is returned instead. It may be shared, e.g. with a decoded-image cache,
+     * and must not be written to.
+     *
+     * If resize_param is about to be applied and sets reduced_decode, a JPEG
+     * may be decoded at a reduced size, see GetJPEGReducedScale.
+     */
+    cv::Mat DecodeDatum(const Datum& datum, bool will_resize = false);
+    /**
+     * @brief Makes every decode of datum (compared by address) return img,
+     *    until another datum is set. Pass NULL to detach.
+     */
+    void SetDecodedImage(const Datum* datum, const cv::Mat& img);
     #endif  // USE_OPENCV
     protected:
     /**
@@ -293,6 +396,22 @@ namespace caffe {
      */
     virtual int Rand(int n);
 
+    // Draws whether and by how much to expand an image according to
+    // expand_param. Returns false if the image is to be left alone.
+    bool DrawExpandRatio(float* expand_ratio);
+
+    #ifdef USE_OPENCV
+    // DecodeDatum, at the largest reduced size that is still at least
+    // min_height x min_width if resize_param sets reduced_decode.
+    cv::Mat DecodeDatumReduced(const Datum& datum, int min_height,
+                    int min_width);
+    // The value ExpandImage fills the expanded image with.
+    cv::Scalar ExpandBackground(int channels);
+    // Gives an encoded datum the size of img, which holds its pixels, and
+    // clears its data.
+    void SetImageSize(const cv::Mat& img, Datum* datum);
+    #endif  // USE_OPENCV
+
     // Transform and return the transformation information.
     void Transform(const Datum& datum, Dtype* transformed_data,
                     NormalizedBBox* crop_bbox, bool* do_mirror);
@@ -313,6 +432,13 @@ namespace caffe {
     Phase phase_;
     Blob<Dtype> data_mean_;
     vector<Dtype> mean_values_;
+    StageStats* stats_;
+    #ifdef USE_OPENCV
+    const Datum* decoded_datum_;
+    cv::Mat decoded_image_;
+    // Output buffer of DistortImage, valid until its next call
+    cv::Mat distort_image_;
+    #endif  // USE_OPENCV
     };
 
 }  // namespace caffe
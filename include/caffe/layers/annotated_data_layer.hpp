@@ -12,6 +12,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/image_cache.hpp"
 
 namespace caffe {
 
@@ -30,8 +31,12 @@ public:
 
 protected:
     virtual void load_batch(Batch<Dtype>* batch);
+    void load_item(Batch<Dtype>* batch,
+                const vector<AnnotatedDatum*>& anno_datums, Dtype* top_data,
+                Dtype* top_label, vector<vector<AnnotationGroup> >& all_anno,
+                int item_id, int worker_id);
     void fill_label(Dtype* top_label, int batch_size, 
-                std::map<int, vector<AnnotationGroup> > all_anno, 
+                const vector<vector<AnnotationGroup> >& all_anno, 
                 int num_bboxes, 
                 int label_last_channels);
     void check_landmarks_value(AnnoFaceLandmarks lmarks);
@@ -48,6 +53,10 @@ protected:
     bool YoloFormat_;
     AnnotatedDataParameter_CROP_TYPE crop_type_;
     bool has_landmarks_;
+    bool lazy_crop_;
+#ifdef USE_OPENCV
+    shared_ptr<DecodedImageCache> image_cache_;
+#endif  // USE_OPENCV
     int jj;
     int batch_id;
 };
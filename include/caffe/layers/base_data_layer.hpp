@@ -9,6 +9,9 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/spsc_queue.hpp"
+#include "caffe/util/stage_stats.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -81,18 +84,49 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
+  // Time spent in each stage of loading batches, e.g. reading, decoding
+  // and transforming, since the last stats()->Reset().
+  inline StageStats* stats() { return &stats_; }
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
-
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
-  BlockingQueue<Batch<Dtype>*> prefetch_free_;
-  BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  // Pops the next prefetched batch for Forward, timing the wait.
+  Batch<Dtype>* NextBatch();
+  // Batches are recycled through prefetch_free_ and prefetch_full_. Every
+  // batch is kept at least as large as the biggest one loaded so far, so that
+  // batches of varying size stop reallocating their (pinned) buffers.
+  void ReserveBatch(Batch<Dtype>* batch);
+  void UpdateBatchCapacity(const Batch<Dtype>& batch);
+
+  /**
+   * @brief Runs fn(item_id, worker_id) for every item of a batch on the
+   *    data_param().num_workers() transform workers. Called on the prefetch
+   *    thread from load_batch; returns once all items are done.
+   */
+  void ParallelForItems(int batch_size,
+      const boost::function<void(int, int)>& fn);
+  // Per-worker transformer and destination blob. Worker 0 is the prefetch
+  // thread and uses data_transformer_ and transformed_data_.
+  DataTransformer<Dtype>* worker_transformer(int worker_id);
+  Blob<Dtype>* worker_transformed_data(int worker_id);
+
+  // Prefetches data_param().prefetch() batches (asynchronously if to GPU
+  // memory). The prefetch thread is the only consumer of prefetch_free_ and
+  // producer of prefetch_full_, Forward the other end of both.
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
+  SPSCQueue<Batch<Dtype>*> prefetch_free_;
+  SPSCQueue<Batch<Dtype>*> prefetch_full_;
+  int data_capacity_;
+  int label_capacity_;
 
   Blob<Dtype> transformed_data_;
+
+  shared_ptr<ThreadPool> workers_;
+  vector<shared_ptr<DataTransformer<Dtype> > > worker_transformers_;
+  vector<shared_ptr<Blob<Dtype> > > worker_transformed_data_;
+
+  StageStats stats_;
 };
 
 template <typename Dtype>
@@ -143,17 +177,17 @@ class ImageDataPrefetchingDataLayer :
       const vector<Blob<Dtype>*>& top);
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(pairBatch<Dtype>* batch) = 0;
 
-  pairBatch<Dtype> prefetch_[PREFETCH_COUNT];
+  // Prefetches data_param().prefetch() batches (asynchronously if to GPU
+  // memory)
+  vector<shared_ptr<pairBatch<Dtype> > > prefetch_;
 
-  BlockingQueue<pairBatch<Dtype>*> prefetch_free_;
-  BlockingQueue<pairBatch<Dtype>*> prefetch_full_;
+  SPSCQueue<pairBatch<Dtype>*> prefetch_free_;
+  SPSCQueue<pairBatch<Dtype>*> prefetch_full_;
 
   Blob<Dtype> transformed_data_;
 };
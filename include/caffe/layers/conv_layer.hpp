@@ -58,11 +58,17 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  first group and input channels 3-4 and output channels 5-8 into the second
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
-   *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
-   *    kernels + stream parallelism) engines.
+   *  - activation / negative_slope (\b optional, default NONE). A ReLU or
+   *    ReLU6 applied to the output while it is in cache, as set by
+   *    FuseLayers. Only supported in TEST nets.
+   *  - engine: convolution has CAFFE (matrix multiplication), CUDNN (library
+   *    kernels + stream parallelism) and DEPTHWISE (direct CPU kernels for
+   *    group == channels, see DepthwiseConvolutionLayer) engines.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Convolution"; }
 
@@ -77,6 +83,15 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  // Applies the activation to the output of one image.
+  void forward_cpu_activation(Dtype* output);
+#ifndef CPU_ONLY
+  void forward_gpu_activation(Dtype* output);
+#endif
+
+  ConvolutionParameter_Activation activation_;
+  Dtype negative_slope_;
 };
 
 }  // namespace caffe
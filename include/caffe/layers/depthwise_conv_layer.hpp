@@ -0,0 +1,51 @@
+#ifndef CAFFE_DEPTHWISE_CONV_LAYER_HPP_
+#define CAFFE_DEPTHWISE_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Direct CPU implementation of a 2D ConvolutionLayer with
+ *        group == channels, as in the MobileNet blocks.
+ *        Fallback to ConvolutionLayer for GPU mode and other convolutions.
+ *
+ * ConvolutionLayer computes such a convolution with one im2col and one tiny
+ * matrix multiplication per channel. This layer convolves each channel
+ * directly instead, with the vectorized caffe_cpu_depthwise_conv forward
+ * and direct loops over the taps backward, without a column buffer. The
+ * output channels may be a multiple of the channels.
+ */
+template <typename Dtype>
+class DepthwiseConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit DepthwiseConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // Accumulates the gradients of one image w.r.t. the weights and the input
+  // into weight_diff and input_diff, either of which may be NULL.
+  void backward_cpu_depthwise(const Dtype* input, const Dtype* output_diff,
+      const Dtype* weight, Dtype* weight_diff, Dtype* input_diff);
+
+  // Whether the convolution is depthwise and 2D, else ConvolutionLayer
+  // computes it.
+  bool depthwise_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DEPTHWISE_CONV_LAYER_HPP_
@@ -76,6 +76,8 @@ class CenternetDetectionOutputLayer : public Layer<Dtype> {
     std::map<int, std::vector<CenterNetInfo> > results_;
     Dtype nms_thresh_;
     bool has_lm_;
+    bool nms_heatmap_;
+    shared_ptr<ThreadPool> nms_pool_;
 };
 
 }  // namespace caffe
@@ -15,6 +15,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using namespace boost::property_tree;  // NOLINT(build/namespaces)
 
@@ -63,6 +64,10 @@ class DetectionOutputLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  // Decodes the confident bboxes of the (image, class) pair job and runs the
+  // nms on them, on the thread worker_id of nms_pool_.
+  void ApplyNMSJob(const Dtype* loc_data, const Dtype* conf_data, int job,
+      int worker_id);
   /// @brief Not implemented
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
@@ -112,6 +117,28 @@ class DetectionOutputLayer : public Layer<Dtype> {
   Blob<Dtype> bbox_permute_;
   Blob<Dtype> conf_permute_;
 
+  // Prior bboxes decoded by Forward_cpu, kept while bottom[2] holds the same
+  // prior_data_.
+  vector<Dtype> prior_data_;
+  vector<BBox> prior_bboxes_;
+  vector<float> prior_variances_;
+
+  // The prior indices and decoded bboxes kept by the nms of a job.
+  struct NMSResult {
+    vector<int> indices;
+    vector<BBox> bboxes;
+  };
+  // Buffers of a worker of the nms.
+  struct NMSScratch {
+    vector<BBox> bboxes;
+    vector<float> scores;
+    vector<int> prior_indices;
+    vector<int> kept;
+  };
+  vector<NMSResult> nms_results_;
+  vector<NMSScratch> nms_scratch_;
+  shared_ptr<ThreadPool> nms_pool_;
+
 };
 
 }  // namespace caffe
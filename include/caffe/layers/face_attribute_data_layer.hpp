@@ -29,6 +29,9 @@ class faceAttributeDataLayer: public BasePrefetchingDataLayer<Dtype>{
 
     protected:
         virtual void load_batch(Batch<Dtype>* batch);
+        void load_item(Batch<Dtype>* batch,
+                const vector<AnnoFaceAttributeDatum*>& anno_datums, Dtype* top_data,
+                vector<AnnoFaceAttribute>& all_anno, int item_id, int worker_id);
 
         DataReader<AnnoFaceAttributeDatum> reader_;
         bool has_anno_type_;
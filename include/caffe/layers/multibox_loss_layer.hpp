@@ -103,6 +103,8 @@ class MultiBoxSSDLossLayer : public LossLayer<Dtype> {
   int num_conf_;
   vector<map<int, vector<int> > > all_match_indices_;
   vector<vector<int> > all_neg_indices_;
+  // Threads matching the images of a batch, if more than one.
+  shared_ptr<ThreadPool> match_pool_;
 
   int iterations_;
 
@@ -79,7 +79,8 @@ class Net {
    * @brief Reshape all layers from bottom to top.
    *
    * This is useful to propagate changes to layer sizes without running
-   * a forward pass, e.g. to compute output feature size.
+   * a forward pass, e.g. to compute output feature size. When the memory of
+   * the net is planned, it is planned again after the next forward.
    */
   void Reshape();
 
@@ -188,6 +189,14 @@ class Net {
   inline const vector<bool>& has_params_decay() const {
     return has_params_decay_;
   }
+  /**
+   * @brief returns whether each learnable parameter gets a gradient. The
+   *        diffs of those that do not are never cleared nor applied, so they
+   *        are never allocated.
+   */
+  inline const vector<bool>& params_need_diff() const {
+    return params_need_diff_;
+  }
   const map<string, int>& param_names_index() const {
     return param_names_index_;
   }
@@ -228,6 +237,10 @@ class Net {
   static bool StateMeetsRule(const NetState& state, const NetStateRule& rule,
       const string& layer_name);
 
+  /// @brief Bytes of the arena shared by the planned blobs, 0 until the
+  ///        memory of the net is planned.
+  inline size_t planned_memory_used() const { return planned_memory_used_; }
+
  protected:
   // Helpers for Init.
   /// @brief Append a new top blob to the net.
@@ -241,6 +254,22 @@ class Net {
   /// @brief Append a new parameter blob to the net.
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
+  /**
+   * @brief Places the data of the blobs between the layers in one arena,
+   *        blobs that are not live at the same layer sharing memory.
+   *
+   * Inputs and outputs of the net and the tops of layers without bottoms,
+   * e.g. data layers, keep their own memory. Blobs sharing data, e.g.
+   * through split or reshape layers, are placed together, which is why it
+   * runs after a whole forward.
+   */
+  void PlanMemory();
+  /**
+   * @brief Sets params_need_diff_: in TRAIN nets the params with a non-zero
+   *        lr_mult and those a layer propagates down to. Logs the diff memory
+   *        the net does without.
+   */
+  void InitParamsNeedDiff();
 
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
@@ -302,8 +331,16 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// whether learnable_params_ are learned or get a gradient from backward
+  vector<bool> params_need_diff_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// Whether the data of the blobs between the layers is planned, and the
+  /// arena holding it.
+  bool plan_memory_;
+  bool memory_planned_;
+  shared_ptr<SyncedMemory> memory_arena_;
+  size_t planned_memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
   /// The root net that actually holds the shared layers in data parallelism
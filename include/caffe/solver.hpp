@@ -111,6 +111,8 @@ class Solver {
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
+  // Logs and resets the stage timings of the train net's data layers.
+  void LogDataStats();
   void UpdateSmoothedLoss(Dtype loss, int start_iter, int average_loss);
   /// Harmonize solver class type with configured proto type.
   void CheckType(SolverParameter* param);
@@ -17,6 +17,7 @@
 #include "glog/logging.h"
 
 #include "caffe/caffe.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -32,6 +33,29 @@ typedef MultiFaceAttriLossParameter_AttriLossType PoseAttriLossType;
 
 typedef map<int, vector<NormalizedBBox> > LabelBBox;
 
+// A bbox as a plain struct, for the loops over every prior or prediction of
+// a batch, where the allocations, has-bits and accessors of NormalizedBBox
+// dominate. The functions taking NormalizedBBox have overloads for it where
+// DetectionOutputLayer and the CenterNet layers need them.
+struct BBox {
+  float xmin;
+  float ymin;
+  float xmax;
+  float ymax;
+  int label;
+  float score;
+  // BBoxSize() of the bbox, or -1 if it is not known, like an unset size of
+  // NormalizedBBox.
+  float size;
+};
+
+typedef map<int, vector<BBox> > LabelBoxes;
+
+// Convert between NormalizedBBox and BBox. The fields BBox does not have are
+// left alone.
+void ToBBox(const NormalizedBBox& bbox, BBox* box);
+void ToNormalizedBBox(const BBox& box, NormalizedBBox* bbox);
+
 // Function used to sort NormalizedBBox, stored in STL container (e.g. vector),
 // in ascend order based on the score value.
 bool SortBBoxAscend(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2);
@@ -64,12 +88,14 @@ void IntersectBBox(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2,
 
 // Compute bbox size.
 float BBoxSize(const NormalizedBBox& bbox, const bool normalized = true);
+float BBoxSize(const BBox& bbox, const bool normalized = true);
 
 template <typename Dtype>
 Dtype BBoxSize(const Dtype* bbox, const bool normalized = true);
 
 // Clip the NormalizedBBox such that the range for each corner is [0, 1].
 void ClipBBox(const NormalizedBBox& bbox, NormalizedBBox* clip_bbox);
+void ClipBBox(const BBox& bbox, BBox* clip_bbox);
 
 // Clip the bbox such that the bbox is within [0, 0; width, height].
 void ClipBBox(const NormalizedBBox& bbox, const float height, const float width,
@@ -104,9 +130,34 @@ void ExtrapolateBBox(const ResizeParameter& param, const int height,
 float JaccardOverlap(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2,
                      const bool normalized = true);
 
+float JaccardOverlap(const BBox& bbox1, const BBox& bbox2,
+                     const bool normalized = true);
+
 template <typename Dtype>
 Dtype JaccardOverlap(const Dtype* bbox1, const Dtype* bbox2);
 
+// A set of normalized bboxes stored as one array per coordinate, so that the
+// overlaps of a bbox with all of them are computed over contiguous memory.
+struct BBoxArray {
+  BBoxArray() {}
+  explicit BBoxArray(const vector<NormalizedBBox>& bboxes);
+
+  inline int count() const { return xmin.size(); }
+  bool IsCrossBoundary(const int i) const;
+
+  vector<float> xmin;
+  vector<float> ymin;
+  vector<float> xmax;
+  vector<float> ymax;
+  // BBoxSize() of each bbox.
+  vector<float> size;
+};
+
+// Compute the jaccard overlap of every bbox in bboxes with bbox, i.e.
+// overlaps[i] = JaccardOverlap(bboxes[i], bbox), with SIMD where available.
+void JaccardOverlaps(const BBoxArray& bboxes, const NormalizedBBox& bbox,
+                     float* overlaps);
+
 // Compute the coverage of bbox1 by bbox2.
 float BBoxCoverage(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2);
 
@@ -125,6 +176,11 @@ void DecodeBBox(const NormalizedBBox& prior_bbox,
     const vector<float>& prior_variance, const CodeType code_type,
     const bool variance_encoded_in_target, const bool clip_bbox,
     const NormalizedBBox& bbox, NormalizedBBox* decode_bbox);
+// prior_variance holds 4 values, it is not read if
+// variance_encoded_in_target.
+void DecodeBBox(const BBox& prior_bbox, const float* prior_variance,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip_bbox, const BBox& bbox, BBox* decode_bbox);
 
 // Decode a set of bboxes according to a set of prior bboxes.
 void DecodeBBoxes(const vector<NormalizedBBox>& prior_bboxes,
@@ -132,6 +188,12 @@ void DecodeBBoxes(const vector<NormalizedBBox>& prior_bboxes,
     const CodeType code_type, const bool variance_encoded_in_target,
     const bool clip_bbox, const vector<NormalizedBBox>& bboxes,
     vector<NormalizedBBox>* decode_bboxes);
+// prior_variances holds 4 values per prior bbox.
+void DecodeBBoxes(const vector<BBox>& prior_bboxes,
+    const vector<float>& prior_variances,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip_bbox, const vector<BBox>& bboxes,
+    vector<BBox>* decode_bboxes);
 
 // Decode all bboxes in a batch.
 void DecodeBBoxesAll(const vector<LabelBBox>& all_loc_pred,
@@ -141,6 +203,13 @@ void DecodeBBoxesAll(const vector<LabelBBox>& all_loc_pred,
     const int num_loc_classes, const int background_label_id,
     const CodeType code_type, const bool variance_encoded_in_target,
     const bool clip, vector<LabelBBox>* all_decode_bboxes);
+void DecodeBBoxesAll(const vector<LabelBoxes>& all_loc_pred,
+    const vector<BBox>& prior_bboxes,
+    const vector<float>& prior_variances,
+    const int num, const bool share_location,
+    const int num_loc_classes, const int background_label_id,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip, vector<LabelBoxes>* all_decode_bboxes);
 
 // Match prediction bboxes with ground truth bboxes.
 void MatchBBox(const vector<NormalizedBBox>& gt,
@@ -152,6 +221,18 @@ void MatchBBox(const vector<NormalizedBBox>& gt,
     vector<int> bbox_small_list, vector<int> bbox_large_list,
     vector<int> receptive_filed_list, int input_height, int input_width);
 
+// The same with the prediction bboxes stored as a BBoxArray, e.g. to match
+// the same prior bboxes against the ground truth of several images.
+void MatchBBox(const vector<NormalizedBBox>& gt,
+    const BBoxArray& pred_bboxes, const int label,
+    const MatchType match_type, const float overlap_threshold,
+    const bool ignore_cross_boundary_bbox,
+    vector<int>* match_indices, vector<float>* match_overlaps,
+    const bool use_tiny_box_match, const bool use_center_locate_match,
+    const vector<int>& bbox_small_list, const vector<int>& bbox_large_list,
+    const vector<int>& receptive_filed_list, int input_height,
+    int input_width);
+
 // Find matches between prediction bboxes and ground truth bboxes.
 //    all_loc_preds: stores the location prediction, where each item contains
 //      location prediction for an image.
@@ -161,13 +242,15 @@ void MatchBBox(const vector<NormalizedBBox>& gt,
 //    multibox_loss_param: stores the parameters for MultiBoxLossLayer.
 //    all_match_overlaps: stores jaccard overlaps between predictions and gt.
 //    all_match_indices: stores mapping between predictions and ground truth.
+//    pool: if not NULL, matches the images of the batch in parallel on it.
 void FindMatches(const vector<LabelBBox>& all_loc_preds,
       const map<int, vector<NormalizedBBox> >& all_gt_bboxes,
       const vector<NormalizedBBox>& prior_bboxes,
       const vector<vector<float> >& prior_variances,
       const MultiBoxLossParameter& multibox_loss_param,
       vector<map<int, vector<float> > >* all_match_overlaps,
-      vector<map<int, vector<int> > >* all_match_indices);
+      vector<map<int, vector<int> > >* all_match_indices,
+      ThreadPool* pool = NULL);
 
 // Count the number of matches from the match indices.
 int CountNumMatches(const vector<map<int, vector<int> > >& all_match_indices,
@@ -237,6 +320,10 @@ template <typename Dtype>
 void GetLocPredictions(const Dtype* loc_data, const int num,
       const int num_preds_per_class, const int num_loc_classes,
       const bool share_location, vector<LabelBBox>* loc_preds);
+template <typename Dtype>
+void GetLocPredictions(const Dtype* loc_data, const int num,
+      const int num_preds_per_class, const int num_loc_classes,
+      const bool share_location, vector<LabelBoxes>* loc_preds);
 
 // Encode the localization prediction and ground truth for each matched prior.
 //    all_loc_preds: stores the location prediction, where each item contains
@@ -384,6 +471,10 @@ template <typename Dtype>
 void GetPriorBBoxes(const Dtype* prior_data, const int num_priors,
       vector<NormalizedBBox>* prior_bboxes,
       vector<vector<float> >* prior_variances);
+// The same with 4 prior_variances per prior bbox.
+template <typename Dtype>
+void GetPriorBBoxes(const Dtype* prior_data, const int num_priors,
+      vector<BBox>* prior_bboxes, vector<float>* prior_variances);
 
 // Get detection results from det_data.
 //    det_data: 1 x 1 x num_det x 7 blob.
@@ -463,6 +554,10 @@ void ApplyNMSFast(const vector<NormalizedBBox>& bboxes,
       const vector<float>& scores, const float score_threshold,
       const float nms_threshold, const float eta, const int top_k,
       vector<int>* indices);
+void ApplyNMSFast(const vector<BBox>& bboxes,
+      const vector<float>& scores, const float score_threshold,
+      const float nms_threshold, const float eta, const int top_k,
+      vector<int>* indices);
 
 // Do non maximum suppression based on raw bboxes and scores data.
 // Inspired by Piotr Dollar's NMS implementation in EdgeBox.
@@ -11,6 +11,8 @@
 #include "glog/logging.h"
 
 #include "caffe/caffe.hpp"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 typedef struct _YoloScoreShow{
@@ -45,16 +47,25 @@ void CopyDiffToBottom(const Dtype* pre_offset_diff, const Dtype* pre_wh_diff, co
                         bool share_location, Dtype* bottom_diff, const int num_channels,
                         const std::map<int, vector<std::pair<NormalizedBBox, AnnoFaceLandmarks> > >& all_gt_bboxes);
 
+// Decodes and nms the detections of each image, keeping at most top_k of
+// them by descending score when top_k > 0. The images run on pool if given.
+// With nms_heatmap only the cells that are the max of their 3x3 neighborhood
+// in keep_max_data are candidates, otherwise every cell above conf_thresh.
 template <typename Dtype>
 void get_topK(const Dtype* keep_max_data, const Dtype* loc_data, const int output_height
                 , const int output_width, const int channels, const int num_batch
                 , std::map<int, std::vector<CenterNetInfo > >* results
-                , const int loc_channels, bool has_lm,  Dtype conf_thresh, Dtype nms_thresh);      
+                , const int loc_channels, bool has_lm,  Dtype conf_thresh, Dtype nms_thresh
+                , const int top_k = -1, ThreadPool* pool = NULL, bool nms_heatmap = false);
 
 
+// Sets peaks to the indices of the cells of conf_data above conf_thresh that
+// a 3x3 max pooling with stride 1 and padding 1 leaves unchanged, in
+// increasing order.
 template <typename Dtype>
-void _nms_heatmap(const Dtype* conf_data, Dtype* keep_max_data, const int output_height
-                  , const int output_width, const int channels, const int num_batch);
+void _nms_heatmap(const Dtype* conf_data, const int output_height, const int output_width
+                  , const int channels, const int num_batch, Dtype conf_thresh
+                  , std::vector<int>* peaks);
 
 template <typename Dtype>
 void GenerateBatchHeatmap(const std::map<int, vector<std::pair<NormalizedBBox, AnnoFaceLandmarks> > >& all_gt_bboxes, Dtype* gt_heatmap, 
@@ -63,6 +74,11 @@ void GenerateBatchHeatmap(const std::map<int, vector<std::pair<NormalizedBBox, A
 
 void hard_nms(std::vector<CenterNetInfo>& input, std::vector<CenterNetInfo>* output, float nmsthreshold = 0.3,
                               int type=NMS_UNION);
+// The same on plain bboxes whose size holds the area, picked receives the
+// indices of the kept bboxes in descending score order, at most max_picked
+// of them when it is not negative.
+void hard_nms(const std::vector<BBox>& input, std::vector<int>* picked, float nmsthreshold = 0.3,
+                              int type=NMS_UNION, int max_picked=-1);
 
 
 void soft_nms(std::vector<CenterNetInfo>& input, std::vector<CenterNetInfo>* output, 
@@ -18,6 +18,10 @@ class Cursor {
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
+  // The current value without copying it out of the backend's storage. The
+  // pointer stays valid until the cursor is moved or destroyed.
+  virtual const char* value_data() = 0;
+  virtual size_t value_size() = 0;
   virtual bool valid() = 0;
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
@@ -0,0 +1,53 @@
+#ifndef CAFFE_UTIL_FUSE_LAYERS_HPP_
+#define CAFFE_UTIL_FUSE_LAYERS_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Copies a net for TEST with the BatchNorm, BatchNormScale, Scale and
+ *    Bias layers that follow a Convolution folded into its weights and bias,
+ *    and the ReLU or ReLU6 after them into its activation.
+ *
+ * The trained blobs of the layers of param are looked up by layer name in
+ * weights, as in Net::CopyTrainedLayersFrom; both may be the same
+ * NetParameter. fused_weights receives the blobs for fused_param, so that
+ *
+ *   Net<float> net(fused_param);
+ *   net.CopyTrainedLayersFrom(fused_weights);
+ *
+ * computes what param computes with weights, in fewer passes over the
+ * activations. Only a chain of layers that each read nothing but the output
+ * of the previous one, with no other reader of the intermediate blobs, is
+ * folded. Returns the number of layers folded.
+ */
+int FuseLayers(const NetParameter& param, const NetParameter& weights,
+    NetParameter* fused_param, NetParameter* fused_weights);
+
+/**
+ * @brief Loads a TEST net with FuseLayers applied, where
+ *
+ *   Net<Dtype> net(param_file, TEST, level, stages);
+ *   net.CopyTrainedLayersFrom(trained_filename);
+ *
+ * would load it unfused.
+ *
+ * The layers are rewritten before Net::Init, so the net never holds the
+ * folded layers or their outputs. The fusion needs the trained statistics,
+ * which a Net only gets after Init, so the weights are read from
+ * trained_filename first; HDF5 weights are read by a temporary unfused net.
+ */
+template <typename Dtype>
+shared_ptr<Net<Dtype> > LoadFusedNet(const string& param_file,
+    const string& trained_filename, const int level = 0,
+    const vector<string>* stages = NULL);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FUSE_LAYERS_HPP_
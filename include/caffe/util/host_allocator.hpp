@@ -0,0 +1,96 @@
+#ifndef CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include <stdint.h>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Allocates the host memory of SyncedMemory when it is not pinned by
+ *    CUDA.
+ *
+ * Free is always called on the allocator that allocated the memory, with the
+ * size it was allocated with, from any thread.
+ */
+class HostAllocator {
+ public:
+  virtual ~HostAllocator() {}
+  virtual void* Allocate(size_t size) = 0;
+  virtual void Free(void* ptr, size_t size) = 0;
+};
+
+// malloc and free, the default allocator.
+class SystemHostAllocator : public HostAllocator {
+ public:
+  SystemHostAllocator() {}
+  virtual void* Allocate(size_t size);
+  virtual void Free(void* ptr, size_t size);
+
+DISABLE_COPY_AND_ASSIGN(SystemHostAllocator);
+};
+
+struct HostAllocatorStats {
+  // Bytes allocated and not freed yet, and their maximum.
+  size_t current_bytes;
+  size_t peak_bytes;
+  // Bytes of freed blocks kept for reuse.
+  size_t cached_bytes;
+  uint64_t allocations;
+  // Allocations served by a cached block.
+  uint64_t hits;
+};
+
+/**
+ * @brief Caches freed blocks by size class, so that reallocating a size seen
+ *    before does not go through the system allocator.
+ *
+ * Sizes are rounded up to 64 bytes, then to one of four classes per power of
+ * two, which wastes at most a quarter of a block. Blocks are 64-byte aligned
+ * for the SIMD kernels. Each thread keeps a few freed blocks of each class
+ * that it reuses without locking; the others go to a pool shared by all the
+ * threads, up to max_cached_bytes. Blocks larger than max_block_size are not
+ * cached.
+ */
+class PoolingHostAllocator : public HostAllocator {
+ public:
+  explicit PoolingHostAllocator(size_t max_cached_bytes = size_t(1) << 30,
+      size_t max_block_size = size_t(1) << 28);
+  virtual ~PoolingHostAllocator();
+
+  virtual void* Allocate(size_t size);
+  virtual void Free(void* ptr, size_t size);
+
+  HostAllocatorStats stats() const;
+  // Frees the blocks of the shared pool and of the calling thread's cache.
+  void Trim();
+
+  // The size a request of size bytes is rounded up to.
+  static size_t BlockSize(size_t size);
+
+ protected:
+  // The shared pool and the stats, kept alive by the thread caches.
+  class Pool;
+  // The cache of each thread, kept out of the header as in BlockingQueue.
+  class ThreadCaches;
+
+  shared_ptr<Pool> pool_;
+  shared_ptr<ThreadCaches> caches_;
+
+DISABLE_COPY_AND_ASSIGN(PoolingHostAllocator);
+};
+
+/**
+ * @brief Sets the allocator of the host memory of the SyncedMemory allocated
+ *    from now on, or restores the SystemHostAllocator if allocator is NULL.
+ *
+ * Installed allocators are kept until the process exits, so that the memory
+ * they allocated can always be freed.
+ */
+void SetHostAllocator(const shared_ptr<HostAllocator>& allocator);
+HostAllocator* GetHostAllocator();
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_ALLOCATOR_HPP_
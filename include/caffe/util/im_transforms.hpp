@@ -88,6 +88,14 @@ void RandomOrderChannels(const cv::Mat& in_img, cv::Mat* out_img,
                          const float random_order_prob);
 
 cv::Mat ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param);
+
+// Distorts the 8-bit image in_img into out_img, which is reused if it already
+// has the right size and type. Brightness and contrast are applied in one
+// lookup table pass, saturation and hue in one round trip through HSV, with
+// the same random draws as the separate Random* functions. in_img is not
+// written to.
+void ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param,
+    cv::Mat* out_img);
 #endif  // USE_OPENCV
 
 }  // namespace caffe
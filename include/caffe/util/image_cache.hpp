@@ -0,0 +1,71 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_HPP_
+#define CAFFE_UTIL_IMAGE_CACHE_HPP_
+
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include <list>
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief A thread-safe cache of decoded images keyed by database key, holding
+ *        at most max_bytes of pixel data and evicting the least recently used
+ *        image first.
+ *
+ * Images are shared with the cache rather than copied in and out, so callers
+ * must not write to them.
+ */
+class DecodedImageCache {
+ public:
+  explicit DecodedImageCache(size_t max_bytes);
+
+  /**
+   * @brief Looks up key and marks it as most recently used.
+   * @return true and sets *img on a hit.
+   */
+  bool Get(const string& key, cv::Mat* img);
+  /**
+   * @brief Inserts or replaces key, evicting old images to stay within the
+   *    byte budget. Images larger than the whole budget are not cached.
+   */
+  void Put(const string& key, const cv::Mat& img);
+
+  size_t size() const;
+  size_t bytes() const;
+  inline size_t max_bytes() const { return max_bytes_; }
+  uint64_t hits() const;
+  uint64_t misses() const;
+
+ protected:
+  struct Entry {
+    string key;
+    cv::Mat img;
+    size_t bytes;
+  };
+  typedef std::list<Entry> EntryList;
+
+  void Evict(size_t needed);
+
+  const size_t max_bytes_;
+  size_t bytes_;
+  uint64_t hits_;
+  uint64_t misses_;
+  // Most recently used first
+  EntryList entries_;
+  map<string, EntryList::iterator> index_;
+  shared_ptr<boost::mutex> mutex_;
+
+DISABLE_COPY_AND_ASSIGN(DecodedImageCache);
+};
+
+}  // namespace caffe
+
+#endif  // USE_OPENCV
+#endif  // CAFFE_UTIL_IMAGE_CACHE_HPP_
@@ -315,8 +315,30 @@ cv::Mat ReadImageToCVMat(const string& filename,
 
 cv::Mat ReadImageToCVMat(const string& filename);
 
+/**
+ * @brief Like ReadImageToCVMat(filename, height, width, is_color), but lets
+ *    the JPEG decoder shrink the image by up to 8x in the DCT domain before it
+ *    is resized to height x width, see GetJPEGReducedScale.
+ */
+cv::Mat ReadImageToCVMatReduced(const string& filename,
+    const int height, const int width, const bool is_color);
+
+/**
+ * @brief Returns the largest scale in {1, 2, 4, 8} by which the JPEG in data
+ *    can be shrunk while it is decoded so that it is still at least
+ *    min_height x min_width. If exact, only scales that divide both sides of
+ *    the image are considered, which keeps its aspect ratio unchanged.
+ *    Returns 1 if data is not a JPEG or the decoder cannot reduce images.
+ */
+int GetJPEGReducedScale(const string& data, const int min_height,
+    const int min_width, const bool exact);
+
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum);
 cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color);
+// Decode at 1/scale of the original size, with scale from GetJPEGReducedScale
+cv::Mat DecodeDatumToCVMatNative(const Datum& datum, const int scale);
+cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color,
+    const int scale);
 
 void EncodeCVMatToDatum(const cv::Mat& cv_img, const string& encoding,
                         Datum* datum);
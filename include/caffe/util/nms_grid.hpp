@@ -0,0 +1,71 @@
+#ifndef CAFFE_UTIL_NMS_GRID_HPP_
+#define CAFFE_UTIL_NMS_GRID_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/bbox_util.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A uniform grid over the kept boxes of a greedy NMS, so that each
+ *    candidate is only tested against the kept boxes it can overlap instead
+ *    of against all of them.
+ *
+ * Boxes are registered in every cell their [min, max] span touches, so a
+ * pair of boxes whose spans intersect always shares a cell. Pairs that do
+ * not are only skipped, never suppressed, which makes the result identical
+ * to testing every pair as long as a zero overlap never suppresses. Boxes
+ * with non-finite coordinates are tested against everything.
+ */
+class NMSGrid {
+ public:
+  NMSGrid();
+
+  /**
+   * @brief Empties the grid and lays it over the extent of boxes, with a
+   *    number of cells that suits num_candidates greedy steps. A grid for
+   *    0 candidates has a single cell, i.e. every kept box is tested.
+   *
+   * margin widens the spans of the queried boxes, for overlaps that are
+   * positive for boxes up to that far apart, e.g. 1 for pixel boxes whose
+   * widths are computed as xmax - xmin + 1.
+   */
+  void Reset(const vector<BBox>& boxes, const int num_candidates,
+      const float margin = 0);
+  // Registers boxes[index] as kept.
+  void Insert(const BBox& box, const int index);
+  /**
+   * @brief Sets indices to the kept boxes that may overlap box, each once,
+   *    in no particular order.
+   */
+  void Query(const BBox& box, vector<int>* indices);
+
+  inline int side() const { return side_; }
+
+ protected:
+  // Cell range touched by the span of box widened by margin. Returns false
+  // if the box has non-finite coordinates.
+  bool CellRange(const BBox& box, const float margin, int* x0, int* y0,
+      int* x1, int* y1) const;
+
+  float xmin_;
+  float ymin_;
+  float cell_width_;
+  float cell_height_;
+  float margin_;
+  int side_;
+  vector<vector<int> > cells_;
+  // Kept boxes with non-finite coordinates.
+  vector<int> unbounded_;
+  // Query() stamps the kept boxes it has collected to skip duplicates.
+  vector<int> stamps_;
+  int stamp_;
+
+DISABLE_COPY_AND_ASSIGN(NMSGrid);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NMS_GRID_HPP_
@@ -0,0 +1,94 @@
+#ifndef CAFFE_UTIL_SIMD_HPP_
+#define CAFFE_UTIL_SIMD_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+namespace caffe {
+
+// Instruction sets the vectorized CPU kernels below can use, from least to
+// most capable.
+enum SimdLevel {
+  SIMD_SCALAR = 0,
+  SIMD_SSE41 = 1,
+  SIMD_AVX2 = 2
+};
+
+/**
+ * @brief Returns the most capable SimdLevel the CPU and the compiler support.
+ *    It is detected once, on the first call.
+ */
+SimdLevel caffe_cpu_simd_level();
+
+/**
+ * @brief Converts an interleaved 8-bit height x width x channels image into
+ *    planar channels x height x width data, computing
+ *    dst = (src - mean[c]) * scale.
+ *
+ * @param src_step bytes between the starts of two rows of src.
+ * @param mean one value per channel, or NULL to skip mean subtraction.
+ * @param mirror whether to flip every row horizontally.
+ * @param max_level the most capable kernel to use, e.g. SIMD_SCALAR to force
+ *    the reference implementation. Only float has vectorized kernels, for 1
+ *    and 3 channels; they produce the same values as the scalar code.
+ */
+template <typename Dtype>
+void caffe_cpu_hwc_to_chw(const int height, const int width,
+    const int channels, const uint8_t* src, const int src_step,
+    const Dtype* mean, const Dtype scale, const bool mirror, Dtype* dst,
+    const SimdLevel max_level = SIMD_AVX2);
+
+/**
+ * @brief Computes the Jaccard overlap of n normalized boxes, given as one
+ *    array per coordinate and their sizes, with the box
+ *    [xmin, ymin, xmax, ymax] of the given size.
+ *
+ * overlaps[i] is the value JaccardOverlap(box i, box) returns for boxes with
+ * the same sizes; the vectorized kernels produce the same values as the
+ * scalar code.
+ */
+void caffe_cpu_jaccard_overlap(const int n, const float* xmin,
+    const float* ymin, const float* xmax, const float* ymax,
+    const float* size, const float* box, const float box_size,
+    float* overlaps, const SimdLevel max_level = SIMD_AVX2);
+
+/**
+ * @brief Finds the peaks of channels height x width maps, i.e. the values
+ *    above threshold that a 3x3 max pooling with stride 1 and padding 1
+ *    leaves unchanged, and appends their indices
+ *    c * height * width + h * width + w to peaks in increasing order.
+ *
+ * The pooling is separable: the max of each row triplet, then of the three
+ * row maxima. The maps are padded by repeating their border values, which
+ * keeps the same maxima without testing for the border. Only float has
+ * vectorized kernels; they find the same peaks as the scalar code.
+ */
+template <typename Dtype>
+void caffe_cpu_heatmap_peaks(const int channels, const int height,
+    const int width, const Dtype* data, const Dtype threshold,
+    std::vector<int>* peaks, const SimdLevel max_level = SIMD_AVX2);
+
+/**
+ * @brief Computes the depthwise convolution of channels height x width maps:
+ *    output channel c of channels * multiplier is input channel
+ *    c / multiplier convolved with the kernel_h x kernel_w filter c of
+ *    weight, plus bias[c] unless bias is NULL. This is what
+ *    ConvolutionLayer computes with group == channels, without im2col.
+ *
+ * Each output value is the bias plus the taps in row-major kernel order.
+ * The columns whose taps are all inside the input are computed in vectors
+ * for stride_w 1 and 2, with unrolled loops for 3 and 5 wide kernels; they
+ * produce the same values as the scalar code. Only float has vectorized
+ * kernels.
+ */
+template <typename Dtype>
+void caffe_cpu_depthwise_conv(const Dtype* input, const int channels,
+    const int height, const int width, const int multiplier,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const Dtype* weight, const Dtype* bias,
+    Dtype* output, const SimdLevel max_level = SIMD_AVX2);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SIMD_HPP_
@@ -0,0 +1,57 @@
+#ifndef CAFFE_UTIL_SPSC_QUEUE_HPP_
+#define CAFFE_UTIL_SPSC_QUEUE_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A bounded lock-free ring buffer for a single producer and a single
+ *        consumer, with the interface of BlockingQueue.
+ *
+ * push and pop only touch the ring and two atomic counters unless they have
+ * to wait. A waiting side first polls, then yields, and finally parks on a
+ * condition variable, which is an interruption point as in BlockingQueue.
+ * push waits while the queue holds capacity() elements.
+ *
+ * Several threads may take turns as producer or consumer, as long as their
+ * calls are serialized, e.g. by the forward mutex of a shared layer.
+ */
+template<typename T>
+class SPSCQueue {
+ public:
+  explicit SPSCQueue(size_t capacity);
+
+  void push(const T& t);
+
+  bool try_pop(T* t);
+
+  // This logs a message if the thread needs to be parked
+  // useful for detecting e.g. when data feeding is too slow
+  T pop(const string& log_on_wait = "");
+
+  bool try_peek(T* t);
+
+  // Return element without removing it
+  T peek();
+
+  size_t size() const;
+
+  inline size_t capacity() const { return capacity_; }
+
+ protected:
+  // Atomics and synchronization fields, kept out of the header for the same
+  // reasons as in BlockingQueue.
+  class sync;
+
+  const size_t capacity_;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(SPSCQueue);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SPSC_QUEUE_HPP_
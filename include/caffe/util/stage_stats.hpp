@@ -0,0 +1,81 @@
+#ifndef CAFFE_UTIL_STAGE_STATS_HPP_
+#define CAFFE_UTIL_STAGE_STATS_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief Thread-safe accumulator of the time a data layer spends in each
+ *    stage of producing batches, so that the stage starving the net can be
+ *    found in release builds.
+ *
+ * Stages run by the transform workers are summed over all workers, i.e. they
+ * measure CPU time rather than wall time. Times are exclusive: a stage timed
+ * inside another one, e.g. a decode inside a crop, is not counted twice.
+ */
+class StageStats {
+ public:
+  enum Stage {
+    READ,        // waiting for records from the DataReader
+    DECODE,      // decoding encoded images
+    SAMPLE,      // generating crop samples
+    DISTORT,     // photometric distortion
+    EXPAND,      // zoom-out expansion
+    CROP,        // cropping samples
+    TRANSFORM,   // resize, mean, scale and copy into the batch
+    QUEUE_WAIT,  // Forward waiting for a prefetched batch
+    NUM_STAGES
+  };
+
+  StageStats();
+
+  void Add(Stage stage, double microseconds);
+  // Counts a batch finished by the prefetch thread.
+  void AddBatch();
+  void Reset();
+
+  static const char* StageName(Stage stage);
+  double total_ms(Stage stage) const;
+  int batches() const;
+  /**
+   * @brief Average milliseconds per batch of every stage that was timed,
+   *    e.g. "read 0.4 ms, decode 12.1 ms, transform 3.2 ms".
+   */
+  string ToString() const;
+
+ protected:
+  double total_us_[NUM_STAGES];
+  int batches_;
+  shared_ptr<boost::mutex> mutex_;
+
+DISABLE_COPY_AND_ASSIGN(StageStats);
+};
+
+/**
+ * @brief Adds the lifetime of the timer, minus that of the timers nested in
+ *    it on the same thread, to a stage. Does nothing if stats is NULL.
+ */
+class StageTimer {
+ public:
+  StageTimer(StageStats* stats, StageStats::Stage stage);
+  ~StageTimer();
+
+ protected:
+  StageStats* stats_;
+  StageStats::Stage stage_;
+  StageTimer* parent_;
+  double nested_us_;
+  CPUTimer timer_;
+
+DISABLE_COPY_AND_ASSIGN(StageTimer);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_STAGE_STATS_HPP_
@@ -0,0 +1,54 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of worker threads that split an index range [0, count).
+ *
+ * Index i is always processed by worker (i % num_threads()), in increasing
+ * order, so callers that keep per-worker state (e.g. one DataTransformer and
+ * RNG stream per worker) get the same results for a fixed seed regardless of
+ * thread scheduling. Worker 0 is the thread calling Run(); the remaining
+ * workers are InternalThreads and inherit device, mode and a random seed from
+ * the thread that constructed the pool.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  inline int num_threads() const { return num_threads_; }
+
+  /**
+   * @brief Calls fn(index, worker_id) for every index in [0, count) and
+   *    returns once all of them are done.
+   */
+  void Run(int count, const boost::function<void(int, int)>& fn);
+
+ protected:
+  class Worker;
+
+  void RunShare(int worker_id);
+
+  const int num_threads_;
+  vector<shared_ptr<Worker> > workers_;
+  BlockingQueue<int> done_;
+
+  // State of the job currently being run, published to the workers through
+  // their job queues.
+  const boost::function<void(int, int)>* fn_;
+  int count_;
+
+DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
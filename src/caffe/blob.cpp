@@ -59,6 +59,16 @@ void Blob<Dtype>::ReshapeLike(const Blob<Dtype>& other) {
   Reshape(other.shape());
 }
 
+template <typename Dtype>
+void Blob<Dtype>::Reserve(const int count) {
+  CHECK_GE(count, 0);
+  if (count > capacity_) {
+    capacity_ = count;
+    data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  }
+}
+
 template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
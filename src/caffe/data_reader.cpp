@@ -65,7 +65,9 @@ template <typename T>
 DataReader<T>::QueuePair::QueuePair(int size) {
   // Initialize the free queue with requested number of data
   for (int i = 0; i < size; ++i) {
-    free_.push(new T());
+    T* t = new T();
+    keys_[t] = string();
+    free_.push(t);
   }
 }
 
@@ -80,6 +82,67 @@ DataReader<T>::QueuePair::~QueuePair() {
   }
 }
 
+template <typename T>
+class DataReader<T>::Body::Shard : public InternalThread {
+ public:
+    // If ordered, the shard fills the items pushed to todo_ in order and
+    // returns them through done_. Otherwise it takes free items from the
+    // queue pairs itself, round-robin starting at qps[offset % qps.size()].
+    Shard(db::Cursor* cursor, int offset, int stride,
+        const vector<shared_ptr<QueuePair> >& qps, bool ordered)
+        : cursor_(cursor), offset_(offset), stride_(stride), qps_(qps),
+          ordered_(ordered) {
+        StartInternalThread();
+    }
+    virtual ~Shard() {
+        StopInternalThread();
+        T* t;
+        while (todo_.try_pop(&t)) {
+            delete t;
+        }
+        while (done_.try_pop(&t)) {
+            delete t;
+        }
+    }
+
+    BlockingQueue<T*> todo_;
+    BlockingQueue<T*> done_;
+
+ protected:
+    void InternalThreadEntry() {
+        try {
+            // Record r goes to qps[r % qps.size()] when ordered, so the
+            // shard knows which queue pair each of its items belongs to.
+            int qp_id = offset_ % qps_.size();
+            while (!must_stop()) {
+                QueuePair* qp = qps_[qp_id].get();
+                T* t = ordered_ ? todo_.pop() : qp->free_.pop();
+                t->ParseFromArray(cursor_->value_data(),
+                    cursor_->value_size());
+                qp->set_key(t, cursor_->key());
+                if (ordered_) {
+                    done_.push(t);
+                    qp_id = (qp_id + stride_) % qps_.size();
+                } else {
+                    qp->full_.push(t);
+                    qp_id = (qp_id + 1) % qps_.size();
+                }
+                Body::skip(cursor_, stride_);
+            }
+        } catch (boost::thread_interrupted&) {
+            // Interrupted exception is expected on shutdown
+        }
+    }
+
+    db::Cursor* cursor_;
+    const int offset_;
+    const int stride_;
+    const vector<shared_ptr<QueuePair> >& qps_;
+    const bool ordered_;
+
+  DISABLE_COPY_AND_ASSIGN(Shard);
+};
+
 template <typename T>
 DataReader<T>::Body::Body(const LayerParameter& param)
     : param_(param),
@@ -109,6 +172,10 @@ void DataReader<T>::Body::InternalThreadEntry() {
             read_one(cursor.get(), qp.get());
             qps.push_back(qp);
         }
+        if (param_.data_param().num_readers() > 1) {
+            read_sharded(db.get(), solver_count, qps);
+            return;
+        }
         // Main loop
         while (!must_stop()) {
             for (int i = 0; i < solver_count; ++i) {
@@ -128,15 +195,85 @@ void DataReader<T>::Body::InternalThreadEntry() {
 template <typename T>
 void DataReader<T>::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
     T* t = qp->free_.pop();
-    // TODO deserialize in-place instead of copy?
-    t->ParseFromString(cursor->value());
+    // Parse straight from the backend's storage, there is no need to copy
+    // the record first
+    t->ParseFromArray(cursor->value_data(), cursor->value_size());
+    qp->set_key(t, cursor->key());
     qp->full_.push(t);
 
     // go to the next iter
-    cursor->Next();
-    if (!cursor->valid()) {
-        DLOG(INFO) << "Restarting data prefetching from start.";
-        cursor->SeekToFirst();
+    skip(cursor, 1);
+}
+
+template <typename T>
+void DataReader<T>::Body::read_sharded(db::DB* db, int first_record,
+    const vector<shared_ptr<QueuePair> >& qps) {
+    const int num_readers = param_.data_param().num_readers();
+    const bool deterministic = param_.data_param().deterministic_read();
+    const int solver_count = qps.size();
+    LOG(INFO) << "Reading " << param_.data_param().source() << " with "
+        << num_readers << " readers";
+    // Cursors are opened here, as opening them concurrently is not safe for
+    // every backend, and positioned so that shard i continues the sequence
+    // of the single reader at record first_record + i. Shards are declared
+    // last so that they are stopped before their cursors are closed.
+    vector<shared_ptr<db::Cursor> > cursors;
+    vector<shared_ptr<Shard> > shards;
+    for (int i = 0; i < num_readers; ++i) {
+        cursors.push_back(shared_ptr<db::Cursor>(db->NewCursor()));
+        skip(cursors[i].get(), first_record + i);
+        shards.push_back(shared_ptr<Shard>(new Shard(cursors[i].get(),
+            first_record + i, num_readers, qps, deterministic)));
+    }
+    if (!deterministic) {
+        // Shards feed the solvers on their own, just wait for shutdown.
+        new_queue_pairs_.peek();
+        LOG(FATAL) << "A second reader was created for source "
+            << param_.data_param().source();
+    }
+    // Hand free items to the shards in record order and collect them back in
+    // the same order. Items are handed out ahead to keep every shard busy, but
+    // only block on a free item when none is in flight, since the item waited
+    // for might otherwise be one that still has to be collected.
+    const int max_in_flight = 2 * num_readers;
+    int in_flight = 0;
+    int dispatch_shard = 0, dispatch_qp = first_record % solver_count;
+    int collect_shard = 0, collect_qp = dispatch_qp;
+    while (!must_stop()) {
+        T* t;
+        while (in_flight < max_in_flight) {
+            BlockingQueue<T*>& free = qps[dispatch_qp]->free_;
+            if (in_flight == 0) {
+                t = free.pop();
+            } else if (!free.try_pop(&t)) {
+                break;
+            }
+            shards[dispatch_shard]->todo_.push(t);
+            dispatch_shard = (dispatch_shard + 1) % num_readers;
+            dispatch_qp = (dispatch_qp + 1) % solver_count;
+            ++in_flight;
+        }
+        t = shards[collect_shard]->done_.pop();
+        qps[collect_qp]->full_.push(t);
+        collect_shard = (collect_shard + 1) % num_readers;
+        collect_qp = (collect_qp + 1) % solver_count;
+        --in_flight;
+        CHECK_EQ(new_queue_pairs_.size(), 0);
+    }
+    // The interruption that ended the loop is still pending and would cut
+    // short joining the shards, which still use their queues.
+    boost::this_thread::disable_interruption no_interruption;
+    shards.clear();
+}
+
+template <typename T>
+void DataReader<T>::Body::skip(db::Cursor* cursor, int count) {
+    for (int i = 0; i < count; ++i) {
+        cursor->Next();
+        if (!cursor->valid()) {
+            DLOG(INFO) << "Restarting data prefetching from start.";
+            cursor->SeekToFirst();
+        }
     }
 }
 
@@ -10,13 +10,17 @@
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/simd.hpp"
 
 namespace caffe {
 
 template<typename Dtype>
 DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
 		Phase phase)
-		: param_(param), phase_(phase) {
+		: param_(param), phase_(phase), stats_(NULL) {
+#ifdef USE_OPENCV
+	decoded_datum_ = NULL;
+#endif  // USE_OPENCV
 	// check if we want to use mean_file
 	if (param_.has_mean_file()) {
 		CHECK_EQ(param_.mean_value_size(), 0) <<
@@ -51,6 +55,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 																			 Dtype* transformed_data,
 																			 NormalizedBBox* crop_bbox,
 																			 bool* do_mirror) {
+	StageTimer stage_timer(stats_, StageStats::TRANSFORM);
 	const string& data = datum.data();
 	const int datum_channels = datum.channels();
 	const int datum_height = datum.height();
@@ -154,18 +159,11 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 																			 Blob<Dtype>* transformed_blob,
 																			 NormalizedBBox* crop_bbox,
 																			 bool* do_mirror) {
+	StageTimer stage_timer(stats_, StageStats::TRANSFORM);
 	// If datum is encoded, decoded and transform the cv::image.
 	if (datum.encoded()) {
 #ifdef USE_OPENCV
-		CHECK(!(param_.force_color() && param_.force_gray()))
-				<< "cannot set both force_color and force_gray";
-		cv::Mat cv_img;
-		if (param_.force_color() || param_.force_gray()) {
-		// If force_color then decode in color otherwise decode in gray.
-			cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-		} else {
-			cv_img = DecodeDatumToCVMatNative(datum);
-		}
+		cv::Mat cv_img = DecodeDatum(datum, true);
 		// Transform the cv::image into blob.
 		return Transform(cv_img, transformed_blob, crop_bbox, do_mirror);
 #else
@@ -515,18 +513,11 @@ void DataTransformer<Dtype>::TransformAnnoCcpd(
 template<typename Dtype>
 void DataTransformer<Dtype>::CropImageAnchor(const Datum& datum, const NormalizedBBox& bbox,
 												Datum* crop_datum) {
+	StageTimer stage_timer(stats_, StageStats::CROP);
 	// datum为encoded的，将其解码为cvMat Image, 再进行CropImage
 	if (datum.encoded()) {
 	#ifdef USE_OPENCV
-		CHECK(!(param_.force_color() && param_.force_gray()))
-				<< "cannot set both force_color and force_gray";
-		cv::Mat cv_img;
-		if (param_.force_color() || param_.force_gray()) {
-			// If force_color then decode in color otherwise decode in gray.
-			cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-		} else {
-			cv_img = DecodeDatumToCVMatNative(datum);
-		}
+		cv::Mat cv_img = DecodeDatum(datum);
 		// Crop the image.
 		cv::Mat crop_img;
 		CropImageData_Anchor(cv_img, bbox, &crop_img);
@@ -585,19 +576,11 @@ template<typename Dtype>
 void DataTransformer<Dtype>::CropImage(const Datum& datum,
 																			 const NormalizedBBox& bbox,
 																			 Datum* crop_datum) {
+	StageTimer stage_timer(stats_, StageStats::CROP);
 	// If datum is encoded, decode and crop the cv::image.
 	if (datum.encoded()) {
 	#ifdef USE_OPENCV
-		CHECK(!(param_.force_color() && param_.force_gray()))
-				<< "cannot set both force_color and force_gray";
-		cv::Mat cv_img;
-		if (param_.force_color() || param_.force_gray()) {
-			// If force_color then decode in color otherwise decode in gray.
-			cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-			
-		} else {
-			cv_img = DecodeDatumToCVMatNative(datum);
-		}
+		cv::Mat cv_img = DecodeDatum(datum);
 		// Crop the image.
 		cv::Mat crop_img;
 		CropImage(cv_img, bbox, &crop_img);
@@ -657,8 +640,16 @@ void DataTransformer<Dtype>::CropImage(const AnnotatedDatum& anno_datum,
 																			 AnnotatedDatum* cropped_anno_datum) {
 	// Crop the datum.
 	CropImage(anno_datum.datum(), bbox, cropped_anno_datum->mutable_datum());
+	CropAnnotation(anno_datum, bbox, cropped_anno_datum);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::CropAnnotation(const AnnotatedDatum& anno_datum,
+														const NormalizedBBox& bbox,
+														AnnotatedDatum* cropped_anno_datum) {
 	cropped_anno_datum->set_type(anno_datum.type());
-	
+	cropped_anno_datum->mutable_datum()->set_label(anno_datum.datum().label());
+
 	// Transform the annotation according to crop_bbox.
 	const bool do_resize = false;
 	const bool do_mirror = false;
@@ -688,18 +679,11 @@ void DataTransformer<Dtype>::ExpandImage(const Datum& datum,
 																				 const float expand_ratio,
 																				 NormalizedBBox* expand_bbox,
 																				 Datum* expand_datum) {
+	StageTimer stage_timer(stats_, StageStats::EXPAND);
 	// If datum is encoded, decode and crop the cv::image.
 	if (datum.encoded()) {
 #ifdef USE_OPENCV
-		CHECK(!(param_.force_color() && param_.force_gray()))
-				<< "cannot set both force_color and force_gray";
-		cv::Mat cv_img;
-		if (param_.force_color() || param_.force_gray()) {
-			// If force_color then decode in color otherwise decode in gray.
-			cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-		} else {
-			cv_img = DecodeDatumToCVMatNative(datum);
-		}
+		cv::Mat cv_img = DecodeDatum(datum);
 		// Expand the image.
 		cv::Mat expand_img;
 		ExpandImage(cv_img, expand_ratio, expand_bbox, &expand_img);
@@ -758,27 +742,33 @@ void DataTransformer<Dtype>::ExpandImage(const Datum& datum,
 }
 
 template<typename Dtype>
-void DataTransformer<Dtype>::ExpandImage(const AnnotatedDatum& anno_datum,
-																				 AnnotatedDatum* expanded_anno_datum) {
+bool DataTransformer<Dtype>::DrawExpandRatio(float* expand_ratio) {
 	if (!param_.has_expand_param()) {
-		expanded_anno_datum->CopyFrom(anno_datum);
-		return;
+		return false;
 	}
 	const ExpansionParameter& expand_param = param_.expand_param();
 	const float expand_prob = expand_param.prob();
 	float prob;
 	caffe_rng_uniform(1, 0.f, 1.f, &prob);
 	if (prob > expand_prob) {
-		expanded_anno_datum->CopyFrom(anno_datum);
-		return;
+		return false;
 	}
 	const float max_expand_ratio = expand_param.max_expand_ratio();
 	if (fabs(max_expand_ratio - 1.) < 1e-2) {
+		return false;
+	}
+	caffe_rng_uniform(1, 1.f, max_expand_ratio, expand_ratio);
+	return true;
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::ExpandImage(const AnnotatedDatum& anno_datum,
+																				 AnnotatedDatum* expanded_anno_datum) {
+	float expand_ratio;
+	if (!DrawExpandRatio(&expand_ratio)) {
 		expanded_anno_datum->CopyFrom(anno_datum);
 		return;
 	}
-	float expand_ratio;
-	caffe_rng_uniform(1, 1.f, max_expand_ratio, &expand_ratio);
 	// Expand the datum.
 	NormalizedBBox expand_bbox;
 	ExpandImage(anno_datum.datum(), expand_ratio, &expand_bbox,
@@ -792,29 +782,63 @@ void DataTransformer<Dtype>::ExpandImage(const AnnotatedDatum& anno_datum,
 											expanded_anno_datum->mutable_annotation_group());
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::ExpandAnnotation(const AnnotatedDatum& anno_datum,
+																				 NormalizedBBox* expand_bbox,
+																				 AnnotatedDatum* expanded_anno_datum) {
+	const Datum& datum = anno_datum.datum();
+	const int datum_height = datum.height();
+	const int datum_width = datum.width();
+	CHECK_GT(datum_height, 0) << "ExpandAnnotation needs the size of the datum";
+	CHECK_GT(datum_width, 0) << "ExpandAnnotation needs the size of the datum";
+	Datum* expanded_datum = expanded_anno_datum->mutable_datum();
+	expanded_datum->set_channels(datum.channels());
+	expanded_datum->set_height(datum_height);
+	expanded_datum->set_width(datum_width);
+	expanded_datum->set_label(datum.label());
+	expanded_anno_datum->set_type(anno_datum.type());
+	expand_bbox->set_xmin(0);
+	expand_bbox->set_ymin(0);
+	expand_bbox->set_xmax(1);
+	expand_bbox->set_ymax(1);
+
+	float expand_ratio;
+	if (!DrawExpandRatio(&expand_ratio)) {
+		expanded_anno_datum->mutable_annotation_group()->CopyFrom(
+				anno_datum.annotation_group());
+		return;
+	}
+	// Draw the offset of the image like ExpandImage does.
+	const int height = static_cast<int>(datum_height * expand_ratio);
+	const int width = static_cast<int>(datum_width * expand_ratio);
+	float h_off, w_off;
+	caffe_rng_uniform(1, 0.f, static_cast<float>(height - datum_height), &h_off);
+	caffe_rng_uniform(1, 0.f, static_cast<float>(width - datum_width), &w_off);
+	h_off = floor(h_off);
+	w_off = floor(w_off);
+	expand_bbox->set_xmin(-w_off/datum_width);
+	expand_bbox->set_ymin(-h_off/datum_height);
+	expand_bbox->set_xmax((width - w_off)/datum_width);
+	expand_bbox->set_ymax((height - h_off)/datum_height);
+	expanded_datum->set_height(height);
+	expanded_datum->set_width(width);
+
+	// Transform the annotation according to expand_bbox.
+	const bool do_resize = false;
+	const bool do_mirror = false;
+	TransformAnnotation(anno_datum, do_resize, *expand_bbox, do_mirror,
+											expanded_anno_datum->mutable_annotation_group());
+}
+
 
 template<typename Dtype>
 void DataTransformer<Dtype>::ExpandImage(const AnnoFaceAttributeDatum& anno_datum,
 																				 AnnoFaceAttributeDatum* expanded_anno_datum) {
-	if (!param_.has_expand_param()) {
-		expanded_anno_datum->CopyFrom(anno_datum);
-		return;
-	}
-	const ExpansionParameter& expand_param = param_.expand_param();
-	const float expand_prob = expand_param.prob();
-	float prob;
-	caffe_rng_uniform(1, 0.f, 1.f, &prob);
-	if (prob > expand_prob) {
-		expanded_anno_datum->CopyFrom(anno_datum);
-		return;
-	}
-	const float max_expand_ratio = expand_param.max_expand_ratio();
-	if (fabs(max_expand_ratio - 1.) < 1e-2) {
+	float expand_ratio;
+	if (!DrawExpandRatio(&expand_ratio)) {
 		expanded_anno_datum->CopyFrom(anno_datum);
 		return;
 	}
-	float expand_ratio;
-	caffe_rng_uniform(1, 1.f, max_expand_ratio, &expand_ratio);
 	// Expand the datum.
 	NormalizedBBox expand_bbox;
 	ExpandImage(anno_datum.datum(), expand_ratio, &expand_bbox,
@@ -833,25 +857,11 @@ void DataTransformer<Dtype>::ExpandImage(const AnnoFaceAttributeDatum& anno_datu
 template<typename Dtype>
 void DataTransformer<Dtype>::ExpandImage(const AnnotatedCCpdDatum& anno_datum,
 																				 AnnotatedCCpdDatum* expanded_anno_datum) {
-	if (!param_.has_expand_param()) {
-		expanded_anno_datum->CopyFrom(anno_datum);
-		return;
-	}
-	const ExpansionParameter& expand_param = param_.expand_param();
-	const float expand_prob = expand_param.prob();
-	float prob;
-	caffe_rng_uniform(1, 0.f, 1.f, &prob);
-	if (prob > expand_prob) {
-		expanded_anno_datum->CopyFrom(anno_datum);
-		return;
-	}
-	const float max_expand_ratio = expand_param.max_expand_ratio();
-	if (fabs(max_expand_ratio - 1.) < 1e-2) {
+	float expand_ratio;
+	if (!DrawExpandRatio(&expand_ratio)) {
 		expanded_anno_datum->CopyFrom(anno_datum);
 		return;
 	}
-	float expand_ratio;
-	caffe_rng_uniform(1, 1.f, max_expand_ratio, &expand_ratio);
 	// Expand the datum.
 	NormalizedBBox expand_bbox;
 	ExpandImage(anno_datum.datum(), expand_ratio, &expand_bbox,
@@ -871,6 +881,7 @@ void DataTransformer<Dtype>::ExpandImage(const AnnotatedCCpdDatum& anno_datum,
 template<typename Dtype>
 void DataTransformer<Dtype>::DistortImage(const Datum& datum,
                                                         Datum* distort_datum) {
+	StageTimer stage_timer(stats_, StageStats::DISTORT);
 	if (!param_.has_distort_param()) {
 		distort_datum->CopyFrom(datum);
 		return;
@@ -878,19 +889,11 @@ void DataTransformer<Dtype>::DistortImage(const Datum& datum,
 	// If datum is encoded, decode and crop the cv::image.
 	if (datum.encoded()) {
 	#ifdef USE_OPENCV
-		CHECK(!(param_.force_color() && param_.force_gray()))
-				<< "cannot set both force_color and force_gray";
-		cv::Mat cv_img;
-		if (param_.force_color() || param_.force_gray()) {
-			// If force_color then decode in color otherwise decode in gray.
-			cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-		} else {
-			cv_img = DecodeDatumToCVMatNative(datum);
-		}
-		// Distort the image.
-		cv::Mat distort_img = ApplyDistort(cv_img, param_.distort_param());
+		cv::Mat cv_img = DecodeDatum(datum);
+		// Distort the image into a buffer reused across calls.
+		ApplyDistort(cv_img, param_.distort_param(), &distort_image_);
 		// Save the image into datum.
-		EncodeCVMatToDatum(distort_img, "jpg", distort_datum);
+		EncodeCVMatToDatum(distort_image_, "jpg", distort_datum);
 		distort_datum->set_label(datum.label());
 		return;
 	#else
@@ -902,6 +905,216 @@ void DataTransformer<Dtype>::DistortImage(const Datum& datum,
 }
 
 #ifdef USE_OPENCV
+template<typename Dtype>
+void DataTransformer<Dtype>::DistortImage(const Datum& datum,
+		Datum* distort_datum, cv::Mat* img) {
+	if (!param_.has_distort_param() || (img->empty() && !datum.encoded())) {
+		DistortImage(datum, distort_datum);
+		return;
+	}
+	StageTimer stage_timer(stats_, StageStats::DISTORT);
+	const cv::Mat cv_img = img->empty() ? DecodeDatum(datum) : *img;
+	// Distort the image into a buffer reused across calls.
+	ApplyDistort(cv_img, param_.distort_param(), &distort_image_);
+	*img = distort_image_;
+	SetImageSize(*img, distort_datum);
+	distort_datum->set_label(datum.label());
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::ExpandImage(const Datum& datum,
+		const float expand_ratio, NormalizedBBox* expand_bbox,
+		Datum* expanded_datum, cv::Mat* img) {
+	if (img->empty() && !datum.encoded()) {
+		ExpandImage(datum, expand_ratio, expand_bbox, expanded_datum);
+		return;
+	}
+	StageTimer stage_timer(stats_, StageStats::EXPAND);
+	const cv::Mat cv_img = img->empty() ? DecodeDatum(datum) : *img;
+	cv::Mat expand_img;
+	ExpandImage(cv_img, expand_ratio, expand_bbox, &expand_img);
+	*img = expand_img;
+	SetImageSize(*img, expanded_datum);
+	expanded_datum->set_label(datum.label());
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::ExpandImage(const AnnotatedDatum& anno_datum,
+		AnnotatedDatum* expanded_anno_datum, cv::Mat* img) {
+	float expand_ratio;
+	if (!DrawExpandRatio(&expand_ratio)) {
+		expanded_anno_datum->CopyFrom(anno_datum);
+		return;
+	}
+	NormalizedBBox expand_bbox;
+	ExpandImage(anno_datum.datum(), expand_ratio, &expand_bbox,
+							expanded_anno_datum->mutable_datum(), img);
+	expanded_anno_datum->set_type(anno_datum.type());
+	const bool do_resize = false;
+	const bool do_mirror = false;
+	TransformAnnotation(anno_datum, do_resize, expand_bbox, do_mirror,
+											expanded_anno_datum->mutable_annotation_group());
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::ExpandImage(
+		const AnnoFaceAttributeDatum& anno_datum,
+		AnnoFaceAttributeDatum* expanded_anno_datum, cv::Mat* img) {
+	float expand_ratio;
+	if (!DrawExpandRatio(&expand_ratio)) {
+		expanded_anno_datum->CopyFrom(anno_datum);
+		return;
+	}
+	NormalizedBBox expand_bbox;
+	ExpandImage(anno_datum.datum(), expand_ratio, &expand_bbox,
+							expanded_anno_datum->mutable_datum(), img);
+	expanded_anno_datum->set_type(anno_datum.type());
+	const bool do_resize = false;
+	const bool do_mirror = false;
+	const bool do_expand = true;
+	TransformAnnoFaceAttribute(anno_datum, do_resize, expand_bbox, do_mirror,
+											do_expand, expanded_anno_datum->mutable_faceattri());
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::ExpandImage(const AnnotatedCCpdDatum& anno_datum,
+		AnnotatedCCpdDatum* expanded_anno_datum, cv::Mat* img) {
+	float expand_ratio;
+	if (!DrawExpandRatio(&expand_ratio)) {
+		expanded_anno_datum->CopyFrom(anno_datum);
+		return;
+	}
+	NormalizedBBox expand_bbox;
+	ExpandImage(anno_datum.datum(), expand_ratio, &expand_bbox,
+							expanded_anno_datum->mutable_datum(), img);
+	expanded_anno_datum->set_type(anno_datum.type());
+	const bool do_resize = false;
+	const bool do_mirror = false;
+	const bool do_expand = true;
+	TransformAnnoCcpd(anno_datum, do_resize, expand_bbox, do_mirror, do_expand,
+											expanded_anno_datum->mutable_lpnumber());
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::CropImage(const Datum& datum,
+		const NormalizedBBox& bbox, Datum* crop_datum, cv::Mat* img) {
+	if (img->empty() && !datum.encoded()) {
+		CropImage(datum, bbox, crop_datum);
+		return;
+	}
+	StageTimer stage_timer(stats_, StageStats::CROP);
+	const cv::Mat cv_img = img->empty() ? DecodeDatum(datum) : *img;
+	cv::Mat crop_img;
+	CropImage(cv_img, bbox, &crop_img);
+	*img = crop_img;
+	SetImageSize(*img, crop_datum);
+	crop_datum->set_label(datum.label());
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::CropImageAnchor(const Datum& datum,
+		const NormalizedBBox& bbox, Datum* crop_datum, cv::Mat* img) {
+	if (img->empty() && !datum.encoded()) {
+		CropImageAnchor(datum, bbox, crop_datum);
+		return;
+	}
+	StageTimer stage_timer(stats_, StageStats::CROP);
+	const cv::Mat cv_img = img->empty() ? DecodeDatum(datum) : *img;
+	cv::Mat crop_img;
+	CropImageData_Anchor(cv_img, bbox, &crop_img);
+	*img = crop_img;
+	SetImageSize(*img, crop_datum);
+	crop_datum->set_label(datum.label());
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::CropImage(const AnnotatedDatum& anno_datum,
+		const NormalizedBBox& bbox, AnnotatedDatum* cropped_anno_datum,
+		cv::Mat* img) {
+	CropImage(anno_datum.datum(), bbox, cropped_anno_datum->mutable_datum(),
+						img);
+	CropAnnotation(anno_datum, bbox, cropped_anno_datum);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::CropImage_Sampling(
+		const AnnotatedDatum& anno_datum, const NormalizedBBox& bbox,
+		AnnotatedDatum* cropped_anno_datum, cv::Mat* img) {
+	CropImageAnchor(anno_datum.datum(), bbox,
+									cropped_anno_datum->mutable_datum(), img);
+	cropped_anno_datum->set_type(anno_datum.type());
+	const bool do_resize = false;
+	const bool do_mirror = false;
+	TransformAnnotation(anno_datum, do_resize, bbox, do_mirror,
+										cropped_anno_datum->mutable_annotation_group());
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::SetImageSize(const cv::Mat& img, Datum* datum) {
+	datum->set_channels(img.channels());
+	datum->set_height(img.rows);
+	datum->set_width(img.cols);
+	datum->clear_data();
+	datum->clear_float_data();
+	datum->set_encoded(true);
+}
+
+template<typename Dtype>
+cv::Mat DataTransformer<Dtype>::DecodeDatum(const Datum& datum,
+		bool will_resize) {
+	if (will_resize && param_.has_resize_param()) {
+		return DecodeDatumReduced(datum, param_.resize_param().height(),
+				param_.resize_param().width());
+	}
+	return DecodeDatumReduced(datum, 0, 0);
+}
+
+template<typename Dtype>
+cv::Mat DataTransformer<Dtype>::DecodeDatumReduced(const Datum& datum,
+		int min_height, int min_width) {
+	if (&datum == decoded_datum_) {
+		return decoded_image_;
+	}
+	CHECK(!datum.data().empty()) << "Encoded datum has no data";
+	StageTimer stage_timer(stats_, StageStats::DECODE);
+	CHECK(!(param_.force_color() && param_.force_gray()))
+			<< "cannot set both force_color and force_gray";
+	int scale = 1;
+	if (param_.has_resize_param() && param_.resize_param().reduced_decode()) {
+		// Only WARP may change the aspect ratio of the image.
+		scale = GetJPEGReducedScale(datum.data(), min_height, min_width,
+				param_.resize_param().resize_mode() !=
+				ResizeParameter_Resize_mode_WARP);
+	}
+	if (param_.force_color() || param_.force_gray()) {
+		// If force_color then decode in color otherwise decode in gray.
+		return DecodeDatumToCVMat(datum, param_.force_color(), scale);
+	} else {
+		return DecodeDatumToCVMatNative(datum, scale);
+	}
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::SetDecodedImage(const Datum* datum,
+		const cv::Mat& img) {
+	decoded_datum_ = datum;
+	decoded_image_ = img;
+}
+
+template<typename Dtype>
+cv::Scalar DataTransformer<Dtype>::ExpandBackground(int channels) {
+	cv::Scalar background(0, 0, 0, 0);
+	if (mean_values_.size() > 0) {
+		CHECK(mean_values_.size() == 1 || mean_values_.size() == channels)
+				<< "Specify either 1 mean_value or as many as channels: "
+				<< channels;
+		for (int c = 0; c < channels && c < 4; ++c) {
+			background[c] = mean_values_[mean_values_.size() == 1 ? 0 : c];
+		}
+	}
+	return background;
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
 																		Blob<Dtype>* transformed_blob) {
@@ -927,6 +1140,7 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 																			 Blob<Dtype>* transformed_blob,
 																			 NormalizedBBox* crop_bbox,
 																			 bool* do_mirror) {
+	StageTimer stage_timer(stats_, StageStats::TRANSFORM);
 	// Check dimensions.
 	const int img_channels = cv_img.channels();
 	const int channels = transformed_blob->channels();
@@ -1016,6 +1230,13 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 	CHECK(cv_cropped_image.data);
 
 	Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+	if (!has_mean_file) {
+		// Vectorized conversion with per-channel mean values.
+		caffe_cpu_hwc_to_chw(height, width, img_channels, cv_cropped_image.data,
+				cv_cropped_image.step, has_mean_values ? &mean_values_[0] : NULL,
+				scale, *do_mirror, transformed_data);
+		return;
+	}
 	int top_index;
 	for (int h = 0; h < height; ++h) {
 		const uchar* ptr = cv_cropped_image.ptr<uchar>(h);
@@ -1031,19 +1252,9 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 			for (int c = 0; c < img_channels; ++c) {
 				top_index = (c * height + h_idx_real) * width + w_idx_real;
 				Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-				if (has_mean_file) {
-					int mean_index = (c * img_height + h_off + h_idx_real) * img_width
-							+ w_off + w_idx_real;
-					transformed_data[top_index] =
-							(pixel - mean[mean_index]) * scale;
-				} else {
-					if (has_mean_values) {
-						transformed_data[top_index] =
-								(pixel - mean_values_[c]) * scale;
-					} else {
-						transformed_data[top_index] = pixel * scale;
-					}
-				}
+				int mean_index = (c * img_height + h_off + h_idx_real) * img_width
+						+ w_off + w_idx_real;
+				transformed_data[top_index] = (pixel - mean[mean_index]) * scale;
 			}
 		}
 	}
@@ -1129,6 +1340,63 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 	Transform(cv_img, transformed_blob, &crop_bbox, &do_mirror);
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
+		const AnnotatedDatum& anno_datum, Blob<Dtype>* transformed_blob,
+		vector<AnnotationGroup>* transformed_anno_vec) {
+	CHECK_EQ(cv_img.rows, anno_datum.datum().height());
+	CHECK_EQ(cv_img.cols, anno_datum.datum().width());
+	// Transform the image.
+	NormalizedBBox crop_bbox;
+	bool do_mirror;
+	Transform(cv_img, transformed_blob, &crop_bbox, &do_mirror);
+
+	// Transform annotation.
+	const bool do_resize = true;
+	RepeatedPtrField<AnnotationGroup> transformed_anno_group_all;
+	TransformAnnotation(anno_datum, do_resize, crop_bbox, do_mirror,
+											&transformed_anno_group_all);
+	for (int g = 0; g < transformed_anno_group_all.size(); ++g) {
+		transformed_anno_vec->push_back(transformed_anno_group_all.Get(g));
+	}
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
+		const AnnoFaceAttributeDatum& anno_datum, Blob<Dtype>* transformed_blob,
+		AnnoFaceAttribute* transformed_anno_vec) {
+	CHECK_EQ(cv_img.rows, anno_datum.datum().height());
+	CHECK_EQ(cv_img.cols, anno_datum.datum().width());
+	// Transform the image.
+	NormalizedBBox crop_bbox;
+	bool do_mirror;
+	Transform(cv_img, transformed_blob, &crop_bbox, &do_mirror);
+
+	// Transform annotation.
+	const bool do_resize = true;
+	const bool do_expand = false;
+	TransformAnnoFaceAttribute(anno_datum, do_resize, crop_bbox, do_mirror,
+											do_expand, transformed_anno_vec);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
+		const AnnotatedCCpdDatum& anno_datum, Blob<Dtype>* transformed_blob,
+		LicensePlate* transformed_anno_vec) {
+	CHECK_EQ(cv_img.rows, anno_datum.datum().height());
+	CHECK_EQ(cv_img.cols, anno_datum.datum().width());
+	// Transform the image.
+	NormalizedBBox crop_bbox;
+	bool do_mirror;
+	Transform(cv_img, transformed_blob, &crop_bbox, &do_mirror);
+
+	// Transform annotation.
+	const bool do_resize = true;
+	const bool do_expand = false;
+	TransformAnnoCcpd(anno_datum, do_resize, crop_bbox, do_mirror, do_expand,
+											transformed_anno_vec);
+}
+
 template <typename Dtype>
 void DataTransformer<Dtype>::CropImageData_Anchor(const cv::Mat& img,
 									const NormalizedBBox& bbox, cv::Mat* crop_img) {
@@ -1253,6 +1521,87 @@ void DataTransformer<Dtype>::ExpandImage(const cv::Mat& img,
 	img.copyTo((*expand_img)(bbox_roi));
 }
 
+template <typename Dtype>
+void DataTransformer<Dtype>::ExpandCropImage(const Datum& datum,
+																				 const NormalizedBBox& expand_bbox,
+																				 const NormalizedBBox& crop_bbox,
+																				 cv::Mat* crop_img) {
+	StageTimer stage_timer(stats_, StageStats::CROP);
+	CHECK(datum.encoded()) << "ExpandCropImage needs an encoded datum";
+	CHECK(!param_.has_mean_file())
+			<< "ExpandCropImage does not support mean_file";
+	const int datum_height = datum.height();
+	const int datum_width = datum.width();
+	CHECK_GT(datum_height, 0);
+	CHECK_GT(datum_width, 0);
+
+	// The expanded image and the position of the original one in it, which
+	// ExpandAnnotation drew in whole pixels.
+	const int expand_height = cvRound(
+			(expand_bbox.ymax() - expand_bbox.ymin()) * datum_height);
+	const int expand_width = cvRound(
+			(expand_bbox.xmax() - expand_bbox.xmin()) * datum_width);
+	const int expand_h_off = cvRound(-expand_bbox.ymin() * datum_height);
+	const int expand_w_off = cvRound(-expand_bbox.xmin() * datum_width);
+
+	// Get the crop dimension in the expanded image, like CropImage does, and
+	// move it to the original image.
+	NormalizedBBox clipped_bbox;
+	ClipBBox(crop_bbox, &clipped_bbox);
+	NormalizedBBox scaled_bbox;
+	ScaleBBox(clipped_bbox, expand_height, expand_width, &scaled_bbox);
+	const int crop_h_off = static_cast<int>(scaled_bbox.ymin()) - expand_h_off;
+	const int crop_w_off = static_cast<int>(scaled_bbox.xmin()) - expand_w_off;
+	const int crop_height =
+			static_cast<int>(scaled_bbox.ymax() - scaled_bbox.ymin());
+	const int crop_width =
+			static_cast<int>(scaled_bbox.xmax() - scaled_bbox.xmin());
+	CHECK_GT(crop_height, 0);
+	CHECK_GT(crop_width, 0);
+
+	// The crop is resized next, so the whole image may be decoded as small as
+	// makes the crop cover the resized size.
+	int min_height = 0;
+	int min_width = 0;
+	if (param_.has_resize_param()) {
+		const ResizeParameter& resize_param = param_.resize_param();
+		min_height = (resize_param.height() * datum_height + crop_height - 1) /
+				crop_height;
+		min_width = (resize_param.width() * datum_width + crop_width - 1) /
+				crop_width;
+	}
+	const cv::Mat img = DecodeDatumReduced(datum, min_height, min_width);
+	CHECK(img.data) << "Could not decode datum";
+	CHECK(img.depth() == CV_8U) << "Image data type must be unsigned byte";
+
+	// Scale the crop to the decoded image.
+	const float scale_h = static_cast<float>(img.rows) / datum_height;
+	const float scale_w = static_cast<float>(img.cols) / datum_width;
+	const cv::Rect crop_roi(cvRound(crop_w_off * scale_w),
+			cvRound(crop_h_off * scale_h),
+			std::max(cvRound(crop_width * scale_w), 1),
+			std::max(cvRound(crop_height * scale_h), 1));
+	const cv::Rect img_roi = crop_roi & cv::Rect(0, 0, img.cols, img.rows);
+
+	crop_img->create(crop_roi.height, crop_roi.width, img.type());
+	if (img_roi != crop_roi) {
+		// Fill the part outside the image with the mean values.
+		crop_img->setTo(ExpandBackground(img.channels()));
+	}
+	if (img_roi.area() > 0) {
+		cv::Mat dst = (*crop_img)(img_roi - crop_roi.tl());
+		if (param_.has_distort_param()) {
+			// Distort the image but not the background, as DistortImage runs
+			// before ExpandImage.
+			StageTimer distort_timer(stats_, StageStats::DISTORT);
+			ApplyDistort(img(img_roi), param_.distort_param(), &distort_image_);
+			distort_image_.copyTo(dst);
+		} else {
+			img(img_roi).copyTo(dst);
+		}
+	}
+}
+
 template <typename Dtype>
 vector<cv::Point2f> DataTransformer<Dtype>::getRotatePoint(int row, 
 											const vector<cv::Point2f> Points, 
@@ -1315,6 +1664,7 @@ cv::Mat DataTransformer<Dtype>::RotateImage(const cv::Mat& img, const int rotate
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(Blob<Dtype>* input_blob,
 																			 Blob<Dtype>* transformed_blob) {
+	StageTimer stage_timer(stats_, StageStats::TRANSFORM);
 	const int crop_size = param_.crop_size();
 	const int input_num = input_blob->num();
 	const int input_channels = input_blob->channels();
@@ -1431,15 +1781,7 @@ template<typename Dtype>
 vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
 	if (datum.encoded()) {
 #ifdef USE_OPENCV
-		CHECK(!(param_.force_color() && param_.force_gray()))
-				<< "cannot set both force_color and force_gray";
-		cv::Mat cv_img;
-		if (param_.force_color() || param_.force_gray()) {
-		// If force_color then decode in color otherwise decode in gray.
-			cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-		} else {
-			cv_img = DecodeDatumToCVMatNative(datum);
-		}
+		cv::Mat cv_img = DecodeDatum(datum, true);
 		// InferBlobShape using the cv::image.
 		return InferBlobShape(cv_img);
 #else
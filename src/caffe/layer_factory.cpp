@@ -8,6 +8,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layer_factory.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/depthwise_conv_layer.hpp"
 #include "caffe/layers/lrn_layer.hpp"
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/layers/relu_layer.hpp"
@@ -49,14 +50,27 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
 #endif
   if (engine == ConvolutionParameter_Engine_DEFAULT) {
     engine = ConvolutionParameter_Engine_CAFFE;
+    // A depthwise convolution, whose input channels the layer checks.
+    if (conv_param.group() > 1 &&
+        conv_param.group() == conv_param.num_output()) {
+      engine = ConvolutionParameter_Engine_DEPTHWISE;
+    }
 #ifdef USE_CUDNN
-    if (!use_dilation) {
+    // Only the Caffe engines apply a fused activation, and the depthwise one
+    // only runs on the CPU.
+    if (!use_dilation &&
+        conv_param.activation() == ConvolutionParameter_Activation_NONE &&
+        (engine != ConvolutionParameter_Engine_DEPTHWISE ||
+         Caffe::mode() == Caffe::GPU)) {
       engine = ConvolutionParameter_Engine_CUDNN;
     }
 #endif
   }
   if (engine == ConvolutionParameter_Engine_CAFFE) {
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_DEPTHWISE) {
+    return shared_ptr<Layer<Dtype> >(
+        new DepthwiseConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
     if (use_dilation) {
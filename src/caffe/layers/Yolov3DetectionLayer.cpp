@@ -11,6 +11,7 @@
 #include "caffe/layers/Yolov3DetectionLayer.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/nms_grid.hpp"
 
 namespace caffe {
 template <typename Dtype>
@@ -41,23 +42,23 @@ Dtype overlap(Dtype x1, Dtype w1, Dtype x2, Dtype w2)
 	return right - left;
 }
 template <typename Dtype>
-Dtype box_intersection(vector<Dtype> a, vector<Dtype> b)
+Dtype box_intersection(const PredictionResult<Dtype>& a, const PredictionResult<Dtype>& b)
 {
-	float w = overlap(a[0], a[2], b[0], b[2]);
-	float h = overlap(a[1], a[3], b[1], b[3]);
+	float w = overlap(a.x, a.w, b.x, b.w);
+	float h = overlap(a.y, a.h, b.y, b.h);
 	if (w < 0 || h < 0) return 0;
 	float area = w*h;
 	return area;
 }
 template <typename Dtype>
-Dtype box_union(vector<Dtype> a, vector<Dtype> b)
+Dtype box_union(const PredictionResult<Dtype>& a, const PredictionResult<Dtype>& b)
 {
 	float i = box_intersection(a, b);
-	float u = a[2] * a[3] + b[2] * b[3] - i;
+	float u = a.w * a.h + b.w * b.h - i;
 	return u;
 }
 template <typename Dtype>
-Dtype box_iou(vector<Dtype> a, vector<Dtype> b)
+Dtype box_iou(const PredictionResult<Dtype>& a, const PredictionResult<Dtype>& b)
 {
 	return box_intersection(a, b) / box_union(a, b);
 }
@@ -87,37 +88,33 @@ void setNormalizedBBox(NormalizedBBox& bbox, Dtype x, Dtype y, Dtype w, Dtype h)
 	float bbox_size = BBoxSize(bbox, true);
 	bbox.set_size(bbox_size);
 }
+// Greedy nms of the boxes, which are sorted by descending confidence.
 template <typename Dtype>
-void ApplyNms(vector< PredictionResult<Dtype> >& boxes, vector<int>& idxes, Dtype threshold) {
-	map<int, int> idx_map;
-	for (int i = 0; i < boxes.size() - 1; ++i) {
-		if (idx_map.find(i) != idx_map.end()) {
-			continue;
-		}
-		for (int j = i + 1; j < boxes.size(); ++j) {
-			if (idx_map.find(j) != idx_map.end()) {
-				continue;
-			}
-			vector<Dtype> Bbox1, Bbox2;
-			Bbox1.push_back(boxes[i].x);
-			Bbox1.push_back(boxes[i].y);
-			Bbox1.push_back(boxes[i].w);
-			Bbox1.push_back(boxes[i].h);
-
-			Bbox2.push_back(boxes[j].x);
-			Bbox2.push_back(boxes[j].y);
-			Bbox2.push_back(boxes[j].w);
-			Bbox2.push_back(boxes[j].h);
-
-			Dtype iou = box_iou(Bbox1, Bbox2);
-			if (iou >= threshold) {
-				idx_map[j] = 1;
-			}
-		}
+void ApplyNms(const vector< PredictionResult<Dtype> >& boxes, vector<int>& idxes, Dtype threshold) {
+	vector<BBox> bboxes(boxes.size());
+	for (int i = 0; i < boxes.size(); ++i) {
+		bboxes[i].xmin = boxes[i].x - boxes[i].w / 2;
+		bboxes[i].ymin = boxes[i].y - boxes[i].h / 2;
+		bboxes[i].xmax = boxes[i].x + boxes[i].w / 2;
+		bboxes[i].ymax = boxes[i].y + boxes[i].h / 2;
+		bboxes[i].label = boxes[i].classType;
+		bboxes[i].score = boxes[i].confidence;
+		bboxes[i].size = -1;
 	}
+	// Boxes without overlap have an iou of 0 (or 0 / 0), which only
+	// suppresses for a threshold <= 0.
+	NMSGrid grid;
+	grid.Reset(bboxes, threshold > 0 ? boxes.size() : 0);
+	vector<int> neighbors;
 	for (int i = 0; i < boxes.size(); ++i) {
-		if (idx_map.find(i) == idx_map.end()) {
+		grid.Query(bboxes[i], &neighbors);
+		bool keep = true;
+		for (int k = 0; k < neighbors.size() && keep; ++k) {
+			keep = !(box_iou(boxes[neighbors[k]], boxes[i]) >= threshold);
+		}
+		if (keep) {
 			idxes.push_back(i);
+			grid.Insert(bboxes[i], i);
 		}
 	}
 }
@@ -3,6 +3,7 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <map>
 #include <vector>
@@ -10,6 +11,7 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/annotated_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/util/sampler.hpp"
 
 #include "caffe/util/center_bbox_util.hpp"
@@ -63,6 +65,21 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
     YoloFormat_ = anno_data_param.yoloformat();
     crop_type_ = anno_data_param.crop_type();
     has_landmarks_ = anno_data_param.has_landmarks();
+    lazy_crop_ = false;
+#ifdef USE_OPENCV
+    if (anno_data_param.lazy_crop()) {
+        lazy_crop_ = !transform_param.has_mean_file() &&
+            (crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_BATCH ||
+             crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_JITTER ||
+             crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_DEFAULT);
+        LOG_IF(WARNING, !lazy_crop_) << "lazy_crop is ignored with mean_file, "
+            << "CROP_ANCHOR and CROP_GT_BBOX.";
+    }
+    if (anno_data_param.decoded_cache_mb() > 0) {
+        image_cache_.reset(new DecodedImageCache(
+            size_t(anno_data_param.decoded_cache_mb()) << 20));
+    }
+#endif  // USE_OPENCV
 
     // Read a data point, and use it to initialize the top blob.
     AnnotatedDatum& anno_datum = *(reader_.full().peek());
@@ -74,8 +91,8 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
     // Reshape top[0] and prefetch_data according to the batch_size.
     top_shape[0] = batch_size;
     top[0]->Reshape(top_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-        this->prefetch_[i].data_.Reshape(top_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+        this->prefetch_[i]->data_.Reshape(top_shape);
     }
     LOG(INFO) << "output data size: " << top[0]->num() << 
                 "," << top[0]->channels() << 
@@ -120,8 +137,8 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
             label_shape[0] = batch_size;
         }
         top[1]->Reshape(label_shape);
-        for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-            this->prefetch_[i].label_.Reshape(label_shape);
+        for (int i = 0; i < this->prefetch_.size(); ++i) {
+            this->prefetch_[i]->label_.Reshape(label_shape);
         }
     }
     batch_id = 0;
@@ -142,10 +159,6 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     // Reshape according to the first anno_datum of each batch
     // on single input batches allows for inputs of varying dimension.
     const int batch_size = this->layer_param_.data_param().batch_size();
-    const AnnotatedDataParameter& anno_data_param =
-        this->layer_param_.annotated_data_param();
-    const TransformationParameter& transform_param =
-    this->layer_param_.transform_param();
     AnnotatedDatum& anno_datum = *(reader_.full().peek());
     // Use data_transformer to infer the expected blob shape from anno_datum.
     vector<int> top_shape =
@@ -161,233 +174,28 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
         top_label = batch->label_.mutable_cpu_data();
     }
     // Store transformed annotation.
-    map<int, vector<AnnotationGroup> > all_anno;
+    vector<vector<AnnotationGroup> > all_anno(batch_size);
     int num_bboxes = 0;
+    vector<AnnotatedDatum*> anno_datums(batch_size);
     for (int item_id = 0; item_id < batch_size; ++item_id) {
         timer.Start();
+        StageTimer read_timer(&this->stats_, StageStats::READ);
         // get a anno_datum
-        AnnotatedDatum& anno_datum = *(reader_.full().pop("Waiting for data"));
-        #ifdef BOOL_TEST_DATA
-        cv::Mat sourceImage = DecodeDatumToCVMatNative(anno_datum.datum());
-        std::string src_save_folder = "../anchorTestImage";
-        std::string src_prefix_imgName = "source_image";
-        
-        std::string src_saved_img_name = src_save_folder + "/"+ src_prefix_imgName + "_"+ std::to_string(batch_id)+ "_"+ std::to_string(item_id) 
-                                        + "_" + std::to_string(jj) +".jpg";
-        cv::imwrite(src_saved_img_name, sourceImage);
-        #endif
+        anno_datums[item_id] = reader_.full().pop("Waiting for data");
         read_time += timer.MicroSeconds();
-        timer.Start();
-        AnnotatedDatum distort_datum;
-        AnnotatedDatum* expand_datum = NULL;
-        AnnotatedDatum* resized_anno_datum = NULL;
-        bool do_resize = false;
-        if (transform_param.has_distort_param()) {
-            distort_datum.CopyFrom(anno_datum);
-            this->data_transformer_->DistortImage(anno_datum.datum(),
-                                                distort_datum.mutable_datum());
-            if (transform_param.has_expand_param()) {
-                expand_datum = new AnnotatedDatum();
-                this->data_transformer_->ExpandImage(distort_datum, expand_datum);
-            } else {
-                expand_datum = &distort_datum;
-            }
-        } else {
-            if (transform_param.has_expand_param()) {
-                expand_datum = new AnnotatedDatum();
-                this->data_transformer_->ExpandImage(anno_datum, expand_datum);
-            } else {
-                expand_datum = &anno_datum;
-            }
-        }
-        AnnotatedDatum* sampled_datum = NULL;
-        bool has_sampled = false;
-        bool CropSample = false;
-        const int resized_height = transform_param.resize_param().height();
-        vector<NormalizedBBox> sampled_bboxes;
-        sampled_bboxes.clear();
-        if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_BATCH){
-            if (batch_samplers_.size() > 0) {
-                GenerateBatchSamples(*expand_datum, batch_samplers_, &sampled_bboxes);
-                CropSample = true;
-            } else {
-                sampled_datum = expand_datum;
-            }
-        }
-        else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_JITTER){
-            GenerateJitterSamples(*expand_datum, 0.1, &sampled_bboxes);
-            CropSample = true;
-        }
-        else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_ANCHOR){
-            if(data_anchor_samplers_.size() > 0){
-                GenerateBatchDataAnchorSamples(*expand_datum, data_anchor_samplers_, &sampled_bboxes, resized_height);
-                int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
-                sampled_datum = new AnnotatedDatum();
-                this->data_transformer_->CropImage_Sampling(*expand_datum,
-                                                    sampled_bboxes[rand_idx],
-                                                    sampled_datum);
-                has_sampled = true;
-            }else{
-                sampled_datum = expand_datum;
-            }
-        }
-        else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_GT_BBOX){
-            if (anno_data_param.has_bbox_sampler()) {
-                resized_anno_datum = new AnnotatedDatum();
-                do_resize = true;
-                GenerateLFFDSample(*expand_datum, &sampled_bboxes, 
-                                bbox_small_scale_, bbox_large_scale_, anchor_stride_,
-                                resized_anno_datum, transform_param, do_resize);
-                CHECK_GT(resized_anno_datum->datum().channels(), 0);
-                sampled_datum = new AnnotatedDatum();
-                this->data_transformer_->CropImage_Sampling(*resized_anno_datum,
-                                                sampled_bboxes[0], sampled_datum);
-                has_sampled = true;
-            } else {
-                sampled_datum = expand_datum;
-            }
-        }
-        else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_DEFAULT){
-            sampled_datum = expand_datum;
-        }
-        if(CropSample){        
-            if (sampled_bboxes.size() > 0) {
-                int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
-                sampled_datum = new AnnotatedDatum();
-                this->data_transformer_->CropImage(*expand_datum,
-                                                    sampled_bboxes[rand_idx],
-                                                    sampled_datum);
-                has_sampled = true;
-            } else {
-                sampled_datum = expand_datum;
-            }
-        }
-        CHECK(sampled_datum != NULL);
-        timer.Start();
-        vector<int> shape = this->data_transformer_->InferBlobShape(sampled_datum->datum());
-        if (transform_param.has_resize_param()) {
-            if (transform_param.resize_param().resize_mode() ==
-                ResizeParameter_Resize_mode_FIT_SMALL_SIZE) {
-                this->transformed_data_.Reshape(shape);
-                batch->data_.Reshape(shape);
-                top_data = batch->data_.mutable_cpu_data();
-            } else {
-                CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
-                        shape.begin() + 1));
-            }
-        } else {
-            CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
-                shape.begin() + 1));
-        }
-        // Apply data transformations (mirror, scale, crop...)
-        int offset = batch->data_.offset(item_id);
-        this->transformed_data_.set_cpu_data(top_data + offset);
-        vector<AnnotationGroup> transformed_anno_vec;
-        if (this->output_labels_) {
-            if (has_anno_type_) {
-                CHECK(sampled_datum->has_type()) << "Some datum misses AnnotationType.";
-                if (anno_data_param.has_anno_type()) {
-                    sampled_datum->set_type(anno_type_);
-                } else {
-                    CHECK_EQ(anno_type_, sampled_datum->type()) << "Different AnnotationType.";
-                }
-                // Transform datum and annotation_group at the same time
-                transformed_anno_vec.clear();
-                this->data_transformer_->Transform(*sampled_datum,
-                                                    &(this->transformed_data_),
-                                                    &transformed_anno_vec);
-                if (anno_type_ == AnnotatedDatum_AnnotationType_BBOX) {
-                    // Count the number of bboxes.
-                    for (int g = 0; g < transformed_anno_vec.size(); ++g) {
-                        num_bboxes += transformed_anno_vec[g].annotation_size();
-                    }
-                } else {
-                    LOG(FATAL) << "Unknown annotation type.";
-                }
-                all_anno[item_id] = transformed_anno_vec;
-            } else {
-                this->data_transformer_->Transform(sampled_datum->datum(),
-                                                    &(this->transformed_data_));
-                // Otherwise, store the label from datum.
-                CHECK(sampled_datum->datum().has_label()) << "Cannot find any label.";
-                top_label[item_id] = sampled_datum->datum().label();
-            }
-        } 
-        else {
-            this->data_transformer_->Transform(sampled_datum->datum(), &(this->transformed_data_));
-        }
-        # ifdef BOOL_TEST_DATA
-        cv::Mat cropImage;
-        std::string save_folder = "../anchorTestImage";
-        std::string prefix_imgName = "crop_image";
-        
-        std::string saved_img_name = save_folder + "/"+ prefix_imgName + "_"+ std::to_string(batch_id)+ "_"+ std::to_string(item_id) 
-                                        + "_" + std::to_string(jj) +".jpg";
-        const Dtype* data = this->transformed_data_.cpu_data();
-        int Trans_Height = this->transformed_data_.height();
-        int Trans_Width = this->transformed_data_.width();
-        cropImage = cv::Mat(Trans_Height, Trans_Width, CV_8UC3);
-        for(int row = 0; row < Trans_Height; row++){
-            unsigned char *ImgData = cropImage.ptr<uchar>(row);
-            for(int col = 0; col < Trans_Width; col++){
-            ImgData[3 * col + 0] = static_cast<uchar>(data[0 * Trans_Height * Trans_Width + row * Trans_Width + col]);
-            ImgData[3 * col + 1] = static_cast<uchar>(data[1 * Trans_Height * Trans_Width + row * Trans_Width + col]);
-            ImgData[3 * col + 2] = static_cast<uchar>(data[2 * Trans_Height * Trans_Width + row * Trans_Width + col]);
-            }
-        }
-        int num_gt_box = 0;
-        for (int g = 0; g < transformed_anno_vec.size(); ++g) {
-            const AnnotationGroup& anno_group = transformed_anno_vec[g];
-            for (int a = 0; a < anno_group.annotation_size(); ++a) {
-            const Annotation& anno = anno_group.annotation(a);
-            const NormalizedBBox& bbox = anno.bbox();
-            int xmin = int(bbox.xmin() * Trans_Width);
-            int ymin = int(bbox.ymin() * Trans_Height);
-            int xmax = int(bbox.xmax() * Trans_Width);
-            int ymax = int(bbox.ymax() * Trans_Height);
-            cv::rectangle(cropImage, cv::Point2i(xmin, ymin), cv::Point2i(xmax, ymax), cv::Scalar(255,0,0), 1, 1, 0);
-            if(has_landmarks_){
-                if(anno.has_lm()){
-                    const AnnoFaceLandmarks& project_facemark = anno.face_lm();
-                    point lefteye = project_facemark.lefteye();
-                    point righteye = project_facemark.righteye();
-                    point nose = project_facemark.nose();
-                    point leftmouth = project_facemark.leftmouth();
-                    point rightmouth = project_facemark.rightmouth();
-                    vector<cv::Point2i> lm(5);
-                    lm[0] = cv::Point2i(int(lefteye.x() * Trans_Width), int(lefteye.y() * Trans_Height));
-                    lm[1] = cv::Point2i(int(righteye.x() * Trans_Width), int(righteye.y() * Trans_Height));
-                    lm[2] = cv::Point2i(int(nose.x() * Trans_Width), int(nose.y() * Trans_Height));
-                    lm[3] = cv::Point2i(int(leftmouth.x() * Trans_Width), int(leftmouth.y() * Trans_Height));
-                    lm[4] = cv::Point2i(int(rightmouth.x() * Trans_Width), int(rightmouth.y() * Trans_Height));
-                    for(unsigned ii = 0; ii < 5; ii++)
-                        cv::circle(cropImage, lm[ii], 1,  cv::Scalar(0,255,0), 1, 1, 0);
-                }
-            }
-            cv::ellipse(cropImage, cv::Point((xmax + xmin) / 2, (ymax + ymin) / 2), 
-                cv::Size((xmax - xmin)/2, (ymax - ymin)/2), 0, 0, 360, cv::Scalar(255, 129, 0), 2,8);
-            num_gt_box++;
-            }
-        }
-        if(num_gt_box==0)
-            LOG(INFO)<<"*************no gt boxes";
-        cv::imwrite(saved_img_name, cropImage);
-        LOG(INFO)<<"*** Datum Write Into Jpg File Sucessfully! ***";
-        jj ++ ;
-        
-        #endif
-        // clear memory
-        if (has_sampled) {
-            delete sampled_datum;
-        }
-        if (transform_param.has_expand_param()) {
-            delete expand_datum;
-        }
-        if(do_resize){
-            delete resized_anno_datum;
+    }
+    timer.Start();
+    this->ParallelForItems(batch_size,
+        boost::bind(&AnnotatedDataLayer<Dtype>::load_item, this, batch,
+                    boost::cref(anno_datums), top_data, top_label,
+                    boost::ref(all_anno), _1, _2));
+    trans_time += timer.MicroSeconds();
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+        // Count the number of bboxes.
+        for (int g = 0; g < all_anno[item_id].size(); ++g) {
+            num_bboxes += all_anno[item_id][g].annotation_size();
         }
-        trans_time += timer.MicroSeconds();
-        reader_.free().push(const_cast<AnnotatedDatum*>(&anno_datum));
+        reader_.free().push(anno_datums[item_id]);
     }
     
     // Store "rich" annotation if needed.
@@ -469,11 +277,359 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
     DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
     DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+#ifdef USE_OPENCV
+    if (image_cache_) {
+        DLOG(INFO) << "   Image cache: " << image_cache_->hits() << " hits, "
+            << image_cache_->misses() << " misses, "
+            << (image_cache_->bytes() >> 20) << " MB.";
+    }
+#endif  // USE_OPENCV
+}
+
+// This function is called on the transform workers, one item at a time
+template<typename Dtype>
+void AnnotatedDataLayer<Dtype>::load_item(Batch<Dtype>* batch,
+        const vector<AnnotatedDatum*>& anno_datums, Dtype* top_data,
+        Dtype* top_label, vector<vector<AnnotationGroup> >& all_anno,
+        int item_id, int worker_id) {
+    const AnnotatedDataParameter& anno_data_param =
+        this->layer_param_.annotated_data_param();
+    const TransformationParameter& transform_param =
+        this->layer_param_.transform_param();
+    const vector<int>& top_shape = batch->data_.shape();
+    DataTransformer<Dtype>* transformer = this->worker_transformer(worker_id);
+    Blob<Dtype>* transformed_data = this->worker_transformed_data(worker_id);
+    AnnotatedDatum& anno_datum = *anno_datums[item_id];
+#ifdef USE_OPENCV
+    // Hand the decoded image to the transformer, so that none of the steps
+    // below decodes the datum again.
+    if (image_cache_ && anno_datum.datum().encoded()) {
+        const string& key = reader_.key(&anno_datum);
+        cv::Mat img;
+        if (!image_cache_->Get(key, &img)) {
+            img = transformer->DecodeDatum(anno_datum.datum());
+            image_cache_->Put(key, img);
+        }
+        transformer->SetDecodedImage(&anno_datum.datum(), img);
+    }
+#endif  // USE_OPENCV
+    #ifdef BOOL_TEST_DATA
+    cv::Mat sourceImage = DecodeDatumToCVMatNative(anno_datum.datum());
+    std::string src_save_folder = "../anchorTestImage";
+    std::string src_prefix_imgName = "source_image";
+    
+    std::string src_saved_img_name = src_save_folder + "/"+ src_prefix_imgName + "_"+ std::to_string(batch_id)+ "_"+ std::to_string(item_id) 
+                                    + "_" + std::to_string(jj) +".jpg";
+    cv::imwrite(src_saved_img_name, sourceImage);
+    #endif
+    AnnotatedDatum distort_datum;
+    AnnotatedDatum* expand_datum = NULL;
+    AnnotatedDatum* resized_anno_datum = NULL;
+    bool do_resize = false;
+    // Encoded images can be cropped lazily: expand and crop only the
+    // annotations and render the pixels of the crop at the end.
+    const bool lazy_crop = lazy_crop_ && anno_datum.datum().encoded() &&
+        anno_datum.datum().height() > 0 && anno_datum.datum().width() > 0;
+    NormalizedBBox expand_bbox;
+    NormalizedBBox crop_bbox;
+    crop_bbox.set_xmin(0);
+    crop_bbox.set_ymin(0);
+    crop_bbox.set_xmax(1);
+    crop_bbox.set_ymax(1);
+#ifdef USE_OPENCV
+    // Once a step below changes the image of an encoded datum, it is handed
+    // on in sampled_img and the datum of that step only keeps its size.
+    cv::Mat sampled_img;
+#endif  // USE_OPENCV
+    if (lazy_crop) {
+        expand_datum = new AnnotatedDatum();
+        transformer->ExpandAnnotation(anno_datum, &expand_bbox, expand_datum);
+    } else if (transform_param.has_distort_param()) {
+        distort_datum.CopyFrom(anno_datum);
+#ifdef USE_OPENCV
+        transformer->DistortImage(anno_datum.datum(),
+                                  distort_datum.mutable_datum(), &sampled_img);
+#else
+        transformer->DistortImage(anno_datum.datum(),
+                                            distort_datum.mutable_datum());
+#endif  // USE_OPENCV
+        if (transform_param.has_expand_param()) {
+            expand_datum = new AnnotatedDatum();
+#ifdef USE_OPENCV
+            transformer->ExpandImage(distort_datum, expand_datum, &sampled_img);
+#else
+            transformer->ExpandImage(distort_datum, expand_datum);
+#endif  // USE_OPENCV
+        } else {
+            expand_datum = &distort_datum;
+        }
+    } else {
+        if (transform_param.has_expand_param()) {
+            expand_datum = new AnnotatedDatum();
+#ifdef USE_OPENCV
+            transformer->ExpandImage(anno_datum, expand_datum, &sampled_img);
+#else
+            transformer->ExpandImage(anno_datum, expand_datum);
+#endif  // USE_OPENCV
+        } else {
+            expand_datum = &anno_datum;
+        }
+    }
+    AnnotatedDatum* sampled_datum = NULL;
+    bool has_sampled = false;
+    bool CropSample = false;
+    const int resized_height = transform_param.resize_param().height();
+    vector<NormalizedBBox> sampled_bboxes;
+    sampled_bboxes.clear();
+    if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_BATCH){
+        if (batch_samplers_.size() > 0) {
+            StageTimer sample_timer(&this->stats_, StageStats::SAMPLE);
+            GenerateBatchSamples(*expand_datum, batch_samplers_, &sampled_bboxes);
+            CropSample = true;
+        } else {
+            sampled_datum = expand_datum;
+        }
+    }
+    else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_JITTER){
+        StageTimer sample_timer(&this->stats_, StageStats::SAMPLE);
+        GenerateJitterSamples(*expand_datum, 0.1, &sampled_bboxes);
+        CropSample = true;
+    }
+    else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_ANCHOR){
+        if(data_anchor_samplers_.size() > 0){
+            StageTimer sample_timer(&this->stats_, StageStats::SAMPLE);
+            GenerateBatchDataAnchorSamples(*expand_datum, data_anchor_samplers_, &sampled_bboxes, resized_height);
+            int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
+            sampled_datum = new AnnotatedDatum();
+#ifdef USE_OPENCV
+            transformer->CropImage_Sampling(*expand_datum,
+                                            sampled_bboxes[rand_idx],
+                                            sampled_datum, &sampled_img);
+#else
+            transformer->CropImage_Sampling(*expand_datum,
+                                                sampled_bboxes[rand_idx],
+                                                sampled_datum);
+#endif  // USE_OPENCV
+            has_sampled = true;
+        }else{
+            sampled_datum = expand_datum;
+        }
+    }
+    else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_GT_BBOX){
+        if (anno_data_param.has_bbox_sampler()) {
+            resized_anno_datum = new AnnotatedDatum();
+            do_resize = true;
+#ifdef USE_OPENCV
+            // GenerateLFFDSample decodes the datum by itself.
+            if (!sampled_img.empty()) {
+                EncodeCVMatToDatum(sampled_img, "jpg",
+                                   expand_datum->mutable_datum());
+                sampled_img.release();
+            }
+#endif  // USE_OPENCV
+            StageTimer sample_timer(&this->stats_, StageStats::SAMPLE);
+            GenerateLFFDSample(*expand_datum, &sampled_bboxes, 
+                            bbox_small_scale_, bbox_large_scale_, anchor_stride_,
+                            resized_anno_datum, transform_param, do_resize);
+            CHECK_GT(resized_anno_datum->datum().channels(), 0);
+            sampled_datum = new AnnotatedDatum();
+#ifdef USE_OPENCV
+            transformer->CropImage_Sampling(*resized_anno_datum,
+                                            sampled_bboxes[0], sampled_datum,
+                                            &sampled_img);
+#else
+            transformer->CropImage_Sampling(*resized_anno_datum,
+                                            sampled_bboxes[0], sampled_datum);
+#endif  // USE_OPENCV
+            has_sampled = true;
+        } else {
+            sampled_datum = expand_datum;
+        }
+    }
+    else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_DEFAULT){
+        sampled_datum = expand_datum;
+    }
+    if(CropSample){        
+        if (sampled_bboxes.size() > 0) {
+            int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
+            sampled_datum = new AnnotatedDatum();
+            if (lazy_crop) {
+                crop_bbox = sampled_bboxes[rand_idx];
+                transformer->CropAnnotation(*expand_datum, crop_bbox,
+                                            sampled_datum);
+            } else {
+#ifdef USE_OPENCV
+                transformer->CropImage(*expand_datum,
+                                       sampled_bboxes[rand_idx],
+                                       sampled_datum, &sampled_img);
+#else
+                transformer->CropImage(*expand_datum,
+                                                sampled_bboxes[rand_idx],
+                                                sampled_datum);
+#endif  // USE_OPENCV
+            }
+            has_sampled = true;
+        } else {
+            sampled_datum = expand_datum;
+        }
+    }
+    CHECK(sampled_datum != NULL);
+#ifdef USE_OPENCV
+    if (lazy_crop) {
+        transformer->ExpandCropImage(anno_datum.datum(), expand_bbox,
+                                     crop_bbox, &sampled_img);
+        sampled_datum->mutable_datum()->set_channels(sampled_img.channels());
+        sampled_datum->mutable_datum()->set_height(sampled_img.rows);
+        sampled_datum->mutable_datum()->set_width(sampled_img.cols);
+    }
+    vector<int> shape = !sampled_img.empty() ?
+        transformer->InferBlobShape(sampled_img) :
+        transformer->InferBlobShape(sampled_datum->datum());
+#else
+    vector<int> shape = transformer->InferBlobShape(sampled_datum->datum());
+#endif  // USE_OPENCV
+    if (transform_param.has_resize_param()) {
+        if (transform_param.resize_param().resize_mode() ==
+            ResizeParameter_Resize_mode_FIT_SMALL_SIZE) {
+            batch->data_.Reshape(shape);
+            top_data = batch->data_.mutable_cpu_data();
+        } else {
+            CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
+                    shape.begin() + 1));
+        }
+    } else {
+        CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
+            shape.begin() + 1));
+    }
+    transformed_data->Reshape(shape);
+    // Apply data transformations (mirror, scale, crop...)
+    int offset = batch->data_.offset(item_id);
+    transformed_data->set_cpu_data(top_data + offset);
+    vector<AnnotationGroup> transformed_anno_vec;
+    if (this->output_labels_) {
+        if (has_anno_type_) {
+            CHECK(sampled_datum->has_type()) << "Some datum misses AnnotationType.";
+            if (anno_data_param.has_anno_type()) {
+                sampled_datum->set_type(anno_type_);
+            } else {
+                CHECK_EQ(anno_type_, sampled_datum->type()) << "Different AnnotationType.";
+            }
+            // Transform datum and annotation_group at the same time
+            transformed_anno_vec.clear();
+#ifdef USE_OPENCV
+            if (!sampled_img.empty()) {
+                transformer->Transform(sampled_img, *sampled_datum,
+                                       transformed_data, &transformed_anno_vec);
+            } else
+#endif  // USE_OPENCV
+            transformer->Transform(*sampled_datum,
+                                                transformed_data,
+                                                &transformed_anno_vec);
+            if (anno_type_ != AnnotatedDatum_AnnotationType_BBOX) {
+                LOG(FATAL) << "Unknown annotation type.";
+            }
+            all_anno[item_id] = transformed_anno_vec;
+        } else {
+#ifdef USE_OPENCV
+            if (!sampled_img.empty()) {
+                transformer->Transform(sampled_img, transformed_data);
+            } else
+#endif  // USE_OPENCV
+            transformer->Transform(sampled_datum->datum(),
+                                                transformed_data);
+            // Otherwise, store the label from datum.
+            CHECK(sampled_datum->datum().has_label()) << "Cannot find any label.";
+            top_label[item_id] = sampled_datum->datum().label();
+        }
+    } 
+    else {
+#ifdef USE_OPENCV
+        if (!sampled_img.empty()) {
+            transformer->Transform(sampled_img, transformed_data);
+        } else
+#endif  // USE_OPENCV
+        transformer->Transform(sampled_datum->datum(), transformed_data);
+    }
+    # ifdef BOOL_TEST_DATA
+    cv::Mat cropImage;
+    std::string save_folder = "../anchorTestImage";
+    std::string prefix_imgName = "crop_image";
+    
+    std::string saved_img_name = save_folder + "/"+ prefix_imgName + "_"+ std::to_string(batch_id)+ "_"+ std::to_string(item_id) 
+                                    + "_" + std::to_string(jj) +".jpg";
+    const Dtype* data = transformed_data->cpu_data();
+    int Trans_Height = transformed_data->height();
+    int Trans_Width = transformed_data->width();
+    cropImage = cv::Mat(Trans_Height, Trans_Width, CV_8UC3);
+    for(int row = 0; row < Trans_Height; row++){
+        unsigned char *ImgData = cropImage.ptr<uchar>(row);
+        for(int col = 0; col < Trans_Width; col++){
+        ImgData[3 * col + 0] = static_cast<uchar>(data[0 * Trans_Height * Trans_Width + row * Trans_Width + col]);
+        ImgData[3 * col + 1] = static_cast<uchar>(data[1 * Trans_Height * Trans_Width + row * Trans_Width + col]);
+        ImgData[3 * col + 2] = static_cast<uchar>(data[2 * Trans_Height * Trans_Width + row * Trans_Width + col]);
+        }
+    }
+    int num_gt_box = 0;
+    for (int g = 0; g < transformed_anno_vec.size(); ++g) {
+        const AnnotationGroup& anno_group = transformed_anno_vec[g];
+        for (int a = 0; a < anno_group.annotation_size(); ++a) {
+        const Annotation& anno = anno_group.annotation(a);
+        const NormalizedBBox& bbox = anno.bbox();
+        int xmin = int(bbox.xmin() * Trans_Width);
+        int ymin = int(bbox.ymin() * Trans_Height);
+        int xmax = int(bbox.xmax() * Trans_Width);
+        int ymax = int(bbox.ymax() * Trans_Height);
+        cv::rectangle(cropImage, cv::Point2i(xmin, ymin), cv::Point2i(xmax, ymax), cv::Scalar(255,0,0), 1, 1, 0);
+        if(has_landmarks_){
+            if(anno.has_lm()){
+                const AnnoFaceLandmarks& project_facemark = anno.face_lm();
+                point lefteye = project_facemark.lefteye();
+                point righteye = project_facemark.righteye();
+                point nose = project_facemark.nose();
+                point leftmouth = project_facemark.leftmouth();
+                point rightmouth = project_facemark.rightmouth();
+                vector<cv::Point2i> lm(5);
+                lm[0] = cv::Point2i(int(lefteye.x() * Trans_Width), int(lefteye.y() * Trans_Height));
+                lm[1] = cv::Point2i(int(righteye.x() * Trans_Width), int(righteye.y() * Trans_Height));
+                lm[2] = cv::Point2i(int(nose.x() * Trans_Width), int(nose.y() * Trans_Height));
+                lm[3] = cv::Point2i(int(leftmouth.x() * Trans_Width), int(leftmouth.y() * Trans_Height));
+                lm[4] = cv::Point2i(int(rightmouth.x() * Trans_Width), int(rightmouth.y() * Trans_Height));
+                for(unsigned ii = 0; ii < 5; ii++)
+                    cv::circle(cropImage, lm[ii], 1,  cv::Scalar(0,255,0), 1, 1, 0);
+            }
+        }
+        cv::ellipse(cropImage, cv::Point((xmax + xmin) / 2, (ymax + ymin) / 2), 
+            cv::Size((xmax - xmin)/2, (ymax - ymin)/2), 0, 0, 360, cv::Scalar(255, 129, 0), 2,8);
+        num_gt_box++;
+        }
+    }
+    if(num_gt_box==0)
+        LOG(INFO)<<"*************no gt boxes";
+    cv::imwrite(saved_img_name, cropImage);
+    LOG(INFO)<<"*** Datum Write Into Jpg File Sucessfully! ***";
+    jj ++ ;
+    
+    #endif
+    // clear memory
+    if (has_sampled) {
+        delete sampled_datum;
+    }
+    if (lazy_crop || transform_param.has_expand_param()) {
+        delete expand_datum;
+    }
+    if(do_resize){
+        delete resized_anno_datum;
+    }
+#ifdef USE_OPENCV
+    if (image_cache_) {
+        transformer->SetDecodedImage(NULL, cv::Mat());
+    }
+#endif  // USE_OPENCV
 }
 
 template <typename Dtype>
 void AnnotatedDataLayer<Dtype>::fill_label(Dtype* top_label, int batch_size, 
-                std::map<int, vector<AnnotationGroup> > all_anno, 
+                const vector<vector<AnnotationGroup> >& all_anno, 
                 int num_bboxes, 
                 int label_last_channels){
     int idx = 0;
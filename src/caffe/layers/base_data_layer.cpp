@@ -36,9 +36,13 @@ template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+      prefetch_(param.data_param().prefetch()),
+      prefetch_free_(prefetch_.size()), prefetch_full_(prefetch_.size()),
+      data_capacity_(0), label_capacity_(0) {
+  CHECK_GT(prefetch_.size(), 0) << "prefetch must be at least 1.";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
@@ -50,28 +54,96 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
       }
     }
   }
 #endif
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    UpdateBatchCapacity(*prefetch_[i]);
+  }
   DLOG(INFO) << "Initializing prefetch";
   this->data_transformer_->InitRand();
+  this->data_transformer_->set_stats(&stats_);
+  const int num_workers = this->layer_param_.data_param().num_workers();
+  CHECK_GE(num_workers, 1) << "num_workers must be at least 1.";
+  for (int i = 1; i < num_workers; ++i) {
+    worker_transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+    worker_transformers_.back()->InitRand();
+    worker_transformers_.back()->set_stats(&stats_);
+    worker_transformed_data_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  workers_.reset(new ThreadPool(num_workers));
   StartInternalThread();
   DLOG(INFO) << "Prefetch initialized.";
 }
 
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::ParallelForItems(int batch_size,
+    const boost::function<void(int, int)>& fn) {
+  workers_->Run(batch_size, fn);
+}
+
+template <typename Dtype>
+DataTransformer<Dtype>* BasePrefetchingDataLayer<Dtype>::worker_transformer(
+    int worker_id) {
+  if (worker_id == 0) {
+    return this->data_transformer_.get();
+  }
+  return worker_transformers_[worker_id - 1].get();
+}
+
+template <typename Dtype>
+Blob<Dtype>* BasePrefetchingDataLayer<Dtype>::worker_transformed_data(
+    int worker_id) {
+  if (worker_id == 0) {
+    return &transformed_data_;
+  }
+  return worker_transformed_data_[worker_id - 1].get();
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::ReserveBatch(Batch<Dtype>* batch) {
+  batch->data_.Reserve(data_capacity_);
+  if (this->output_labels_) {
+    batch->label_.Reserve(label_capacity_);
+  }
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::UpdateBatchCapacity(
+    const Batch<Dtype>& batch) {
+  // The sizes set up by DataLayerSetUp are kept exactly. Batches that grow
+  // beyond them get 25% headroom so that slowly growing labels (e.g. the
+  // number of boxes per batch) do not reallocate on every new maximum.
+  const bool started = data_capacity_ > 0;
+  if (batch.data_.count() > data_capacity_) {
+    data_capacity_ = batch.data_.count();
+    if (started) {
+      data_capacity_ += data_capacity_ / 4;
+    }
+  }
+  if (batch.label_.count() > label_capacity_) {
+    label_capacity_ = batch.label_.count();
+    if (started) {
+      label_capacity_ += label_capacity_ / 4;
+    }
+  }
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #ifndef CPU_ONLY
@@ -84,7 +156,10 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
   try {
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
+      ReserveBatch(batch);
       load_batch(batch);
+      UpdateBatchCapacity(*batch);
+      stats_.AddBatch();
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
         batch->data_.data().get()->async_gpu_push(stream);
@@ -103,10 +178,16 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::NextBatch() {
+  StageTimer timer(&stats_, StageStats::QUEUE_WAIT);
+  return prefetch_full_.pop("Data layer prefetch queue empty");
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = NextBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
@@ -242,9 +323,12 @@ template <typename Dtype>
 ImageDataPrefetchingDataLayer<Dtype>::ImageDataPrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+      prefetch_(param.data_param().prefetch()),
+      prefetch_free_(prefetch_.size()), prefetch_full_(prefetch_.size()) {
+  CHECK_GT(prefetch_.size(), 0) << "prefetch must be at least 1.";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new pairBatch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
@@ -261,20 +345,20 @@ void ImageDataPrefetchingDataLayer<Dtype>::LayerSetUp(
   if (top.size() == 3) this->output_labels_ = true;
   else                 this->output_labels_ = false;
 
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
-      prefetch_[i].labelSample_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
+      prefetch_[i]->labelSample_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
-        prefetch_[i].labelSample_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
+        prefetch_[i]->labelSample_.mutable_gpu_data();
       }
     }
   }
@@ -1,9 +1,29 @@
+#include <algorithm>
+#include <limits>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  BaseConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  activation_ = conv_param.activation();
+  negative_slope_ = conv_param.negative_slope();
+  CHECK(activation_ == ConvolutionParameter_Activation_NONE ||
+      this->phase_ == TEST)
+      << "Convolution activations are forward only; layer "
+      << this->layer_param_.name() << " must be in a TEST net.";
+  CHECK(activation_ == ConvolutionParameter_Activation_NONE ||
+      conv_param.engine() != ConvolutionParameter_Engine_CUDNN)
+      << "The CUDNN engine does not apply the activation of layer "
+      << this->layer_param_.name() << "; use the CAFFE engine.";
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::compute_output_shape() {
   const int* kernel_shape_data = this->kernel_shape_.cpu_data();
@@ -35,10 +55,24 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
         const Dtype* bias = this->blobs_[1]->cpu_data();
         this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
       }
+      if (activation_ != ConvolutionParameter_Activation_NONE) {
+        forward_cpu_activation(top_data + n * this->top_dim_);
+      }
     }
   }
 }
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_activation(Dtype* output) {
+  const Dtype upper = activation_ == ConvolutionParameter_Activation_RELU6 ?
+      Dtype(6) : std::numeric_limits<Dtype>::max();
+  for (int i = 0; i < this->top_dim_; ++i) {
+    const Dtype x = output[i];
+    output[i] = std::min(std::max(x, Dtype(0)) +
+        negative_slope_ * std::min(x, Dtype(0)), upper);
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
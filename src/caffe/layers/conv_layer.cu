@@ -1,9 +1,30 @@
+#include <cfloat>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+__global__ void ConvActivationForward(const int n, Dtype* data,
+    const Dtype negative_slope, const Dtype upper) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const Dtype x = data[index];
+    data[index] = min((x > 0 ? x : x * negative_slope), upper);
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_gpu_activation(Dtype* output) {
+  const Dtype upper = activation_ == ConvolutionParameter_Activation_RELU6 ?
+      Dtype(6) : FLT_MAX;
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  ConvActivationForward<Dtype><<<CAFFE_GET_BLOCKS(this->top_dim_),
+      CAFFE_CUDA_NUM_THREADS>>>(this->top_dim_, output, negative_slope_,
+      upper);
+  CUDA_POST_KERNEL_CHECK;
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -18,6 +39,9 @@ void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
         const Dtype* bias = this->blobs_[1]->gpu_data();
         this->forward_gpu_bias(top_data + n * this->top_dim_, bias);
       }
+      if (activation_ != ConvolutionParameter_Activation_NONE) {
+        forward_gpu_activation(top_data + n * this->top_dim_);
+      }
     }
   }
 }
@@ -3,6 +3,7 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
@@ -35,8 +36,8 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -45,8 +46,8 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
 }
@@ -79,23 +80,21 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   if (this->output_labels_) {
     top_label = batch->label_.mutable_cpu_data();
   }
+  vector<Datum*> datums(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
     timer.Start();
+    StageTimer read_timer(&this->stats_, StageStats::READ);
     // get a datum
-    Datum& datum = *(reader_.full().pop("Waiting for data"));
+    datums[item_id] = reader_.full().pop("Waiting for data");
     read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply data transformations (mirror, scale, crop...)
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-    // Copy label.
-    if (this->output_labels_) {
-      top_label[item_id] = datum.label();
-    }
-    trans_time += timer.MicroSeconds();
-
-    reader_.free().push(const_cast<Datum*>(&datum));
+  }
+  timer.Start();
+  this->ParallelForItems(batch_size,
+      boost::bind(&DataLayer<Dtype>::load_item, this, batch,
+                  boost::cref(datums), top_data, top_label, _1, _2));
+  trans_time += timer.MicroSeconds();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    reader_.free().push(datums[item_id]);
   }
   timer.Stop();
   batch_timer.Stop();
@@ -104,6 +103,26 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+// This function is called on the transform workers, one item at a time
+template<typename Dtype>
+void DataLayer<Dtype>::load_item(Batch<Dtype>* batch,
+    const vector<Datum*>& datums, Dtype* top_data, Dtype* top_label,
+    int item_id, int worker_id) {
+  const Datum& datum = *datums[item_id];
+  Blob<Dtype>* transformed_data = this->worker_transformed_data(worker_id);
+  if (worker_id > 0) {
+    transformed_data->ReshapeLike(this->transformed_data_);
+  }
+  // Apply data transformations (mirror, scale, crop...)
+  int offset = batch->data_.offset(item_id);
+  transformed_data->set_cpu_data(top_data + offset);
+  this->worker_transformer(worker_id)->Transform(datum, transformed_data);
+  // Copy label.
+  if (this->output_labels_) {
+    top_label[item_id] = datum.label();
+  }
+}
+
 INSTANTIATE_CLASS(DataLayer);
 REGISTER_LAYER_CLASS(Data);
 
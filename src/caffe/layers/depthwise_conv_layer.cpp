@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/depthwise_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/simd.hpp"
+
+namespace caffe {
+
+// Sets [*begin, *end) to the outputs o whose tap o * stride + offset is
+// inside [0, size).
+static inline void TapRange(const int offset, const int stride,
+    const int size, const int output_size, int* begin, int* end) {
+  *begin = offset >= 0 ? 0 : (stride - 1 - offset) / stride;
+  *end = offset >= size ?
+      0 : std::min(output_size, (size - 1 - offset) / stride + 1);
+}
+
+template <typename Dtype>
+void DepthwiseConvolutionLayer<Dtype>::LayerSetUp(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  depthwise_ = this->num_spatial_axes_ == 2 &&
+      this->group_ == this->channels_;
+  if (!depthwise_) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " is not a 2D "
+        << "depthwise convolution; using the Caffe engine on the CPU.";
+  }
+}
+
+template <typename Dtype>
+void DepthwiseConvolutionLayer<Dtype>::Forward_cpu(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!depthwise_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      caffe_cpu_depthwise_conv(bottom_data + n * this->bottom_dim_,
+          this->channels_, this->input_shape(1), this->input_shape(2),
+          this->num_output_ / this->channels_, kernel_shape[0],
+          kernel_shape[1], pad[0], pad[1], stride[0], stride[1], dilation[0],
+          dilation[1], weight, bias, top_data + n * this->top_dim_);
+      if (this->activation_ != ConvolutionParameter_Activation_NONE) {
+        this->forward_cpu_activation(top_data + n * this->top_dim_);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DepthwiseConvolutionLayer<Dtype>::backward_cpu_depthwise(
+      const Dtype* input, const Dtype* output_diff, const Dtype* weight,
+      Dtype* weight_diff, Dtype* input_diff) {
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const int kernel_dim = kernel_shape[0] * kernel_shape[1];
+  const int multiplier = this->num_output_ / this->channels_;
+  for (int c = 0; c < this->num_output_; ++c) {
+    const int map_offset = (c / multiplier) * height * width;
+    const Dtype* diff = output_diff + c * output_h * output_w;
+    for (int kh = 0; kh < kernel_shape[0]; ++kh) {
+      const int offset_h = kh * dilation[0] - pad[0];
+      int h_begin, h_end;
+      TapRange(offset_h, stride[0], height, output_h, &h_begin, &h_end);
+      for (int kw = 0; kw < kernel_shape[1]; ++kw) {
+        const int offset_w = kw * dilation[1] - pad[1];
+        int w_begin, w_end;
+        TapRange(offset_w, stride[1], width, output_w, &w_begin, &w_end);
+        const int tap = c * kernel_dim + kh * kernel_shape[1] + kw;
+        const int columns = w_end - w_begin;
+        if (columns <= 0) {
+          continue;
+        }
+        Dtype sum = 0;
+        for (int h = h_begin; h < h_end; ++h) {
+          // The inputs under the tap, for the outputs [w_begin, w_end).
+          const int row = map_offset + (h * stride[0] + offset_h) * width +
+              w_begin * stride[1] + offset_w;
+          const Dtype* diff_row = diff + h * output_w + w_begin;
+          if (weight_diff) {
+            sum += caffe_cpu_strided_dot(columns, diff_row, 1, input + row,
+                stride[1]);
+          }
+          if (input_diff && stride[1] == 1) {
+            caffe_axpy(columns, weight[tap], diff_row, input_diff + row);
+          } else if (input_diff) {
+            for (int w = 0; w < columns; ++w) {
+              input_diff[row + w * stride[1]] += weight[tap] * diff_row[w];
+            }
+          }
+        }
+        if (weight_diff) {
+          weight_diff[tap] += sum;
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DepthwiseConvolutionLayer<Dtype>::Backward_cpu(
+      const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+      const vector<Blob<Dtype>*>& bottom) {
+  if (!depthwise_) {
+    ConvolutionLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* weight_diff = this->param_propagate_down_[0] ?
+      this->blobs_[0]->mutable_cpu_diff() : NULL;
+  for (int i = 0; i < top.size(); ++i) {
+    const Dtype* top_diff = top[i]->cpu_diff();
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    // Bias gradient, if necessary.
+    if (this->bias_term_ && this->param_propagate_down_[1]) {
+      Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
+      for (int n = 0; n < this->num_; ++n) {
+        this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
+      }
+    }
+    if (!weight_diff && !propagate_down[i]) {
+      continue;
+    }
+    // The taps accumulate into the input gradient.
+    Dtype* bottom_diff = NULL;
+    if (propagate_down[i]) {
+      bottom_diff = bottom[i]->mutable_cpu_diff();
+      caffe_set(bottom[i]->count(), Dtype(0), bottom_diff);
+    }
+    for (int n = 0; n < this->num_; ++n) {
+      backward_cpu_depthwise(bottom_data + n * this->bottom_dim_,
+          top_diff + n * this->top_dim_, weight, weight_diff,
+          bottom_diff ? bottom_diff + n * this->bottom_dim_ : NULL);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(DepthwiseConvolutionLayer);
+
+}  // namespace caffe
@@ -12,10 +12,6 @@
 
 namespace caffe {
 
-bool compare_score(CenterNetInfo a, CenterNetInfo b){
-    return a.score() > b.score();
-}
-
 template <typename Dtype>
 void CenternetDetectionOutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -31,6 +27,10 @@ void CenternetDetectionOutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>
         detection_output_param.confidence_threshold() : -FLT_MAX;
     nms_thresh_ = detection_output_param.nms_thresh();
     has_lm_ = detection_output_param.has_lm();
+    nms_heatmap_ = detection_output_param.nms_heatmap();
+    if (detection_output_param.num_nms_threads() > 1) {
+        nms_pool_.reset(new ThreadPool(detection_output_param.num_nms_threads()));
+    }
 }
 
 template <typename Dtype>
@@ -66,31 +66,19 @@ void CenternetDetectionOutputLayer<Dtype>::Forward_cpu(
     const Dtype* conf_data = bottom[1]->cpu_data();
     const int classes = bottom[1]->channels();
     results_.clear();
+    // get_topK keeps the keep_top_k_ best detections of each image.
     get_topK(conf_data, loc_data, output_height, output_width, classes, num_, &results_, loc_channels,
                         has_lm_,
-                        confidence_threshold_, nms_thresh_);
+                        confidence_threshold_, nms_thresh_,
+                        keep_top_k_ > 0 ? keep_top_k_ : -1, nms_pool_.get(), nms_heatmap_);
 
     int num_kept = 0;
 
     std::map<int, vector<CenterNetInfo > > ::iterator iter;
     int count = 0;
-    #if 1
-    for(iter = results_.begin(); iter != results_.end(); iter++){
-        int num_det = iter->second.size();
-        if(keep_top_k_ > 0 && num_det > keep_top_k_){
-            std::sort(iter->second.begin(), iter->second.end(), compare_score);
-            iter->second.resize(keep_top_k_);
-            num_kept += keep_top_k_;
-        }else{
-            num_kept += num_det;
-        }
-    }
-    #else
     for(iter = results_.begin(); iter != results_.end(); iter++){
-        int num_det = iter->second.size();
-        num_kept += num_det;
+        num_kept += iter->second.size();
     }
-    #endif
     vector<int> top_shape(2, 1);
     top_shape.push_back(num_kept);
     if(has_lm_)
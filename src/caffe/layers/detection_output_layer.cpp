@@ -5,6 +5,7 @@
 #include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/filesystem.hpp"
 #include "boost/foreach.hpp"
 
@@ -40,6 +41,12 @@ void DetectionOutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   if (detection_output_param.nms_param().has_top_k()) {
     top_k_ = detection_output_param.nms_param().top_k();
   }
+  const int num_nms_threads = detection_output_param.num_nms_threads();
+  CHECK_GE(num_nms_threads, 1) << "num_nms_threads must be at least 1.";
+  if (num_nms_threads > 1) {
+    nms_pool_.reset(new ThreadPool(num_nms_threads));
+  }
+  nms_scratch_.resize(num_nms_threads);
   const SaveOutputParameter& save_output_param =
       detection_output_param.save_output_param();
   output_directory_ = save_output_param.output_directory();
@@ -178,6 +185,58 @@ void DetectionOutputLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   top[0]->Reshape(top_shape);
 }
 
+template <typename Dtype>
+void DetectionOutputLayer<Dtype>::ApplyNMSJob(const Dtype* loc_data,
+    const Dtype* conf_data, int job, int worker_id) {
+  const int i = job / num_classes_;
+  const int c = job % num_classes_;
+  NMSResult& result = nms_results_[job];
+  result.indices.clear();
+  result.bboxes.clear();
+  if (c == background_label_id_) {
+    // Ignore background class.
+    return;
+  }
+  // Decode the loc predictions lazily, only the ones with a confidence above
+  // confidence_threshold_ can be kept by the nms.
+  const bool clip_bbox = false;
+  const int loc_size = num_loc_classes_ * 4;
+  const int loc_class = share_location_ ? 0 : c;
+  const Dtype* image_loc_data = loc_data + i * num_priors_ * loc_size;
+  const Dtype* image_conf_data = conf_data + i * num_priors_ * num_classes_;
+  NMSScratch& scratch = nms_scratch_[worker_id];
+  scratch.bboxes.clear();
+  scratch.scores.clear();
+  scratch.prior_indices.clear();
+  for (int p = 0; p < num_priors_; ++p) {
+    const float score = image_conf_data[p * num_classes_ + c];
+    if (score <= confidence_threshold_) {
+      continue;
+    }
+    const Dtype* loc = image_loc_data + p * loc_size + loc_class * 4;
+    BBox loc_bbox;
+    loc_bbox.xmin = loc[0];
+    loc_bbox.ymin = loc[1];
+    loc_bbox.xmax = loc[2];
+    loc_bbox.ymax = loc[3];
+    loc_bbox.label = share_location_ ? -1 : c;
+    loc_bbox.score = 0;
+    loc_bbox.size = -1;
+    scratch.bboxes.resize(scratch.bboxes.size() + 1);
+    DecodeBBox(prior_bboxes_[p], &prior_variances_[p * 4], code_type_,
+               variance_encoded_in_target_, clip_bbox, loc_bbox,
+               &scratch.bboxes.back());
+    scratch.scores.push_back(score);
+    scratch.prior_indices.push_back(p);
+  }
+  ApplyNMSFast(scratch.bboxes, scratch.scores, confidence_threshold_,
+      nms_threshold_, eta_, top_k_, &scratch.kept);
+  for (int k = 0; k < scratch.kept.size(); ++k) {
+    result.indices.push_back(scratch.prior_indices[scratch.kept[k]]);
+    result.bboxes.push_back(scratch.bboxes[scratch.kept[k]]);
+  }
+}
+
 template <typename Dtype>
 void DetectionOutputLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
@@ -185,91 +244,83 @@ void DetectionOutputLayer<Dtype>::Forward_cpu(
   const Dtype* conf_data = bottom[1]->cpu_data();
   const Dtype* prior_data = bottom[2]->cpu_data();
   const int num = bottom[0]->num();
-  // Retrieve all location predictions.
-  vector<LabelBBox> all_loc_preds;
-  GetLocPredictions(loc_data, num, num_priors_, num_loc_classes_,
-                    share_location_, &all_loc_preds);
-  // Retrieve all confidences.
-  vector<map<int, vector<float> > > all_conf_scores;
-  GetConfidenceScores(conf_data, num, num_priors_, num_classes_,
-                      &all_conf_scores);
-  
+
   // Retrieve all prior bboxes. It is same within a batch since we assume all
-  // images in a batch are of same dimension.
-  vector<NormalizedBBox> prior_bboxes;
-  vector<vector<float> > prior_variances;
-  GetPriorBBoxes(prior_data, num_priors_, &prior_bboxes, &prior_variances);
+  // images in a batch are of same dimension, and it only changes with the
+  // input size, so it is only decoded again when its values change.
+  const int prior_count = num_priors_ * 8;
+  if (prior_data_.size() != prior_count ||
+      !std::equal(prior_data_.begin(), prior_data_.end(), prior_data)) {
+    prior_data_.assign(prior_data, prior_data + prior_count);
+    GetPriorBBoxes(prior_data, num_priors_, &prior_bboxes_,
+                   &prior_variances_);
+  }
 
-  // Decode all loc predictions to bboxes.
-  vector<LabelBBox> all_decode_bboxes;
-  const bool clip_bbox = false;
-  DecodeBBoxesAll(all_loc_preds, prior_bboxes, prior_variances, num,
-                  share_location_, num_loc_classes_, background_label_id_,
-                  code_type_, variance_encoded_in_target_, clip_bbox,
-                  &all_decode_bboxes);
+  // Every (image, class) pair is an independent nms problem, whose results
+  // go to nms_results_[image * num_classes_ + class].
+  const int num_jobs = num * num_classes_;
+  nms_results_.resize(num_jobs);
+  boost::function<void(int, int)> job = boost::bind(
+      &DetectionOutputLayer<Dtype>::ApplyNMSJob, this, loc_data, conf_data,
+      _1, _2);
+  if (nms_pool_) {
+    nms_pool_->Run(num_jobs, job);
+  } else {
+    for (int j = 0; j < num_jobs; ++j) {
+      job(j, 0);
+    }
+  }
 
+  // Merge the results in image and class order. The indices of an image
+  // map each label to positions in its nms result.
   int num_kept = 0;
-  vector<map<int, vector<int> > > all_indices;
+  vector<map<int, vector<int> > > all_indices(num);
   for (int i = 0; i < num; ++i) {
-    const LabelBBox& decode_bboxes = all_decode_bboxes[i];
-    const map<int, vector<float> >& conf_scores = all_conf_scores[i];
-    map<int, vector<int> > indices;
+    const Dtype* image_conf_data = conf_data + i * num_priors_ * num_classes_;
+    map<int, vector<int> >& indices = all_indices[i];
     int num_det = 0;
     for (int c = 0; c < num_classes_; ++c) {
       if (c == background_label_id_) {
-        // Ignore background class.
         continue;
       }
-      if (conf_scores.find(c) == conf_scores.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find confidence predictions for label " << c;
-      }
-      const vector<float>& scores = conf_scores.find(c)->second;
-      int label = share_location_ ? -1 : c;
-      if (decode_bboxes.find(label) == decode_bboxes.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find location predictions for label " << label;
-        continue;
+      const int num_label_det =
+          nms_results_[i * num_classes_ + c].indices.size();
+      vector<int>& label_indices = indices[c];
+      for (int k = 0; k < num_label_det; ++k) {
+        label_indices.push_back(k);
       }
-      const vector<NormalizedBBox>& bboxes = decode_bboxes.find(label)->second;
-      ApplyNMSFast(bboxes, scores, confidence_threshold_, nms_threshold_, eta_,
-          top_k_, &(indices[c]));
-      num_det += indices[c].size();
+      num_det += num_label_det;
     }
     if (keep_top_k_ > -1 && num_det > keep_top_k_) {
       vector<pair<float, pair<int, int> > > score_index_pairs;
       for (map<int, vector<int> >::iterator it = indices.begin();
            it != indices.end(); ++it) {
         int label = it->first;
-        const vector<int>& label_indices = it->second;
-        if (conf_scores.find(label) == conf_scores.end()) {
-          // Something bad happened for current label.
-          LOG(FATAL) << "Could not find location predictions for " << label;
-          continue;
-        }
-        const vector<float>& scores = conf_scores.find(label)->second;
-        for (int j = 0; j < label_indices.size(); ++j) {
-          int idx = label_indices[j];
-          CHECK_LT(idx, scores.size());
+        const vector<int>& prior_indices =
+            nms_results_[i * num_classes_ + label].indices;
+        for (int k = 0; k < prior_indices.size(); ++k) {
+          const float score =
+              image_conf_data[prior_indices[k] * num_classes_ + label];
           score_index_pairs.push_back(std::make_pair(
-                  scores[idx], std::make_pair(label, idx)));
+                  score, std::make_pair(label, k)));
         }
       }
-      // Keep top k results per image.
-      std::sort(score_index_pairs.begin(), score_index_pairs.end(),
-                SortScorePairDescend<pair<int, int> >);
+      // Keep top k results per image, only those need to be sorted.
+      std::partial_sort(score_index_pairs.begin(),
+                        score_index_pairs.begin() + keep_top_k_,
+                        score_index_pairs.end(),
+                        SortScorePairDescend<pair<int, int> >);
       score_index_pairs.resize(keep_top_k_);
       // Store the new indices.
       map<int, vector<int> > new_indices;
       for (int j = 0; j < score_index_pairs.size(); ++j) {
         int label = score_index_pairs[j].second.first;
-        int idx = score_index_pairs[j].second.second;
-        new_indices[label].push_back(idx);
+        int k = score_index_pairs[j].second.second;
+        new_indices[label].push_back(k);
       }
-      all_indices.push_back(new_indices);
+      indices.swap(new_indices);
       num_kept += keep_top_k_;
     } else {
-      all_indices.push_back(indices);
       num_kept += num_det;
     }
   }
@@ -295,25 +346,11 @@ void DetectionOutputLayer<Dtype>::Forward_cpu(
   int count = 0;
   boost::filesystem::path output_directory(output_directory_);
   for (int i = 0; i < num; ++i) {
-    const map<int, vector<float> >& conf_scores = all_conf_scores[i];
-    const LabelBBox& decode_bboxes = all_decode_bboxes[i];
+    const Dtype* image_conf_data = conf_data + i * num_priors_ * num_classes_;
     for (map<int, vector<int> >::iterator it = all_indices[i].begin();
         it != all_indices[i].end(); ++it) {
       int label = it->first;
-      if (conf_scores.find(label) == conf_scores.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find confidence predictions for " << label;
-        continue;
-      }
-      const vector<float>& scores = conf_scores.find(label)->second;
-      int loc_label = share_location_ ? -1 : label;
-      if (decode_bboxes.find(loc_label) == decode_bboxes.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find location predictions for " << loc_label;
-        continue;
-      }
-      const vector<NormalizedBBox>& bboxes =
-          decode_bboxes.find(loc_label)->second;
+      const NMSResult& result = nms_results_[i * num_classes_ + label];
       vector<int>& indices = it->second;
       if (need_save_) {
         CHECK(label_to_name_.find(label) != label_to_name_.end())
@@ -321,15 +358,17 @@ void DetectionOutputLayer<Dtype>::Forward_cpu(
         CHECK_LT(name_count_, names_.size());
       }
       for (int j = 0; j < indices.size(); ++j) {
-        int idx = indices[j];
+        int k = indices[j];
+        int idx = result.indices[k];
         top_data[count * 7] = i;
         top_data[count * 7 + 1] = label;
-        top_data[count * 7 + 2] = scores[idx];
-        const NormalizedBBox& bbox = bboxes[idx];
-        top_data[count * 7 + 3] = bbox.xmin();
-        top_data[count * 7 + 4] = bbox.ymin();
-        top_data[count * 7 + 5] = bbox.xmax();
-        top_data[count * 7 + 6] = bbox.ymax();
+        top_data[count * 7 + 2] =
+            static_cast<float>(image_conf_data[idx * num_classes_ + label]);
+        const BBox& bbox = result.bboxes[k];
+        top_data[count * 7 + 3] = bbox.xmin;
+        top_data[count * 7 + 4] = bbox.ymin;
+        top_data[count * 7 + 5] = bbox.xmax;
+        top_data[count * 7 + 6] = bbox.ymax;
         ++count;
       }
     }
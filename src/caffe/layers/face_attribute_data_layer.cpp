@@ -3,6 +3,7 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <map>
 #include <vector>
@@ -48,8 +49,8 @@ void faceAttributeDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& b
     top_shape[0] = batch_size;
     top[0]->Reshape(top_shape);
     phase_ = this->layer_param_.phase();
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-        this->prefetch_[i].data_.Reshape(top_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+        this->prefetch_[i]->data_.Reshape(top_shape);
     }
     LOG(INFO) << "output data size: " << top[0]->num() << ","
         << top[0]->channels() << "," << top[0]->height() << ","
@@ -79,8 +80,8 @@ void faceAttributeDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& b
             label_shape[0] = batch_size;
         }
         top[1]->Reshape(label_shape);
-        for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-            this->prefetch_[i].label_.Reshape(label_shape);
+        for (int i = 0; i < this->prefetch_.size(); ++i) {
+            this->prefetch_[i]->label_.Reshape(label_shape);
         }
     }
     iterations_ = 0;
@@ -100,7 +101,6 @@ void faceAttributeDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     // Reshape according to the first datum of each batch
     // on single input batches allows for inputs of varying dimension.
     const int batch_size = this->layer_param_.data_param().batch_size();
-    const TransformationParameter& transform_param = this->layer_param_.transform_param();
     AnnoFaceAttributeDatum& anno_datum = *(reader_.full().peek());
     // Use data_transformer to infer the expected blob shape from datum.
     vector<int> top_shape = this->data_transformer_->InferBlobShape(anno_datum.datum());
@@ -113,84 +113,29 @@ void faceAttributeDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     Dtype* top_label = NULL;  // suppress warnings about uninitialized variables
 
       // Store transformed annotation.
-    map<int, AnnoFaceAttribute > all_anno;
+    vector<AnnoFaceAttribute> all_anno(batch_size);
     map<int, vector<int>> batchImgShape;
     if (this->output_labels_ && !has_anno_type_) {
         top_label = batch->label_.mutable_cpu_data();
     }
+    vector<AnnoFaceAttributeDatum*> anno_datums(batch_size);
     for (int item_id = 0; item_id < batch_size; ++item_id) {
         timer.Start();
+        StageTimer read_timer(&this->stats_, StageStats::READ);
         // get a anno_datum
-        AnnoFaceAttributeDatum& anno_datum = *(reader_.full().pop("Waiting for data"));
-        batchImgShape[item_id].push_back (anno_datum.datum().width());
-        batchImgShape[item_id].push_back (anno_datum.datum().height());
-        AnnoFaceAttributeDatum distort_datum;
-        AnnoFaceAttributeDatum* expand_datum = NULL;
-        if (transform_param.has_distort_param()) {
-            distort_datum.CopyFrom(anno_datum);
-            this->data_transformer_->DistortImage(anno_datum.datum(),
-                                                    distort_datum.mutable_datum());
-            if (transform_param.has_expand_param()) {
-                expand_datum = new AnnoFaceAttributeDatum();
-                this->data_transformer_->ExpandImage(distort_datum, expand_datum);
-            } else {
-                expand_datum = &distort_datum;
-            }
-        } else {
-            if (transform_param.has_expand_param()) {
-                expand_datum = new AnnoFaceAttributeDatum();
-                this->data_transformer_->ExpandImage(anno_datum, expand_datum);
-            } else {
-                expand_datum = &anno_datum;
-            }
-        }
-        timer.Start();
-        vector<int> shape =
-            this->data_transformer_->InferBlobShape(expand_datum->datum());
-        if (transform_param.has_resize_param()) {
-            if (transform_param.resize_param().resize_mode() ==
-                ResizeParameter_Resize_mode_FIT_SMALL_SIZE) {
-                this->transformed_data_.Reshape(shape);
-                batch->data_.Reshape(shape);
-                top_data = batch->data_.mutable_cpu_data();
-            } else {
-                CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
-                    shape.begin() + 1))<<"shape: "<<shape[0]<<" "
-                             <<shape[1]<<" "<<shape[2]<<" "
-                             <<shape[3]<<";top_shape: "<<top_shape[0]<<" "
-                             <<top_shape[1]<<" "<<top_shape[2]<<" "
-                             <<top_shape[3];
-            }
-        } else {
-            CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
-                shape.begin() + 1));
-        }
+        anno_datums[item_id] = reader_.full().pop("Waiting for data");
+        batchImgShape[item_id].push_back(anno_datums[item_id]->datum().width());
+        batchImgShape[item_id].push_back(anno_datums[item_id]->datum().height());
         read_time += timer.MicroSeconds();
-        // Apply data transformations (mirror, scale, crop...)
-        int offset = batch->data_.offset(item_id);
-        this->transformed_data_.set_cpu_data(top_data + offset);
-        AnnoFaceAttribute transformed_anno_vec;
-        if (this->output_labels_) {
-            if (has_anno_type_) {
-                // Transform datum and annotation_group at the same time
-                this->data_transformer_->Transform(*expand_datum,
-                                                &(this->transformed_data_),
-                                                &transformed_anno_vec);
-                all_anno[item_id] = transformed_anno_vec;
-            } else {
-                this->data_transformer_->Transform(expand_datum->datum(),
-                                                &(this->transformed_data_));
-            }
-        } else {
-            this->data_transformer_->Transform(expand_datum->datum(),
-                                            &(this->transformed_data_));
-        }
-        // clear memory
-        if (transform_param.has_expand_param()) {
-            delete expand_datum;
-        }
-        trans_time += timer.MicroSeconds();
-        reader_.free().push(const_cast<AnnoFaceAttributeDatum*>(&anno_datum));
+    }
+    timer.Start();
+    this->ParallelForItems(batch_size,
+        boost::bind(&faceAttributeDataLayer<Dtype>::load_item, this, batch,
+                    boost::cref(anno_datums), top_data,
+                    boost::ref(all_anno), _1, _2));
+    trans_time += timer.MicroSeconds();
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+        reader_.free().push(anno_datums[item_id]);
     }
 
     // store "rich " landmark, face attributes
@@ -209,7 +154,7 @@ void faceAttributeDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
             top_label = batch->label_.mutable_cpu_data();
             int idx = 0;
             for (int item_id = 0; item_id < batch_size; ++item_id) {
-                AnnoFaceAttribute face = all_anno[item_id];
+                const AnnoFaceAttribute& face = all_anno[item_id];
                 top_label[idx++] = face.landmark().lefteye().x();
                 top_label[idx++] = face.landmark().righteye().x();
                 top_label[idx++] = face.landmark().nose().x();
@@ -255,6 +200,121 @@ void faceAttributeDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+// This function is called on the transform workers, one item at a time
+template<typename Dtype>
+void faceAttributeDataLayer<Dtype>::load_item(Batch<Dtype>* batch,
+        const vector<AnnoFaceAttributeDatum*>& anno_datums, Dtype* top_data,
+        vector<AnnoFaceAttribute>& all_anno, int item_id, int worker_id) {
+    const TransformationParameter& transform_param =
+        this->layer_param_.transform_param();
+    const vector<int>& top_shape = batch->data_.shape();
+    DataTransformer<Dtype>* transformer = this->worker_transformer(worker_id);
+    Blob<Dtype>* transformed_data = this->worker_transformed_data(worker_id);
+    AnnoFaceAttributeDatum& anno_datum = *anno_datums[item_id];
+    AnnoFaceAttributeDatum distort_datum;
+    AnnoFaceAttributeDatum* expand_datum = NULL;
+#ifdef USE_OPENCV
+    // Once a step below changes the image of an encoded datum, it is handed
+    // on in img and the datum of that step only keeps its size.
+    cv::Mat img;
+#endif  // USE_OPENCV
+    if (transform_param.has_distort_param()) {
+        distort_datum.CopyFrom(anno_datum);
+#ifdef USE_OPENCV
+        transformer->DistortImage(anno_datum.datum(),
+                                  distort_datum.mutable_datum(), &img);
+#else
+        transformer->DistortImage(anno_datum.datum(),
+                                                distort_datum.mutable_datum());
+#endif  // USE_OPENCV
+        if (transform_param.has_expand_param()) {
+            expand_datum = new AnnoFaceAttributeDatum();
+#ifdef USE_OPENCV
+            transformer->ExpandImage(distort_datum, expand_datum, &img);
+#else
+            transformer->ExpandImage(distort_datum, expand_datum);
+#endif  // USE_OPENCV
+        } else {
+            expand_datum = &distort_datum;
+        }
+    } else {
+        if (transform_param.has_expand_param()) {
+            expand_datum = new AnnoFaceAttributeDatum();
+#ifdef USE_OPENCV
+            transformer->ExpandImage(anno_datum, expand_datum, &img);
+#else
+            transformer->ExpandImage(anno_datum, expand_datum);
+#endif  // USE_OPENCV
+        } else {
+            expand_datum = &anno_datum;
+        }
+    }
+#ifdef USE_OPENCV
+    vector<int> shape = !img.empty() ? transformer->InferBlobShape(img) :
+        transformer->InferBlobShape(expand_datum->datum());
+#else
+    vector<int> shape =
+        transformer->InferBlobShape(expand_datum->datum());
+#endif  // USE_OPENCV
+    if (transform_param.has_resize_param()) {
+        if (transform_param.resize_param().resize_mode() ==
+            ResizeParameter_Resize_mode_FIT_SMALL_SIZE) {
+            batch->data_.Reshape(shape);
+            top_data = batch->data_.mutable_cpu_data();
+        } else {
+            CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
+                shape.begin() + 1))<<"shape: "<<shape[0]<<" "
+                         <<shape[1]<<" "<<shape[2]<<" "
+                         <<shape[3]<<";top_shape: "<<top_shape[0]<<" "
+                         <<top_shape[1]<<" "<<top_shape[2]<<" "
+                         <<top_shape[3];
+        }
+    } else {
+        CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
+            shape.begin() + 1));
+    }
+    transformed_data->Reshape(shape);
+    // Apply data transformations (mirror, scale, crop...)
+    int offset = batch->data_.offset(item_id);
+    transformed_data->set_cpu_data(top_data + offset);
+    AnnoFaceAttribute transformed_anno_vec;
+    if (this->output_labels_) {
+        if (has_anno_type_) {
+            // Transform datum and annotation_group at the same time
+#ifdef USE_OPENCV
+            if (!img.empty()) {
+                transformer->Transform(img, *expand_datum, transformed_data,
+                                       &transformed_anno_vec);
+            } else
+#endif  // USE_OPENCV
+            transformer->Transform(*expand_datum,
+                                            transformed_data,
+                                            &transformed_anno_vec);
+            all_anno[item_id] = transformed_anno_vec;
+        } else {
+#ifdef USE_OPENCV
+            if (!img.empty()) {
+                transformer->Transform(img, transformed_data);
+            } else
+#endif  // USE_OPENCV
+            transformer->Transform(expand_datum->datum(),
+                                            transformed_data);
+        }
+    } else {
+#ifdef USE_OPENCV
+        if (!img.empty()) {
+            transformer->Transform(img, transformed_data);
+        } else
+#endif  // USE_OPENCV
+        transformer->Transform(expand_datum->datum(),
+                                        transformed_data);
+    }
+    // clear memory
+    if (transform_param.has_expand_param()) {
+        delete expand_datum;
+    }
+}
+
 INSTANTIATE_CLASS(faceAttributeDataLayer);
 REGISTER_LAYER_CLASS(faceAttributeData);
 
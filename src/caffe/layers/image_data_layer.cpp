@@ -169,8 +169,8 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int batch_size = this->layer_param_.image_data_param().batch_size();
   CHECK_GT(batch_size, 0) << "Positive batch size required";
   top_shape[0] = batch_size;
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   top[0]->Reshape(top_shape);
 
@@ -180,14 +180,14 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // label
   vector<int> label_shape(1, label_num_);
   top[1]->Reshape(label_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].label_.Reshape(label_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->label_.Reshape(label_shape);
   }
   // sample_label_
   vector<int> label_shape_sample(1, batch_size);
   top[2]->Reshape(label_shape_sample);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].labelSample_.Reshape(label_shape_sample);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->labelSample_.Reshape(label_shape_sample);
   }
 }
 
@@ -277,8 +277,11 @@ void ImageDataLayer<Dtype>::load_batch(pairBatch<Dtype>* batch) {
     caffe_rng_uniform(1, 0.0f, 1.0f, &sampleProb);
     // get a blob
     timer.Start();
-    cv::Mat cv_img = ReadImageToCVMat(choosedImagefile_[item_id].first,
-        new_height, new_width, is_color);
+    cv::Mat cv_img = image_data_param.reduced_decode() ?
+        ReadImageToCVMatReduced(choosedImagefile_[item_id].first,
+            new_height, new_width, is_color) :
+        ReadImageToCVMat(choosedImagefile_[item_id].first,
+            new_height, new_width, is_color);
     CHECK(cv_img.data) << "Could not load " << choosedImagefile_[item_id].first;
     read_time += timer.MicroSeconds();
     timer.Start();
@@ -42,6 +42,12 @@ void MultiBoxSSDLossLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   do_neg_mining_ = mining_type_ != MultiBoxLossParameter_MiningType_NONE;
 
+  const int num_match_threads = multibox_loss_param.num_match_threads();
+  CHECK_GE(num_match_threads, 1) << "num_match_threads must be at least 1.";
+  if (num_match_threads > 1) {
+    match_pool_.reset(new ThreadPool(num_match_threads));
+  }
+
   if (!this->layer_param_.loss_param().has_normalization() &&
       this->layer_param_.loss_param().has_normalize()) {
     normalization_ = this->layer_param_.loss_param().normalize() ?
@@ -191,7 +197,8 @@ void MultiBoxSSDLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom
   // Find matches between source bboxes and ground truth bboxes.
   vector<map<int, vector<float> > > all_match_overlaps;
   FindMatches(all_loc_preds, all_gt_bboxes, prior_bboxes, prior_variances,
-              multibox_loss_param_, &all_match_overlaps, &all_match_indices_);
+              multibox_loss_param_, &all_match_overlaps, &all_match_indices_,
+              match_pool_.get());
 
   num_matches_ = 0;
   int num_negs = 0;
@@ -279,7 +279,14 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  InitParamsNeedDiff();
   debug_info_ = param.debug_info();
+  // Without backward only the blobs a layer reads and writes need to be
+  // alive during its forward.
+  plan_memory_ = param.plan_memory() && phase_ == TEST &&
+      !param.force_backward();
+  memory_planned_ = false;
+  planned_memory_used_ = 0;
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
@@ -550,6 +557,12 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
+  // Layers such as Split share the data of their tops during forward, so
+  // the memory is planned once a whole forward has run.
+  if (plan_memory_ && !memory_planned_ && start == 0 &&
+      end == layers_.size() - 1) {
+    PlanMemory();
+  }
   return loss;
 }
 
@@ -657,7 +670,10 @@ void Net<Dtype>::UpdateDebugInfo(const int param_id) {
   const int param_owner = param_owners_[param_id];
   const string& layer_name = layer_names_[param_layer_indices_[param_id].first];
   const string& param_display_name = param_display_names_[param_id];
-  const Dtype diff_abs_val_mean = blob.asum_diff() / blob.count();
+  // A param without a diff has a zero gradient.
+  const Dtype diff_abs_val_mean =
+      params_need_diff_[learnable_param_ids_[param_id]] ?
+      blob.asum_diff() / blob.count() : Dtype(0);
   if (param_owner < 0) {
     const Dtype data_abs_val_mean = blob.asum_data() / blob.count();
     LOG_IF(INFO, Caffe::root_solver())
@@ -725,6 +741,9 @@ void Net<Dtype>::Backward() {
   if (debug_info_) {
     Dtype asum_data = 0, asum_diff = 0, sumsq_data = 0, sumsq_diff = 0;
     for (int i = 0; i < learnable_params_.size(); ++i) {
+      if (!params_need_diff_[i]) {
+        continue;
+      }
       asum_data += learnable_params_[i]->asum_data();
       asum_diff += learnable_params_[i]->asum_diff();
       sumsq_data += learnable_params_[i]->sumsq_data();
@@ -732,7 +751,7 @@ void Net<Dtype>::Backward() {
     }
     const Dtype l2norm_data = std::sqrt(sumsq_data);
     const Dtype l2norm_diff = std::sqrt(sumsq_diff);
-    LOG(ERROR) << "    [Backward] All net params (data, diff): "
+    LOG(ERROR) << "    [Backward] All trained net params (data, diff): "
                << "L1 norm = (" << asum_data << ", " << asum_diff << "); "
                << "L2 norm = (" << l2norm_data << ", " << l2norm_diff << ")";
   }
@@ -743,6 +762,142 @@ void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  // Blobs that grew have their own memory again until the next plan.
+  memory_planned_ = false;
+}
+
+// Data of the blobs sharing a SyncedMemory, live from the forward of layer
+// first to the one of layer last.
+struct MemoryBlock {
+  SyncedMemory* memory;
+  size_t size;
+  int first;
+  int last;
+  bool fixed;
+  size_t offset;
+};
+
+static bool LargerBlock(const MemoryBlock* a, const MemoryBlock* b) {
+  return a->size > b->size || (a->size == b->size && a->first < b->first);
+}
+
+static bool LowerBlock(const MemoryBlock* a, const MemoryBlock* b) {
+  return a->offset < b->offset;
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanMemory() {
+  memory_planned_ = true;
+  if (Caffe::mode() != Caffe::CPU) {
+    // The GPU copies are allocated per blob, and syncing them back to shared
+    // host memory would overwrite live blobs.
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Memory is only planned in CPU mode.";
+    planned_memory_used_ = 0;
+    return;
+  }
+  const int num_blobs = blobs_.size();
+  vector<bool> fixed(num_blobs, false);
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    fixed[net_input_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    fixed[net_output_blob_indices_[i]] = true;
+  }
+  vector<int> first(num_blobs, -1);
+  vector<int> last(num_blobs, -1);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = bottom_id_vecs_[layer_id][i];
+      first[blob_id] = first[blob_id] < 0 ? layer_id : first[blob_id];
+      last[blob_id] = layer_id;
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = top_id_vecs_[layer_id][i];
+      first[blob_id] = first[blob_id] < 0 ? layer_id : first[blob_id];
+      last[blob_id] = layer_id;
+      // Data layers may point their tops to their own buffers.
+      fixed[blob_id] = fixed[blob_id] || bottom_vecs_[layer_id].empty();
+    }
+  }
+  // Blobs sharing data, e.g. the tops of a split and its bottom, are placed
+  // as one block live over all their layers.
+  vector<MemoryBlock> blocks;
+  map<SyncedMemory*, int> block_ids;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (blobs_[blob_id]->count() == 0 || first[blob_id] < 0) {
+      continue;
+    }
+    SyncedMemory* memory = blobs_[blob_id]->data().get();
+    map<SyncedMemory*, int>::iterator it = block_ids.find(memory);
+    if (it == block_ids.end()) {
+      MemoryBlock block = {memory, memory->size(), first[blob_id],
+          last[blob_id], fixed[blob_id], 0};
+      block_ids[memory] = blocks.size();
+      blocks.push_back(block);
+    } else {
+      MemoryBlock& block = blocks[it->second];
+      block.first = std::min(block.first, first[blob_id]);
+      block.last = std::max(block.last, last[blob_id]);
+      block.fixed = block.fixed || fixed[blob_id];
+    }
+  }
+  // Greedy best-fit: the largest blocks are placed first, each one in the
+  // smallest gap between the blocks live at the same time it fits in.
+  const size_t kAlignment = 64;
+  vector<MemoryBlock*> order;
+  for (int i = 0; i < blocks.size(); ++i) {
+    if (!blocks[i].fixed) {
+      blocks[i].size = (blocks[i].size + kAlignment - 1) / kAlignment *
+          kAlignment;
+      order.push_back(&blocks[i]);
+    }
+  }
+  std::sort(order.begin(), order.end(), LargerBlock);
+  vector<MemoryBlock*> placed;
+  vector<MemoryBlock*> live;
+  size_t total = 0;
+  for (int i = 0; i < order.size(); ++i) {
+    MemoryBlock* block = order[i];
+    live.clear();
+    for (int j = 0; j < placed.size(); ++j) {
+      if (placed[j]->first <= block->last && block->first <= placed[j]->last) {
+        live.push_back(placed[j]);
+      }
+    }
+    std::sort(live.begin(), live.end(), LowerBlock);
+    size_t offset = 0;
+    size_t best_offset = 0;
+    size_t best_gap = 0;
+    bool found = false;
+    for (int j = 0; j < live.size(); ++j) {
+      if (live[j]->offset >= offset + block->size) {
+        const size_t gap = live[j]->offset - offset;
+        if (!found || gap < best_gap) {
+          best_offset = offset;
+          best_gap = gap;
+          found = true;
+        }
+      }
+      offset = std::max(offset, live[j]->offset + live[j]->size);
+    }
+    block->offset = found ? best_offset : offset;
+    total = std::max(total, block->offset + block->size);
+    placed.push_back(block);
+  }
+  if (total > 0) {
+    if (!memory_arena_ || memory_arena_->size() < total) {
+      memory_arena_.reset(new SyncedMemory(total));
+    }
+    uint8_t* arena = static_cast<uint8_t*>(memory_arena_->mutable_cpu_data());
+    for (int i = 0; i < order.size(); ++i) {
+      order[i]->memory->set_cpu_data(arena + order[i]->offset);
+    }
+  }
+  planned_memory_used_ = total;
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Memory planned for " << order.size() << " blocks of data: "
+      << total;
 }
 
 template <typename Dtype>
@@ -923,13 +1078,18 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 template <typename Dtype>
 void Net<Dtype>::Update() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
-    learnable_params_[i]->Update();
+    if (params_need_diff_[i]) {
+      learnable_params_[i]->Update();
+    }
   }
 }
 
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
+    if (!params_need_diff_[i]) {
+      continue;
+    }
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
     case Caffe::CPU:
@@ -948,6 +1108,61 @@ void Net<Dtype>::ClearParamDiffs() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::InitParamsNeedDiff() {
+  params_need_diff_.resize(learnable_params_.size());
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    params_need_diff_[i] = phase_ == TRAIN && params_lr_[i] != 0;
+  }
+  // Frozen params still get a gradient if backward is forced.
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (!layer_need_backward_[layer_id]) {
+      continue;
+    }
+    for (int param_id = 0; param_id < param_id_vecs_[layer_id].size();
+         ++param_id) {
+      if (layers_[layer_id]->param_propagate_down(param_id)) {
+        const int net_param_id = param_id_vecs_[layer_id][param_id];
+        params_need_diff_[learnable_param_ids_[net_param_id]] = true;
+      }
+    }
+  }
+  int num_params = 0;
+  size_t param_bytes = 0;
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    if (!params_need_diff_[i]) {
+      ++num_params;
+      param_bytes += learnable_params_[i]->count() * sizeof(Dtype);
+    }
+  }
+  // Blobs may share their diff, e.g. through reshape layers.
+  set<SyncedMemory*> needed_diffs, unneeded_diffs;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (!blobs_[blob_id]->count()) {
+      continue;
+    }
+    SyncedMemory* diff = blobs_[blob_id]->diff().get();
+    if (blob_need_backward_[blob_id] ||
+        (blob_id < blob_loss_weights_.size() &&
+         blob_loss_weights_[blob_id] != 0)) {
+      needed_diffs.insert(diff);
+    } else {
+      unneeded_diffs.insert(diff);
+    }
+  }
+  size_t blob_bytes = 0;
+  for (set<SyncedMemory*>::iterator it = unneeded_diffs.begin();
+       it != unneeded_diffs.end(); ++it) {
+    if (!needed_diffs.count(*it)) {
+      blob_bytes += (*it)->size();
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Memory not needed for diffs: " << param_bytes << " for "
+      << num_params << " of " << learnable_params_.size()
+      << " learnable params, " << blob_bytes << " for blobs.";
+}
+
 template <typename Dtype>
 void Net<Dtype>::ShareWeights() {
   for (int i = 0; i < params_.size(); ++i) {
@@ -5,6 +5,7 @@
 #include <utility>
 #include <vector>
 
+#include "caffe/layers/base_data_layer.hpp"
 #include "caffe/solver.hpp"
 #include "caffe/util/bbox_util.hpp"
 #include "caffe/util/format.hpp"
@@ -263,6 +264,9 @@ void Solver<Dtype>::Step(int iters) {
                     #endif
                 }
             }
+            if (param_.data_stats() && Caffe::root_solver()) {
+                LogDataStats();
+            }
         }
         for (int i = 0; i < callbacks_.size(); ++i) {
             callbacks_[i]->on_gradients_ready();
@@ -808,6 +812,21 @@ void Solver<Dtype>::UpdateSmoothedLoss(Dtype loss, int start_iter,
     }
 }
 
+template <typename Dtype>
+void Solver<Dtype>::LogDataStats() {
+    const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+    for (int i = 0; i < layers.size(); ++i) {
+        BasePrefetchingDataLayer<Dtype>* data_layer =
+            dynamic_cast<BasePrefetchingDataLayer<Dtype>*>(layers[i].get());
+        if (data_layer == NULL || data_layer->stats()->batches() == 0) {
+            continue;
+        }
+        LOG(INFO) << "    Data layer " << net_->layer_names()[i]
+            << " per batch: " << data_layer->stats()->ToString();
+        data_layer->stats()->Reset();
+    }
+}
+
 INSTANTIATE_CLASS(Solver);
 
 }  // namespace caffe
@@ -114,9 +114,13 @@ void SGDSolver<Dtype>::ClipGradients() {
   const Dtype clip_gradients = this->param_.clip_gradients();
   if (clip_gradients < 0) { return; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const vector<bool>& params_need_diff = this->net_->params_need_diff();
   Dtype sumsq_diff = 0;
   for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+    // Frozen params have no gradient to clip; leave their diffs unallocated.
+    if (params_need_diff[i]) {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -125,7 +129,9 @@ void SGDSolver<Dtype>::ClipGradients() {
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
     for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
+      if (params_need_diff[i]) {
+        net_params[i]->scale_diff(scale_factor);
+      }
     }
   }
 }
@@ -140,6 +146,8 @@ void SGDSolver<Dtype>::ApplyUpdate() {
     ClipGradients();
     for (int param_id = 0; param_id < this->net_->learnable_params().size();
         ++param_id) {
+        // Frozen params have no gradient and a zero update.
+        if (!this->net_->params_need_diff()[param_id]) { continue; }
         Normalize(param_id);
         Regularize(param_id);
         ComputeUpdateValue(param_id, rate);
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <map>
 #include <utility>
 #include <vector>
@@ -6,6 +7,7 @@
 
 #include "caffe/common.hpp"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -315,6 +317,39 @@ TEST_F(CPUBBoxUtilTest, TestJaccardOverlap) {
   EXPECT_NEAR(overlap, 0., eps);
 }
 
+// Fills bboxes with num random bboxes in [0, 1].
+static void FillRandomBBoxes(const int num, vector<NormalizedBBox>* bboxes) {
+  bboxes->resize(num);
+  for (int i = 0; i < num; ++i) {
+    float coords[4];
+    caffe_rng_uniform(4, 0.f, 1.f, coords);
+    NormalizedBBox& bbox = (*bboxes)[i];
+    bbox.set_xmin(std::min(coords[0], coords[2]));
+    bbox.set_ymin(std::min(coords[1], coords[3]));
+    bbox.set_xmax(std::max(coords[0], coords[2]));
+    bbox.set_ymax(std::max(coords[1], coords[3]));
+  }
+}
+
+TEST_F(CPUBBoxUtilTest, TestJaccardOverlaps) {
+  Caffe::set_random_seed(1701);
+  vector<NormalizedBBox> bboxes;
+  FillRandomBBoxes(37, &bboxes);
+  // Touching and invalid bboxes.
+  bboxes[0].set_xmin(bboxes[1].xmax());
+  bboxes[2].set_xmax(bboxes[2].xmin() - 0.1);
+  const BBoxArray bbox_array(bboxes);
+  ASSERT_EQ(37, bbox_array.count());
+  vector<float> overlaps(bboxes.size());
+  for (int j = 0; j < bboxes.size(); ++j) {
+    JaccardOverlaps(bbox_array, bboxes[j], &overlaps[0]);
+    for (int i = 0; i < bboxes.size(); ++i) {
+      EXPECT_EQ(JaccardOverlap(bboxes[i], bboxes[j]), overlaps[i])
+          << "bbox " << i << " with bbox " << j;
+    }
+  }
+}
+
 TEST_F(CPUBBoxUtilTest, TestEncodeBBoxCorner) {
   NormalizedBBox prior_bbox;
   prior_bbox.set_xmin(0.1);
@@ -574,6 +609,49 @@ TEST_F(CPUBBoxUtilTest, TestDecodeBBoxesCenterSize) {
   }
 }
 
+TEST_F(CPUBBoxUtilTest, TestDecodeBBoxesPlain) {
+  Caffe::set_random_seed(1701);
+  const int num = 23;
+  vector<NormalizedBBox> prior_bboxes;
+  vector<NormalizedBBox> bboxes;
+  FillRandomBBoxes(num, &prior_bboxes);
+  FillRandomBBoxes(num, &bboxes);
+  vector<vector<float> > prior_variances(num);
+  vector<float> flat_variances;
+  vector<BBox> prior_boxes(num), boxes(num);
+  for (int i = 0; i < num; ++i) {
+    prior_variances[i].resize(4);
+    caffe_rng_uniform(4, 0.1f, 0.2f, &prior_variances[i][0]);
+    flat_variances.insert(flat_variances.end(), prior_variances[i].begin(),
+                          prior_variances[i].end());
+    ToBBox(prior_bboxes[i], &prior_boxes[i]);
+    ToBBox(bboxes[i], &boxes[i]);
+  }
+  const CodeType code_types[] = {PriorBoxParameter_CodeType_CORNER,
+      PriorBoxParameter_CodeType_CENTER_SIZE,
+      PriorBoxParameter_CodeType_CORNER_SIZE};
+  for (int t = 0; t < 3; ++t) {
+    for (int flags = 0; flags < 4; ++flags) {
+      const bool variance_encoded_in_target = flags & 1;
+      const bool clip = flags & 2;
+      vector<NormalizedBBox> decode_bboxes;
+      vector<BBox> decode_boxes;
+      DecodeBBoxes(prior_bboxes, prior_variances, code_types[t],
+                   variance_encoded_in_target, clip, bboxes, &decode_bboxes);
+      DecodeBBoxes(prior_boxes, flat_variances, code_types[t],
+                   variance_encoded_in_target, clip, boxes, &decode_boxes);
+      ASSERT_EQ(num, decode_boxes.size());
+      for (int i = 0; i < num; ++i) {
+        EXPECT_EQ(decode_bboxes[i].xmin(), decode_boxes[i].xmin);
+        EXPECT_EQ(decode_bboxes[i].ymin(), decode_boxes[i].ymin);
+        EXPECT_EQ(decode_bboxes[i].xmax(), decode_boxes[i].xmax);
+        EXPECT_EQ(decode_bboxes[i].ymax(), decode_boxes[i].ymax);
+        EXPECT_EQ(decode_bboxes[i].size(), decode_boxes[i].size);
+      }
+    }
+  }
+}
+
 TEST_F(CPUBBoxUtilTest, TestMatchBBoxLableOneBipartite) {
   vector<NormalizedBBox> gt_bboxes;
   vector<NormalizedBBox> pred_bboxes;
@@ -786,6 +864,46 @@ TEST_F(CPUBBoxUtilTest, TestMatchBBoxLableAllPerPredictionEx) {
   EXPECT_NEAR(match_overlaps[5], 0., eps);
 }
 
+TEST_F(CPUBBoxUtilTest, TestFindMatchesParallel) {
+  Caffe::set_random_seed(1701);
+  const int num = 5;
+  vector<NormalizedBBox> prior_bboxes;
+  FillRandomBBoxes(300, &prior_bboxes);
+  vector<vector<float> > prior_variances(300, vector<float>(4, 0.1));
+  vector<LabelBBox> all_loc_preds(num);
+  map<int, vector<NormalizedBBox> > all_gt_bboxes;
+  for (int i = 0; i < num; ++i) {
+    all_loc_preds[i][-1] = prior_bboxes;
+    // The third image has no ground truth.
+    if (i != 2) {
+      FillRandomBBoxes(i + 1, &all_gt_bboxes[i]);
+      for (int g = 0; g <= i; ++g) {
+        all_gt_bboxes[i][g].set_label(1 + g % 2);
+      }
+    }
+  }
+  MultiBoxLossParameter param;
+  param.set_num_classes(3);
+  param.set_match_type(MultiBoxLossParameter_MatchType_PER_PREDICTION);
+  param.set_overlap_threshold(0.3);
+
+  vector<map<int, vector<float> > > expected_overlaps;
+  vector<map<int, vector<int> > > expected_indices;
+  FindMatches(all_loc_preds, all_gt_bboxes, prior_bboxes, prior_variances,
+              param, &expected_overlaps, &expected_indices);
+  ASSERT_EQ(num, expected_indices.size());
+  EXPECT_EQ(0, expected_indices[2].size());
+  EXPECT_GT(CountNumMatches(expected_indices, num), 0);
+
+  ThreadPool pool(3);
+  vector<map<int, vector<float> > > all_match_overlaps;
+  vector<map<int, vector<int> > > all_match_indices;
+  FindMatches(all_loc_preds, all_gt_bboxes, prior_bboxes, prior_variances,
+              param, &all_match_overlaps, &all_match_indices, &pool);
+  EXPECT_TRUE(expected_overlaps == all_match_overlaps);
+  EXPECT_TRUE(expected_indices == all_match_indices);
+}
+
 TEST_F(CPUBBoxUtilTest, TestGetGroundTruth) {
   const int num_gt = 4;
   Blob<float> gt_blob(1, 1, num_gt, 8);
@@ -1468,6 +1586,89 @@ TEST_F(CPUBBoxUtilTest, TestApplyNMSFast) {
   EXPECT_EQ(indices[0], 0);
 }
 
+TEST_F(CPUBBoxUtilTest, TestApplyNMSFastPlain) {
+  Caffe::set_random_seed(1701);
+  const int num = 200;
+  vector<NormalizedBBox> bboxes;
+  FillRandomBBoxes(num, &bboxes);
+  vector<float> scores(num);
+  caffe_rng_uniform(num, 0.f, 1.f, &scores[0]);
+  vector<BBox> boxes(num);
+  for (int i = 0; i < num; ++i) {
+    ToBBox(bboxes[i], &boxes[i]);
+  }
+  const float eta[] = {1., 0.9};
+  for (int e = 0; e < 2; ++e) {
+    vector<int> indices, box_indices;
+    ApplyNMSFast(bboxes, scores, 0.1, 0.45, eta[e], 100, &indices);
+    ApplyNMSFast(boxes, scores, 0.1, 0.45, eta[e], 100, &box_indices);
+    EXPECT_GT(indices.size(), 1);
+    EXPECT_TRUE(indices == box_indices);
+  }
+  // Round trip through BBox.
+  NormalizedBBox bbox = bboxes[0];
+  bbox.set_label(3);
+  bbox.set_score(0.5);
+  BBox box;
+  ToBBox(bbox, &box);
+  EXPECT_EQ(-1, box.size);
+  NormalizedBBox round_trip;
+  ToNormalizedBBox(box, &round_trip);
+  EXPECT_EQ(bbox.SerializeAsString(), round_trip.SerializeAsString());
+}
+
+TEST_F(CPUBBoxUtilTest, TestApplyNMSFastDense) {
+  Caffe::set_random_seed(1701);
+  // Many small bboxes, so that the nms runs on a grid of several cells.
+  const int num = 3000;
+  vector<BBox> bboxes(num);
+  vector<float> scores(num);
+  caffe_rng_uniform(num, 0.f, 1.f, &scores[0]);
+  for (int i = 0; i < num; ++i) {
+    float coords[4];
+    caffe_rng_uniform(2, 0.f, 1.f, coords);
+    caffe_rng_uniform(2, 0.f, 0.05f, coords + 2);
+    bboxes[i].xmin = coords[0];
+    bboxes[i].ymin = coords[1];
+    bboxes[i].xmax = coords[0] + coords[2];
+    bboxes[i].ymax = coords[1] + coords[3];
+    bboxes[i].label = 0;
+    bboxes[i].score = scores[i];
+    bboxes[i].size = -1;
+  }
+  const float nms_thresholds[] = {0.45, 0., -0.1};
+  const float eta[] = {1., 0.9};
+  for (int t = 0; t < 3; ++t) {
+    for (int e = 0; e < 2; ++e) {
+      // Test every pair of bboxes as a reference.
+      vector<pair<float, int> > score_index_vec;
+      GetMaxScoreIndex(scores, 0.05, -1, &score_index_vec);
+      vector<int> expected;
+      float adaptive_threshold = nms_thresholds[t];
+      for (int i = 0; i < score_index_vec.size(); ++i) {
+        const int idx = score_index_vec[i].second;
+        bool keep = true;
+        for (int k = 0; k < expected.size() && keep; ++k) {
+          keep = JaccardOverlap(bboxes[idx], bboxes[expected[k]]) <=
+              adaptive_threshold;
+        }
+        if (keep) {
+          expected.push_back(idx);
+          if (eta[e] < 1 && adaptive_threshold > 0.5) {
+            adaptive_threshold *= eta[e];
+          }
+        }
+      }
+      vector<int> indices;
+      ApplyNMSFast(bboxes, scores, 0.05, nms_thresholds[t], eta[e], -1,
+                   &indices);
+      // A negative threshold lets the first bbox suppress all the others.
+      EXPECT_EQ(nms_thresholds[t] < 0, indices.size() == 1);
+      EXPECT_TRUE(expected == indices) << "threshold " << nms_thresholds[t];
+    }
+  }
+}
+
 TEST_F(CPUBBoxUtilTest, TestCumSum) {
   vector<pair<float, int> > pairs;
   vector<int> cumsum;
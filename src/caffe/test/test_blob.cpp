@@ -59,6 +59,24 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestReserve) {
+  this->blob_->Reserve(120);
+  EXPECT_EQ(this->blob_->count(), 0);
+  EXPECT_EQ(this->blob_->capacity(), 120);
+  this->blob_->Reshape(2, 3, 4, 5);
+  const TypeParam* data = this->blob_->cpu_data();
+  // Shrinking and growing back within the reserved capacity keeps the memory.
+  this->blob_->Reshape(1, 3, 4, 5);
+  this->blob_->Reshape(2, 3, 4, 5);
+  EXPECT_EQ(this->blob_->cpu_data(), data);
+  this->blob_->Reserve(60);
+  EXPECT_EQ(this->blob_->capacity(), 120);
+  EXPECT_EQ(this->blob_->cpu_data(), data);
+  this->blob_->Reserve(240);
+  EXPECT_EQ(this->blob_->capacity(), 240);
+  EXPECT_EQ(this->blob_->count(), 120);
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/center_bbox_util.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CenterBBoxUtilTest : public ::testing::Test {
+ protected:
+  CenterBBoxUtilTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // Fills boxes with num random pixel boxes in a 512 x 512 image, whose size
+  // holds their area.
+  void FillBoxes(const int num) {
+    boxes_.resize(num);
+    vector<float> values(5 * num);
+    caffe_rng_uniform(2 * num, 0.f, 480.f, &values[0]);
+    caffe_rng_uniform(2 * num, 4.f, 32.f, &values[2 * num]);
+    caffe_rng_uniform(num, 0.f, 1.f, &values[4 * num]);
+    for (int i = 0; i < num; ++i) {
+      BBox& box = boxes_[i];
+      box.xmin = values[2 * i];
+      box.ymin = values[2 * i + 1];
+      box.xmax = box.xmin + values[2 * num + 2 * i];
+      box.ymax = box.ymin + values[2 * num + 2 * i + 1];
+      box.label = i % 3;
+      // Some ties, to check their order.
+      box.score = i % 10 == 0 ? 0.5 : values[4 * num + i];
+      box.size = (box.xmax - box.xmin + 1) * (box.ymax - box.ymin + 1);
+    }
+  }
+
+  vector<BBox> boxes_;
+};
+
+TEST_F(CenterBBoxUtilTest, TestHardNMSMaxPicked) {
+  FillBoxes(1000);
+  vector<int> all_picked;
+  hard_nms(boxes_, &all_picked, 0.3);
+  ASSERT_GT(all_picked.size(), 20);
+  for (int i = 1; i < all_picked.size(); ++i) {
+    const BBox& prev = boxes_[all_picked[i - 1]];
+    const BBox& cur = boxes_[all_picked[i]];
+    EXPECT_TRUE(prev.score > cur.score ||
+        (prev.score == cur.score && all_picked[i - 1] < all_picked[i]));
+  }
+  // Stopping early keeps the best of the same bboxes.
+  const int max_picked[] = {0, 1, 20, static_cast<int>(all_picked.size()),
+      10000};
+  for (int m = 0; m < sizeof(max_picked) / sizeof(max_picked[0]); ++m) {
+    vector<int> picked;
+    hard_nms(boxes_, &picked, 0.3, NMS_UNION, max_picked[m]);
+    ASSERT_EQ(std::min<int>(max_picked[m], all_picked.size()), picked.size());
+    for (int i = 0; i < picked.size(); ++i) {
+      EXPECT_EQ(all_picked[i], picked[i]);
+    }
+  }
+}
+
+TEST_F(CenterBBoxUtilTest, TestGetTopKThreads) {
+  const int num = 3;
+  const int classes = 2;
+  const int height = 16;
+  const int width = 16;
+  const int dim = height * width;
+  vector<float> conf(num * classes * dim);
+  vector<float> loc(num * 4 * dim);
+  caffe_rng_uniform(conf.size(), 0.f, 1.f, &conf[0]);
+  caffe_rng_uniform(loc.size(), 0.f, 1.f, &loc[0]);
+  // The last image has no detection.
+  std::fill(conf.begin() + (num - 1) * classes * dim, conf.end(), 0.f);
+  std::map<int, vector<CenterNetInfo> > expected;
+  get_topK(&conf[0], &loc[0], height, width, classes, num, &expected, 4, false,
+      0.5f, 0.3f);
+  ASSERT_EQ(num - 1, expected.size());
+  ThreadPool pool(2);
+  const int top_k = 5;
+  std::map<int, vector<CenterNetInfo> > results;
+  get_topK(&conf[0], &loc[0], height, width, classes, num, &results, 4, false,
+      0.5f, 0.3f, top_k, &pool);
+  ASSERT_EQ(expected.size(), results.size());
+  for (int i = 0; i < num - 1; ++i) {
+    const vector<CenterNetInfo>& expected_dets = expected[i];
+    const vector<CenterNetInfo>& dets = results[i];
+    ASSERT_GT(expected_dets.size(), top_k);
+    ASSERT_EQ(top_k, dets.size());
+    for (int j = 0; j < top_k; ++j) {
+      EXPECT_EQ(expected_dets[j].class_id(), dets[j].class_id());
+      EXPECT_EQ(expected_dets[j].score(), dets[j].score());
+      EXPECT_EQ(expected_dets[j].xmin(), dets[j].xmin());
+      EXPECT_EQ(expected_dets[j].ymax(), dets[j].ymax());
+    }
+  }
+}
+
+TEST_F(CenterBBoxUtilTest, TestGetTopKHeatmapPeaks) {
+  const int classes = 2;
+  const int height = 16;
+  const int width = 16;
+  const int dim = height * width;
+  vector<float> conf(classes * dim);
+  vector<float> loc(4 * dim);
+  caffe_rng_uniform(conf.size(), 0.f, 1.f, &conf[0]);
+  caffe_rng_uniform(loc.size(), 0.f, 1.f, &loc[0]);
+  const float conf_thresh = 0.3;
+  int num_peaks = 0;
+  int num_above = 0;
+  for (int c = 0; c < classes; ++c) {
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        const float value = conf[(c * height + h) * width + w];
+        bool peak = value > conf_thresh;
+        for (int nh = std::max(h - 1, 0); nh <= std::min(h + 1, height - 1);
+             ++nh) {
+          for (int nw = std::max(w - 1, 0); nw <= std::min(w + 1, width - 1);
+               ++nw) {
+            peak = peak && conf[(c * height + nh) * width + nw] <= value;
+          }
+        }
+        num_peaks += peak;
+        num_above += value > conf_thresh;
+      }
+    }
+  }
+  ASSERT_GT(num_peaks, 0);
+  ASSERT_LT(num_peaks, num_above);
+  // The overlaps of these bboxes are below 4, so the nms keeps every
+  // candidate.
+  std::map<int, vector<CenterNetInfo> > results;
+  get_topK(&conf[0], &loc[0], height, width, classes, 1, &results, 4, false,
+      conf_thresh, 4.f);
+  EXPECT_EQ(num_above, results[0].size());
+  results.clear();
+  get_topK(&conf[0], &loc[0], height, width, classes, 1, &results, 4, false,
+      conf_thresh, 4.f, -1, NULL, true);
+  EXPECT_EQ(num_peaks, results[0].size());
+}
+
+}  // namespace caffe
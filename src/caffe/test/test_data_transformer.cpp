@@ -108,6 +108,51 @@ class DataTransformTest : public ::testing::Test {
     return num_sequence_matches;
   }
 
+  // Distorts and then expands anno_datum, whose datum is encoded, with the
+  // expansion never drawn. Checks that both the datum API and the cv::Mat
+  // one hand on an image that Transform can use.
+  template <typename AnnoDatum, typename Anno>
+  void CheckDistortWithoutExpand(const AnnoDatum& anno_datum, Anno* anno) {
+    TransformationParameter transform_param;
+    transform_param.mutable_distort_param()->set_brightness_prob(1);
+    transform_param.mutable_distort_param()->set_brightness_delta(32);
+    transform_param.mutable_expand_param()->set_prob(0);
+    transform_param.mutable_expand_param()->set_max_expand_ratio(2);
+    DataTransformer<Dtype> transformer(transform_param, TRAIN);
+    transformer.InitRand();
+    Caffe::set_random_seed(seed_);
+    const Datum& datum = anno_datum.datum();
+
+    // The datum API hands on regular encoded datums.
+    AnnoDatum distort_datum(anno_datum);
+    transformer.DistortImage(datum, distort_datum.mutable_datum());
+    AnnoDatum expand_datum;
+    transformer.ExpandImage(distort_datum, &expand_datum);
+    EXPECT_TRUE(expand_datum.datum().encoded());
+    EXPECT_GT(expand_datum.datum().data().size(), 0);
+    Blob<Dtype> blob(transformer.InferBlobShape(expand_datum.datum()));
+    transformer.Transform(expand_datum, &blob, anno);
+
+    // The cv::Mat API hands on the image and only its size in the datums.
+    cv::Mat img;
+    distort_datum.CopyFrom(anno_datum);
+    transformer.DistortImage(datum, distort_datum.mutable_datum(), &img);
+    transformer.ExpandImage(distort_datum, &expand_datum, &img);
+    ASSERT_FALSE(img.empty());
+    EXPECT_EQ(0, expand_datum.datum().data().size());
+    EXPECT_EQ(datum.height(), expand_datum.datum().height());
+    EXPECT_EQ(datum.width(), expand_datum.datum().width());
+    blob.Reshape(transformer.InferBlobShape(img));
+    transformer.Transform(img, expand_datum, &blob, anno);
+    for (int h = 0; h < img.rows; ++h) {
+      for (int w = 0; w < img.cols; ++w) {
+        for (int c = 0; c < img.channels(); ++c) {
+          ASSERT_EQ(img.at<cv::Vec3b>(h, w)[c], blob.data_at(0, c, h, w));
+        }
+      }
+    }
+  }
+
   int seed_;
   int num_iter_;
   int channels_;
@@ -455,5 +500,241 @@ TYPED_TEST(DataTransformTest, TestRichLabelCropMirror) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestExpandCropImage) {
+  TransformationParameter transform_param;
+  transform_param.mutable_expand_param()->set_prob(1);
+  transform_param.mutable_expand_param()->set_max_expand_ratio(2);
+  transform_param.add_mean_value(10);
+  transform_param.add_mean_value(20);
+  transform_param.add_mean_value(30);
+  const float eps = 1e-5;
+
+  // A losslessly encoded image with unique pixels.
+  const int height = 20;
+  const int width = 30;
+  cv::Mat img(height, width, CV_8UC3);
+  for (int h = 0; h < height; ++h) {
+    for (int w = 0; w < width; ++w) {
+      img.at<cv::Vec3b>(h, w) = cv::Vec3b(h, w, 100 + h + w);
+    }
+  }
+  AnnotatedDatum anno_datum;
+  EncodeCVMatToDatum(img, "png", anno_datum.mutable_datum());
+  anno_datum.set_type(AnnotatedDatum_AnnotationType_BBOX);
+  Annotation* anno = anno_datum.add_annotation_group()->add_annotation();
+  anno->mutable_bbox()->set_xmin(0.2);
+  anno->mutable_bbox()->set_ymin(0.2);
+  anno->mutable_bbox()->set_xmax(0.6);
+  anno->mutable_bbox()->set_ymax(0.6);
+
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+  Caffe::set_random_seed(this->seed_);
+  NormalizedBBox expand_bbox;
+  AnnotatedDatum expand_datum;
+  transformer.ExpandAnnotation(anno_datum, &expand_bbox, &expand_datum);
+  const int expand_height = expand_datum.datum().height();
+  const int expand_width = expand_datum.datum().width();
+  EXPECT_GE(expand_height, height);
+  EXPECT_GE(expand_width, width);
+  EXPECT_FALSE(expand_datum.datum().has_data());
+  const int h_off = -expand_bbox.ymin() * height + 0.5;
+  const int w_off = -expand_bbox.xmin() * width + 0.5;
+  ASSERT_EQ(1, expand_datum.annotation_group_size());
+  const NormalizedBBox& bbox =
+      expand_datum.annotation_group(0).annotation(0).bbox();
+  EXPECT_NEAR((w_off + 0.2 * width) / expand_width, bbox.xmin(), eps);
+  EXPECT_NEAR((h_off + 0.2 * height) / expand_height, bbox.ymin(), eps);
+  EXPECT_NEAR((w_off + 0.6 * width) / expand_width, bbox.xmax(), eps);
+  EXPECT_NEAR((h_off + 0.6 * height) / expand_height, bbox.ymax(), eps);
+
+  // The whole expanded image is the image on the mean values.
+  NormalizedBBox crop_bbox;
+  crop_bbox.set_xmin(0);
+  crop_bbox.set_ymin(0);
+  crop_bbox.set_xmax(1);
+  crop_bbox.set_ymax(1);
+  cv::Mat expand_img;
+  transformer.ExpandCropImage(anno_datum.datum(), expand_bbox, crop_bbox,
+      &expand_img);
+  ASSERT_EQ(expand_height, expand_img.rows);
+  ASSERT_EQ(expand_width, expand_img.cols);
+  for (int h = 0; h < expand_height; ++h) {
+    for (int w = 0; w < expand_width; ++w) {
+      const int img_h = h - h_off;
+      const int img_w = w - w_off;
+      const cv::Vec3b expected =
+          img_h >= 0 && img_h < height && img_w >= 0 && img_w < width ?
+          img.at<cv::Vec3b>(img_h, img_w) : cv::Vec3b(10, 20, 30);
+      ASSERT_EQ(expected, expand_img.at<cv::Vec3b>(h, w))
+          << "h " << h << " w " << w;
+    }
+  }
+
+  // A crop matches the same crop of the expanded image.
+  crop_bbox.set_xmin(0.3);
+  crop_bbox.set_ymin(0.1);
+  crop_bbox.set_xmax(0.8);
+  crop_bbox.set_ymax(0.7);
+  cv::Mat crop_img;
+  transformer.ExpandCropImage(anno_datum.datum(), expand_bbox, crop_bbox,
+      &crop_img);
+  cv::Mat expected_crop_img;
+  transformer.CropImage(expand_img, crop_bbox, &expected_crop_img);
+  ASSERT_EQ(expected_crop_img.rows, crop_img.rows);
+  ASSERT_EQ(expected_crop_img.cols, crop_img.cols);
+  EXPECT_EQ(0, cv::norm(expected_crop_img, crop_img, cv::NORM_INF));
+}
+
+TYPED_TEST(DataTransformTest, TestExpandImageEncoded) {
+  TransformationParameter transform_param;
+  transform_param.add_mean_value(10);
+  transform_param.add_mean_value(20);
+  transform_param.add_mean_value(30);
+  const int height = 20;
+  const int width = 30;
+  cv::Mat img(height, width, CV_8UC3);
+  for (int h = 0; h < height; ++h) {
+    for (int w = 0; w < width; ++w) {
+      img.at<cv::Vec3b>(h, w) = cv::Vec3b(h, w, 100 + h + w);
+    }
+  }
+  Datum datum;
+  EncodeCVMatToDatum(img, "png", &datum);
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+
+  // The expanded datum is a regular encoded one.
+  Caffe::set_random_seed(this->seed_);
+  NormalizedBBox expand_bbox;
+  Datum expand_datum;
+  transformer.ExpandImage(datum, 2.5, &expand_bbox, &expand_datum);
+  EXPECT_TRUE(expand_datum.encoded());
+  EXPECT_GT(expand_datum.data().size(), 0);
+  cv::Mat expand_img = transformer.DecodeDatum(expand_datum);
+  EXPECT_EQ(50, expand_img.rows);
+  EXPECT_EQ(75, expand_img.cols);
+
+  // Handing on the image gives the one ExpandImage(cv::Mat) builds, and
+  // the expanded datum only has its size.
+  Caffe::set_random_seed(this->seed_);
+  NormalizedBBox expected_bbox;
+  cv::Mat expected_img;
+  transformer.ExpandImage(img, 2.5, &expected_bbox, &expected_img);
+  Caffe::set_random_seed(this->seed_);
+  expand_img.release();
+  transformer.ExpandImage(datum, 2.5, &expand_bbox, &expand_datum,
+      &expand_img);
+  EXPECT_FLOAT_EQ(expected_bbox.xmin(), expand_bbox.xmin());
+  EXPECT_FLOAT_EQ(expected_bbox.ymin(), expand_bbox.ymin());
+  EXPECT_FLOAT_EQ(expected_bbox.xmax(), expand_bbox.xmax());
+  EXPECT_FLOAT_EQ(expected_bbox.ymax(), expand_bbox.ymax());
+  EXPECT_TRUE(expand_datum.encoded());
+  EXPECT_EQ(0, expand_datum.data().size());
+  EXPECT_EQ(3, expand_datum.channels());
+  EXPECT_EQ(50, expand_datum.height());
+  EXPECT_EQ(75, expand_datum.width());
+  ASSERT_EQ(expected_img.rows, expand_img.rows);
+  ASSERT_EQ(expected_img.cols, expand_img.cols);
+  EXPECT_EQ(0, cv::norm(expected_img, expand_img, cv::NORM_INF));
+}
+
+TYPED_TEST(DataTransformTest, TestCropImageEncoded) {
+  TransformationParameter transform_param;
+  cv::Mat img(20, 30, CV_8UC3);
+  for (int h = 0; h < img.rows; ++h) {
+    for (int w = 0; w < img.cols; ++w) {
+      img.at<cv::Vec3b>(h, w) = cv::Vec3b(h, w, h + w);
+    }
+  }
+  Datum datum;
+  EncodeCVMatToDatum(img, "png", &datum);
+  datum.set_label(3);
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+
+  // The cropped datum is a regular encoded one.
+  NormalizedBBox bbox;
+  bbox.set_xmin(0.25);
+  bbox.set_ymin(0.25);
+  bbox.set_xmax(0.75);
+  bbox.set_ymax(0.75);
+  Datum crop_datum;
+  transformer.CropImage(datum, bbox, &crop_datum);
+  EXPECT_TRUE(crop_datum.encoded());
+  EXPECT_GT(crop_datum.data().size(), 0);
+  EXPECT_EQ(3, crop_datum.label());
+  cv::Mat crop_img = transformer.DecodeDatum(crop_datum);
+  EXPECT_EQ(10, crop_img.rows);
+  EXPECT_EQ(15, crop_img.cols);
+
+  // Handing on the image gives the exact crop, and the cropped datum only
+  // has its size.
+  crop_img.release();
+  transformer.CropImage(datum, bbox, &crop_datum, &crop_img);
+  EXPECT_TRUE(crop_datum.encoded());
+  EXPECT_EQ(0, crop_datum.data().size());
+  EXPECT_EQ(3, crop_datum.label());
+  EXPECT_EQ(3, crop_datum.channels());
+  EXPECT_EQ(10, crop_datum.height());
+  EXPECT_EQ(15, crop_datum.width());
+  EXPECT_EQ(0, cv::norm(img(cv::Rect(7, 5, 15, 10)), crop_img,
+      cv::NORM_INF));
+
+  // The image can be transformed and expanded further.
+  Blob<TypeParam> blob(transformer.InferBlobShape(crop_img));
+  transformer.Transform(crop_img, &blob);
+  EXPECT_EQ(5, blob.data_at(0, 0, 0, 0));
+  EXPECT_EQ(7, blob.data_at(0, 1, 0, 0));
+  EXPECT_EQ(5 + 7, blob.data_at(0, 2, 0, 0));
+  NormalizedBBox expand_bbox;
+  Datum expand_datum;
+  cv::Mat expand_img = crop_img;
+  transformer.ExpandImage(crop_datum, 2, &expand_bbox, &expand_datum,
+      &expand_img);
+  EXPECT_EQ(20, expand_datum.height());
+  EXPECT_EQ(30, expand_datum.width());
+  const cv::Rect roi(cvRound(-expand_bbox.xmin() * 15),
+      cvRound(-expand_bbox.ymin() * 10), 15, 10);
+  EXPECT_EQ(0, cv::norm(crop_img, expand_img(roi), cv::NORM_INF));
+}
+
+TYPED_TEST(DataTransformTest, TestDistortWithoutExpandAnnotated) {
+  const cv::Mat img(20, 30, CV_8UC3, cv::Scalar(50, 100, 150));
+  AnnotatedDatum anno_datum;
+  EncodeCVMatToDatum(img, "png", anno_datum.mutable_datum());
+  anno_datum.set_type(AnnotatedDatum_AnnotationType_BBOX);
+  NormalizedBBox* bbox =
+      anno_datum.add_annotation_group()->add_annotation()->mutable_bbox();
+  bbox->set_xmin(0.2);
+  bbox->set_ymin(0.2);
+  bbox->set_xmax(0.6);
+  bbox->set_ymax(0.6);
+  vector<AnnotationGroup> anno;
+  this->CheckDistortWithoutExpand(anno_datum, &anno);
+}
+
+TYPED_TEST(DataTransformTest, TestDistortWithoutExpandFaceAttribute) {
+  const cv::Mat img(20, 30, CV_8UC3, cv::Scalar(50, 100, 150));
+  AnnoFaceAttributeDatum anno_datum;
+  EncodeCVMatToDatum(img, "png", anno_datum.mutable_datum());
+  anno_datum.set_type(AnnoFaceAttributeDatum_AnnoType_FACEATTRIBUTE);
+  anno_datum.mutable_faceattri()->set_gender(1);
+  AnnoFaceAttribute anno;
+  this->CheckDistortWithoutExpand(anno_datum, &anno);
+  EXPECT_EQ(1, anno.gender());
+}
+
+TYPED_TEST(DataTransformTest, TestDistortWithoutExpandCCpd) {
+  const cv::Mat img(20, 30, CV_8UC3, cv::Scalar(50, 100, 150));
+  AnnotatedCCpdDatum anno_datum;
+  EncodeCVMatToDatum(img, "png", anno_datum.mutable_datum());
+  anno_datum.set_type(AnnotatedCCpdDatum_AnnotationType_CCPD);
+  anno_datum.mutable_lpnumber()->set_chichracter(4);
+  LicensePlate anno;
+  this->CheckDistortWithoutExpand(anno_datum, &anno);
+  EXPECT_EQ(4, anno.chichracter());
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -117,6 +117,26 @@ TYPED_TEST(DBTest, TestKeyValue) {
   EXPECT_FALSE(cursor->valid());
 }
 
+TYPED_TEST(DBTest, TestValueData) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  while (cursor->valid()) {
+    string value = cursor->value();
+    ASSERT_EQ(value.size(), cursor->value_size());
+    EXPECT_EQ(value, string(cursor->value_data(), cursor->value_size()));
+    Datum datum, datum_view;
+    datum.ParseFromString(value);
+    EXPECT_TRUE(datum_view.ParseFromArray(cursor->value_data(),
+        cursor->value_size()));
+    EXPECT_EQ(datum.channels(), datum_view.channels());
+    EXPECT_EQ(datum.height(), datum_view.height());
+    EXPECT_EQ(datum.width(), datum_view.width());
+    EXPECT_EQ(datum.data(), datum_view.data());
+    cursor->Next();
+  }
+}
+
 TYPED_TEST(DBTest, TestWrite) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::WRITE);
@@ -190,6 +190,79 @@ TYPED_TEST(DetectionOutputLayerTest, TestForwardShareLocation) {
   this->CheckEqual(*(this->blob_top_), 5, "1 1 0.0 0.25 0.25 0.55 0.55");
 }
 
+TYPED_TEST(DetectionOutputLayerTest, TestForwardConfidenceThreshold) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  DetectionOutputParameter* detection_output_param =
+      layer_param.mutable_detection_output_param();
+  detection_output_param->set_num_classes(this->num_classes_);
+  detection_output_param->set_share_location(true);
+  detection_output_param->set_background_label_id(0);
+  detection_output_param->set_confidence_threshold(0.5);
+  detection_output_param->mutable_nms_param()->set_nms_threshold(
+      this->nms_threshold_);
+  DetectionOutputLayer<Dtype> layer(layer_param);
+
+  this->FillLocData(true);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  EXPECT_EQ(this->blob_top_->height(), 4);
+  this->CheckEqual(*(this->blob_top_), 0, "0 1 1.0 0.15 0.15 0.45 0.45");
+  this->CheckEqual(*(this->blob_top_), 1, "0 1 0.8 0.55 0.15 0.85 0.45");
+  this->CheckEqual(*(this->blob_top_), 2, "0 1 0.6 0.15 0.55 0.45 0.85");
+  this->CheckEqual(*(this->blob_top_), 3, "1 1 0.6 0.45 0.45 0.75 0.75");
+
+  // The priors decoded by the first forward must not be reused once the
+  // prior data changes.
+  Dtype* prior_data = this->blob_bottom_prior_->mutable_cpu_data();
+  for (int i = 0; i < this->num_priors_ * 4; ++i) {
+    prior_data[i] += 0.05;
+  }
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  EXPECT_EQ(this->blob_top_->height(), 4);
+  this->CheckEqual(*(this->blob_top_), 0, "0 1 1.0 0.20 0.20 0.50 0.50");
+  this->CheckEqual(*(this->blob_top_), 1, "0 1 0.8 0.60 0.20 0.90 0.50");
+  this->CheckEqual(*(this->blob_top_), 2, "0 1 0.6 0.20 0.60 0.50 0.90");
+  this->CheckEqual(*(this->blob_top_), 3, "1 1 0.6 0.50 0.50 0.80 0.80");
+}
+
+TYPED_TEST(DetectionOutputLayerTest, TestForwardThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  for (int flags = 0; flags < 4; ++flags) {
+    const bool share_location = flags & 1;
+    LayerParameter layer_param;
+    DetectionOutputParameter* detection_output_param =
+        layer_param.mutable_detection_output_param();
+    detection_output_param->set_num_classes(this->num_classes_);
+    detection_output_param->set_share_location(share_location);
+    detection_output_param->set_background_label_id(-1);
+    detection_output_param->mutable_nms_param()->set_nms_threshold(
+        this->nms_threshold_);
+    if (flags & 2) {
+      detection_output_param->set_keep_top_k(3);
+    }
+    this->FillLocData(share_location);
+    DetectionOutputLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> expected;
+    expected.CopyFrom(*this->blob_top_, false, true);
+
+    detection_output_param->set_num_nms_threads(3);
+    DetectionOutputLayer<Dtype> parallel_layer(layer_param);
+    parallel_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    parallel_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_EQ(expected.count(), this->blob_top_->count());
+    EXPECT_GT(expected.height(), 2);
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], this->blob_top_->cpu_data()[i])
+          << "flags " << flags << " i " << i;
+    }
+  }
+}
+
 TYPED_TEST(DetectionOutputLayerTest, TestForwardShareLocationTopK) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
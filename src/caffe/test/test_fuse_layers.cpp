@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/fuse_layers.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class FuseLayersTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  FuseLayersTest() {}
+
+  // Fuses the net of proto, with random weights and statistics, and checks
+  // that the fused net computes the same output in num_layers layers. If
+  // fuse_proto is set, it is fused instead of proto, with the weights of the
+  // net of proto.
+  void CheckFuse(const string& proto, const int num_folded,
+      const int num_layers, const string& fuse_proto = "") {
+    Caffe::set_random_seed(1701);
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.mutable_state()->set_phase(TEST);
+    Net<Dtype> net(param);
+    if (!fuse_proto.empty()) {
+      CHECK(google::protobuf::TextFormat::ParseFromString(fuse_proto,
+          &param));
+    }
+    for (int i = 0; i < net.layers().size(); ++i) {
+      const vector<shared_ptr<Blob<Dtype> > >& blobs = net.layers()[i]->blobs();
+      for (int j = 0; j < blobs.size(); ++j) {
+        // Positive, as variances, or the moving average factor.
+        if (blobs[j]->count() == 1) {
+          blobs[j]->mutable_cpu_data()[0] = 2;
+        } else {
+          caffe_rng_uniform<Dtype>(blobs[j]->count(), 0.5, 1.5,
+              blobs[j]->mutable_cpu_data());
+        }
+      }
+    }
+    Blob<Dtype>* input = net.input_blobs()[0];
+    caffe_rng_gaussian<Dtype>(input->count(), 0, 2, input->mutable_cpu_data());
+    net.Forward();
+    NetParameter weights;
+    net.ToProto(&weights);
+
+    NetParameter fused_param, fused_weights;
+    EXPECT_EQ(num_folded,
+        FuseLayers(param, weights, &fused_param, &fused_weights));
+    EXPECT_EQ(num_layers, fused_param.layer_size());
+    for (int i = 0; i < fused_param.layer_size(); ++i) {
+      const ConvolutionParameter& conv_param =
+          fused_param.layer(i).convolution_param();
+      if (conv_param.activation() != ConvolutionParameter_Activation_NONE) {
+        EXPECT_EQ(ConvolutionParameter_Engine_DEFAULT, conv_param.engine());
+      }
+    }
+    Net<Dtype> fused_net(fused_param);
+    fused_net.CopyTrainedLayersFrom(fused_weights);
+    CheckOutputs(&net, &fused_net);
+
+    // The same fusion when loading the net from its files.
+    string param_file, weights_file;
+    MakeTempFilename(&param_file);
+    MakeTempFilename(&weights_file);
+    WriteProtoToTextFile(param, param_file);
+    WriteProtoToBinaryFile(weights, weights_file);
+    shared_ptr<Net<Dtype> > loaded_net =
+        LoadFusedNet<Dtype>(param_file, weights_file);
+    EXPECT_EQ(fused_net.layers().size(), loaded_net->layers().size());
+    CheckOutputs(&net, loaded_net.get());
+  }
+
+  // Checks that fused_net computes the outputs net computed, from the same
+  // input.
+  void CheckOutputs(Net<Dtype>* net, Net<Dtype>* fused_net) {
+    const Blob<Dtype>* input = net->input_blobs()[0];
+    caffe_copy(input->count(), input->cpu_data(),
+        fused_net->input_blobs()[0]->mutable_cpu_data());
+    fused_net->Forward();
+    ASSERT_EQ(net->num_outputs(), fused_net->num_outputs());
+    for (int i = 0; i < net->num_outputs(); ++i) {
+      const Blob<Dtype>* output = net->output_blobs()[i];
+      const Blob<Dtype>* fused_output = fused_net->output_blobs()[i];
+      ASSERT_EQ(output->shape(), fused_output->shape());
+      for (int j = 0; j < output->count(); ++j) {
+        const Dtype expected = output->cpu_data()[j];
+        EXPECT_NEAR(expected, fused_output->cpu_data()[j],
+            1e-4 * std::max<Dtype>(1, std::fabs(expected)));
+      }
+    }
+  }
+};
+
+TYPED_TEST_CASE(FuseLayersTest, TestDtypesAndDevices);
+
+TYPED_TEST(FuseLayersTest, TestInPlace) {
+  this->CheckFuse(
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 5 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 pad: 1 "
+      "    bias_term: false } } "
+      "layer { name: 'bn' type: 'BatchNorm' bottom: 'conv' top: 'conv' } "
+      "layer { name: 'scale' type: 'Scale' bottom: 'conv' top: 'conv' "
+      "  scale_param { bias_term: true } } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' "
+      "  relu_param { negative_slope: 0.1 } } ", 3, 2);
+}
+
+TYPED_TEST(FuseLayersTest, TestNotInPlace) {
+  this->CheckFuse(
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 5 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 6 kernel_size: 3 group: 3 } } "
+      "layer { name: 'bn' type: 'BatchNormScale' bottom: 'conv' top: 'conv' } "
+      "layer { name: 'bias' type: 'Bias' bottom: 'conv' top: 'bias' } "
+      "layer { name: 'relu6' type: 'ReLU6' bottom: 'bias' top: 'relu6' } "
+      "layer { name: 'pool' type: 'Pooling' bottom: 'relu6' top: 'pool' "
+      "  pooling_param { pool: MAX kernel_size: 2 } } ", 3, 3);
+}
+
+TYPED_TEST(FuseLayersTest, TestCuDNNEngine) {
+  // The fused conv must not keep the CUDNN engine, which would drop the
+  // ReLU. The reference net uses the CAFFE engine, available in every build.
+  const string conv =
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 5 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 engine: ";
+  const string layers = " } } "
+      "layer { name: 'bn' type: 'BatchNorm' bottom: 'conv' top: 'conv' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' } ";
+  this->CheckFuse(conv + "CAFFE" + layers, 2, 2, conv + "CUDNN" + layers);
+}
+
+TYPED_TEST(FuseLayersTest, TestSharedOutput) {
+  // conv is also read by relu, so bn cannot be folded; relu2 reads the
+  // output of bn, not of conv.
+  this->CheckFuse(
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 5 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 1 } } "
+      "layer { name: 'bn' type: 'BatchNorm' bottom: 'conv' top: 'bn' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'relu' } "
+      "layer { name: 'relu2' type: 'ReLU' bottom: 'bn' top: 'bn' } ", 0, 5);
+}
+
+}  // namespace caffe
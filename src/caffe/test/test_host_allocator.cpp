@@ -0,0 +1,141 @@
+#include <boost/thread.hpp>
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_allocator.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostAllocatorTest : public ::testing::Test {};
+
+TEST_F(HostAllocatorTest, TestBlockSize) {
+  EXPECT_EQ(64, PoolingHostAllocator::BlockSize(0));
+  EXPECT_EQ(64, PoolingHostAllocator::BlockSize(64));
+  EXPECT_EQ(128, PoolingHostAllocator::BlockSize(65));
+  EXPECT_EQ(192, PoolingHostAllocator::BlockSize(129));
+  EXPECT_EQ(320, PoolingHostAllocator::BlockSize(257));
+  EXPECT_EQ(1280, PoolingHostAllocator::BlockSize(1025));
+  EXPECT_EQ(4096, PoolingHostAllocator::BlockSize(4096));
+  for (size_t size = 1; size < (1 << 20); size = size * 3 / 2 + 1) {
+    const size_t block_size = PoolingHostAllocator::BlockSize(size);
+    EXPECT_GE(block_size, size);
+    EXPECT_EQ(0, block_size % 64);
+    EXPECT_LE(block_size, std::max<size_t>(64, size + size / 4 + 64));
+    EXPECT_EQ(block_size, PoolingHostAllocator::BlockSize(block_size));
+  }
+}
+
+TEST_F(HostAllocatorTest, TestReuse) {
+  PoolingHostAllocator allocator;
+  void* ptr = allocator.Allocate(1000);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(ptr) % 64);
+  allocator.Free(ptr, 1000);
+  // Any size of the same class reuses the block.
+  EXPECT_EQ(ptr, allocator.Allocate(1020));
+  HostAllocatorStats stats = allocator.stats();
+  EXPECT_EQ(2, stats.allocations);
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(1024, stats.current_bytes);
+  EXPECT_EQ(0, stats.cached_bytes);
+  void* other = allocator.Allocate(1000);
+  EXPECT_NE(ptr, other);
+  stats = allocator.stats();
+  EXPECT_EQ(2048, stats.current_bytes);
+  EXPECT_EQ(2048, stats.peak_bytes);
+  allocator.Free(ptr, 1020);
+  allocator.Free(other, 1000);
+  stats = allocator.stats();
+  EXPECT_EQ(0, stats.current_bytes);
+  EXPECT_EQ(2048, stats.peak_bytes);
+  EXPECT_EQ(2048, stats.cached_bytes);
+  allocator.Trim();
+  EXPECT_EQ(0, allocator.stats().cached_bytes);
+}
+
+TEST_F(HostAllocatorTest, TestLimits) {
+  PoolingHostAllocator allocator(4096, 1024);
+  // Too large to be cached.
+  void* ptr = allocator.Allocate(2000);
+  allocator.Free(ptr, 2000);
+  EXPECT_EQ(0, allocator.stats().cached_bytes);
+  // Past the thread cache, the pool takes 4096 bytes.
+  vector<void*> ptrs;
+  for (int i = 0; i < 10; ++i) {
+    ptrs.push_back(allocator.Allocate(1024));
+  }
+  for (int i = 0; i < ptrs.size(); ++i) {
+    allocator.Free(ptrs[i], 1024);
+  }
+  // The thread cache keeps 4 blocks.
+  EXPECT_EQ(8 * 1024, allocator.stats().cached_bytes);
+}
+
+// Allocates and frees blocks of a few sizes, checking that no block is
+// handed out twice.
+static void AllocateAndFree(PoolingHostAllocator* allocator, int seed) {
+  vector<std::pair<int*, size_t> > blocks;
+  for (int i = 0; i < 2000; ++i) {
+    const size_t size = 16 << ((i + seed) % 8);
+    int* ptr = static_cast<int*>(allocator->Allocate(size));
+    for (int j = 0; j < size / sizeof(int); ++j) {
+      ptr[j] = seed;
+    }
+    blocks.push_back(std::make_pair(ptr, size));
+    if (i % 3 == 2 || i == 1999) {
+      for (int k = 0; k < blocks.size(); ++k) {
+        for (int j = 0; j < blocks[k].second / sizeof(int); ++j) {
+          EXPECT_EQ(seed, blocks[k].first[j]);
+        }
+        allocator->Free(blocks[k].first, blocks[k].second);
+      }
+      blocks.clear();
+    }
+  }
+}
+
+TEST_F(HostAllocatorTest, TestThreads) {
+  PoolingHostAllocator allocator;
+  boost::thread_group threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.create_thread(boost::bind(&AllocateAndFree, &allocator, i));
+  }
+  threads.join_all();
+  const HostAllocatorStats stats = allocator.stats();
+  EXPECT_EQ(0, stats.current_bytes);
+  EXPECT_EQ(8 * 2000, stats.allocations);
+  EXPECT_GT(stats.hits, 0);
+  // The blocks of the exited threads went back to the pool.
+  allocator.Trim();
+  EXPECT_EQ(0, allocator.stats().cached_bytes);
+}
+
+TEST_F(HostAllocatorTest, TestSyncedMemory) {
+  shared_ptr<PoolingHostAllocator> allocator(new PoolingHostAllocator());
+  SyncedMemory* before = new SyncedMemory(100);
+  before->mutable_cpu_data();
+  SetHostAllocator(allocator);
+  const void* ptr;
+  {
+    SyncedMemory mem(100);
+    ptr = mem.cpu_data();
+    EXPECT_EQ(128, allocator->stats().current_bytes);
+  }
+  SyncedMemory mem(120);
+  EXPECT_EQ(ptr, mem.cpu_data());
+  EXPECT_EQ(1, allocator->stats().hits);
+  SetHostAllocator(shared_ptr<HostAllocator>());
+  // Memory is freed by the allocator it came from.
+  delete before;
+  EXPECT_EQ(128, allocator->stats().current_bytes);
+}
+
+}  // namespace caffe
@@ -92,6 +92,81 @@ TEST_F(ImTransformsTest, TestApplyResize) {
   CHECK_EQ(out_img.cols, 30);
   CHECK_EQ(out_img.rows, 30);
 }
+
+// A 20x30 BGR image with a different color in every pixel.
+static cv::Mat MakeColorImage() {
+  cv::Mat img(20, 30, CV_8UC3);
+  for (int h = 0; h < img.rows; ++h) {
+    for (int w = 0; w < img.cols; ++w) {
+      img.at<cv::Vec3b>(h, w) = cv::Vec3b(8 * w, 12 * h, 255 - 4 * w);
+    }
+  }
+  return img;
+}
+
+static bool SameImage(const cv::Mat& a, const cv::Mat& b) {
+  return a.size() == b.size() && a.type() == b.type() &&
+      cv::countNonZero(a.reshape(1) != b.reshape(1)) == 0;
+}
+
+TEST_F(ImTransformsTest, TestApplyDistortContrast) {
+  const cv::Mat in_img = MakeColorImage();
+  DistortionParameter param;
+  param.set_contrast_prob(1);
+  param.set_contrast_lower(1.5);
+  param.set_contrast_upper(1.5);
+  cv::Mat expected;
+  AdjustContrast(in_img, 1.5, &expected);
+  EXPECT_TRUE(SameImage(expected, ApplyDistort(in_img, param)));
+}
+
+TEST_F(ImTransformsTest, TestApplyDistortSaturation) {
+  const cv::Mat in_img = MakeColorImage();
+  DistortionParameter param;
+  param.set_saturation_prob(1);
+  param.set_saturation_lower(0.5);
+  param.set_saturation_upper(0.5);
+  cv::Mat expected;
+  AdjustSaturation(in_img, 0.5, &expected);
+  EXPECT_TRUE(SameImage(expected, ApplyDistort(in_img, param)));
+}
+
+TEST_F(ImTransformsTest, TestApplyDistortUnusedBounds) {
+  const cv::Mat in_img = MakeColorImage();
+  // Invalid bounds of distortions that are never drawn are ignored.
+  DistortionParameter param;
+  param.set_brightness_delta(-32);
+  param.set_contrast_lower(1.5);
+  param.set_saturation_lower(0.5);
+  param.set_hue_delta(-18);
+  EXPECT_TRUE(SameImage(in_img, ApplyDistort(in_img, param)));
+}
+
+TEST_F(ImTransformsTest, TestApplyDistortReuseBuffer) {
+  const cv::Mat in_img = MakeColorImage();
+  const cv::Mat in_copy = in_img.clone();
+  DistortionParameter param;
+  param.set_random_order_prob(1);
+  cv::Mat out_img;
+  ApplyDistort(in_img, param, &out_img);
+  const uchar* buffer = out_img.data;
+  EXPECT_NE(in_img.data, buffer);
+  // The channels are shuffled, but every channel is kept.
+  vector<cv::Mat> in_channels, out_channels;
+  cv::split(in_img, in_channels);
+  cv::split(out_img, out_channels);
+  for (int c = 0; c < 3; ++c) {
+    EXPECT_TRUE(SameImage(out_channels[c], in_channels[0]) ||
+        SameImage(out_channels[c], in_channels[1]) ||
+        SameImage(out_channels[c], in_channels[2]));
+  }
+  // Nothing to do copies the input into the same buffer.
+  param.set_random_order_prob(0);
+  ApplyDistort(in_img, param, &out_img);
+  EXPECT_EQ(buffer, out_img.data);
+  EXPECT_TRUE(SameImage(in_img, out_img));
+  EXPECT_TRUE(SameImage(in_copy, in_img));
+}
 #endif  // USE_OPENCV
 
 }  // namespace caffe
@@ -0,0 +1,64 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class DecodedImageCacheTest : public ::testing::Test {
+ protected:
+  // A 10x10 3-channel image, i.e. 300 bytes, filled with value
+  static cv::Mat MakeImage(int value) {
+    return cv::Mat(10, 10, CV_8UC3, cv::Scalar(value, value, value));
+  }
+};
+
+TEST_F(DecodedImageCacheTest, TestGetPut) {
+  DecodedImageCache cache(1000);
+  cv::Mat img;
+  EXPECT_FALSE(cache.Get("a", &img));
+  cache.Put("a", MakeImage(1));
+  EXPECT_TRUE(cache.Get("a", &img));
+  EXPECT_EQ(1, img.at<cv::Vec3b>(5, 5)[0]);
+  EXPECT_EQ(1, cache.size());
+  EXPECT_EQ(300, cache.bytes());
+  EXPECT_EQ(1, cache.hits());
+  EXPECT_EQ(1, cache.misses());
+}
+
+TEST_F(DecodedImageCacheTest, TestEvictLeastRecentlyUsed) {
+  DecodedImageCache cache(700);
+  cv::Mat img;
+  cache.Put("a", MakeImage(1));
+  cache.Put("b", MakeImage(2));
+  // Touch "a", so that "b" is the least recently used image
+  EXPECT_TRUE(cache.Get("a", &img));
+  cache.Put("c", MakeImage(3));
+  EXPECT_FALSE(cache.Get("b", &img));
+  EXPECT_TRUE(cache.Get("a", &img));
+  EXPECT_TRUE(cache.Get("c", &img));
+  EXPECT_EQ(3, img.at<cv::Vec3b>(0, 0)[0]);
+  EXPECT_EQ(600, cache.bytes());
+}
+
+TEST_F(DecodedImageCacheTest, TestReplaceAndOversize) {
+  DecodedImageCache cache(500);
+  cv::Mat img;
+  cache.Put("a", MakeImage(1));
+  cache.Put("a", MakeImage(4));
+  EXPECT_EQ(1, cache.size());
+  EXPECT_TRUE(cache.Get("a", &img));
+  EXPECT_EQ(4, img.at<cv::Vec3b>(0, 0)[0]);
+  // An image larger than the whole budget is not cached
+  cache.Put("big", cv::Mat(20, 20, CV_8UC3, cv::Scalar(0, 0, 0)));
+  EXPECT_FALSE(cache.Get("big", &img));
+  EXPECT_EQ(300, cache.bytes());
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -493,5 +493,59 @@ TEST_F(IOTest, TestDecodeDatumToCVMatContentNative) {
   }
 }
 
+TEST_F(IOTest, TestGetJPEGReducedScale) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  Datum datum;
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum));
+  // cat.jpg is 360x480
+  EXPECT_EQ(8, GetJPEGReducedScale(datum.data(), 45, 60, true));
+  EXPECT_EQ(4, GetJPEGReducedScale(datum.data(), 46, 60, true));
+  EXPECT_EQ(2, GetJPEGReducedScale(datum.data(), 100, 100, false));
+  EXPECT_EQ(1, GetJPEGReducedScale(datum.data(), 200, 100, false));
+  EXPECT_EQ(1, GetJPEGReducedScale(datum.data(), 0, 0, false));
+  EXPECT_EQ(1, GetJPEGReducedScale("not a jpeg", 1, 1, false));
+}
+
+TEST_F(IOTest, TestGetJPEGReducedScaleExact) {
+  // SOI followed by a baseline frame header of a 100x120 color image
+  const unsigned char header[] = {0xFF, 0xD8, 0xFF, 0xC0, 0x00, 0x11, 0x08,
+      0x00, 0x64, 0x00, 0x78, 0x03};
+  string data(reinterpret_cast<const char*>(header), sizeof(header));
+  data.resize(data.size() + 9, '\0');
+  EXPECT_EQ(8, GetJPEGReducedScale(data, 10, 10, false));
+  // 100 is not a multiple of 8
+  EXPECT_EQ(4, GetJPEGReducedScale(data, 10, 10, true));
+}
+
+TEST_F(IOTest, TestDecodeDatumToCVMatReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  Datum datum;
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum));
+  cv::Mat cv_img = DecodeDatumToCVMat(datum, true, 4);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 90);
+  EXPECT_EQ(cv_img.cols, 120);
+  cv_img = DecodeDatumToCVMat(datum, false, 2);
+  EXPECT_EQ(cv_img.channels(), 1);
+  EXPECT_EQ(cv_img.rows, 180);
+  EXPECT_EQ(cv_img.cols, 240);
+  cv_img = DecodeDatumToCVMatNative(datum, 8);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 45);
+  EXPECT_EQ(cv_img.cols, 60);
+}
+
+TEST_F(IOTest, TestReadImageToCVMatReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  cv::Mat cv_img = ReadImageToCVMatReduced(filename, 100, 200, true);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 100);
+  EXPECT_EQ(cv_img.cols, 200);
+  cv_img = ReadImageToCVMatReduced(filename, 0, 0, false);
+  EXPECT_EQ(cv_img.channels(), 1);
+  EXPECT_EQ(cv_img.rows, 360);
+  EXPECT_EQ(cv_img.cols, 480);
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -9,6 +9,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/sgd_solvers.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -629,6 +630,89 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitPlannedNet(const bool plan_memory) {
+    const string& proto =
+        "name: 'PlannedNetwork' "
+        "state: { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 4 dim: 5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'innerproduct1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 128 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'innerproduct1' "
+        "  top: 'innerproduct1' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 128 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "  bottom: 'innerproduct1' "
+        "  top: 'innerproduct2' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct3' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 128 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "  bottom: 'innerproduct2' "
+        "  top: 'innerproduct3' "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'innerproduct1' "
+        "  bottom: 'innerproduct3' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct4' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "  bottom: 'sum' "
+        "  top: 'innerproduct4' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.set_plan_memory(plan_memory);
+    net_.reset(new Net<Dtype>(param));
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -1423,6 +1507,60 @@ TYPED_TEST(NetTest, TestParamPropagateDown) {
   }
 }
 
+TYPED_TEST(NetTest, TestParamsNeedDiff) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kBiasTerm = true;
+  const Dtype* kLossWeight1 = NULL;
+  const Dtype* kLossWeight2 = NULL;
+  // Freeze the bias of the first layer and the weights of the second.
+  const Dtype blobs_lr_w1 = 1, blobs_lr_b1 = 0, blobs_lr_w2 = 0,
+      blobs_lr_b2 = 1;
+  for (int force_backward = 0; force_backward < 2; ++force_backward) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitUnsharedWeightsNet(kLossWeight1, kLossWeight2, force_backward,
+        kBiasTerm, blobs_lr_w1, blobs_lr_b1, blobs_lr_w2, blobs_lr_b2);
+    const vector<bool>& params_need_diff = this->net_->params_need_diff();
+    const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+    ASSERT_EQ(4, params.size());
+    ASSERT_EQ(4, params_need_diff.size());
+    vector<shared_ptr<Blob<Dtype> > > params_before;
+    this->CopyNetParams(false, &params_before);
+    this->net_->ClearParamDiffs();
+    this->net_->ForwardBackward();
+    this->net_->Update();
+    for (int i = 0; i < params.size(); ++i) {
+      // Forced backward computes the gradients of frozen params too.
+      const bool frozen = (i == 1 || i == 2) && !force_backward;
+      EXPECT_EQ(!frozen, params_need_diff[i]);
+      if (frozen) {
+        EXPECT_EQ(SyncedMemory::UNINITIALIZED, params[i]->diff()->head());
+        for (int j = 0; j < params[i]->count(); ++j) {
+          EXPECT_EQ(params_before[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+        }
+      }
+    }
+    // Neither does a solver step with gradient clipping and debug info.
+    SolverParameter solver_param;
+    this->net_->ToProto(solver_param.mutable_net_param());
+    solver_param.mutable_net_param()->set_force_backward(force_backward);
+    solver_param.set_base_lr(0.01);
+    solver_param.set_lr_policy("fixed");
+    solver_param.set_momentum(0.9);
+    solver_param.set_clip_gradients(1e-3);
+    solver_param.set_display(1);
+    solver_param.set_debug_info(true);
+    SGDSolver<Dtype> solver(solver_param);
+    solver.Step(1);
+    const vector<Blob<Dtype>*>& solver_params =
+        solver.net()->learnable_params();
+    for (int i = 0; i < solver_params.size(); ++i) {
+      const bool frozen = (i == 1 || i == 2) && !force_backward;
+      EXPECT_EQ(frozen,
+          solver_params[i]->diff()->head() == SyncedMemory::UNINITIALIZED);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestFromTo) {
   typedef typename TypeParam::Dtype Dtype;
   this->InitTinyNet();
@@ -2446,6 +2584,50 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestPlanMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(Caffe::CPU);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> blob1(2, 3, 4, 5);
+  Blob<Dtype> blob2(4, 3, 4, 5);
+  filler.Fill(&blob1);
+  filler.Fill(&blob2);
+  Caffe::set_random_seed(this->seed_);
+  this->InitPlannedNet(false);
+  shared_ptr<Net<Dtype> > reference_net = this->net_;
+  EXPECT_EQ(0, reference_net->planned_memory_used());
+  Caffe::set_random_seed(this->seed_);
+  this->InitPlannedNet(true);
+  vector<shared_ptr<Net<Dtype> > > nets;
+  nets.push_back(reference_net);
+  nets.push_back(this->net_);
+  for (int i = 0; i < 2; ++i) {
+    Blob<Dtype>* blob = i == 0 ? &blob1 : &blob2;
+    for (int j = 0; j < nets.size(); ++j) {
+      Blob<Dtype>* input_blob = nets[j]->input_blobs()[0];
+      input_blob->ReshapeLike(*blob);
+      nets[j]->Reshape();
+      caffe_copy(blob->count(), blob->cpu_data(),
+          input_blob->mutable_cpu_data());
+      // The memory is planned after the first forward.
+      nets[j]->Forward();
+      nets[j]->Forward();
+    }
+    // innerproduct1, shared with its split tops, is live until sum, and
+    // innerproduct2 and sum are never live together.
+    EXPECT_EQ(3 * blob->num() * 128 * sizeof(Dtype),
+        this->net_->planned_memory_used());
+    const Blob<Dtype>* expected = reference_net->output_blobs()[0];
+    const Blob<Dtype>* output = this->net_->output_blobs()[0];
+    ASSERT_EQ(expected->count(), output->count());
+    for (int k = 0; k < expected->count(); ++k) {
+      EXPECT_EQ(expected->cpu_data()[k], output->cpu_data()[k]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/nms_grid.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class NMSGridTest : public ::testing::Test {
+ protected:
+  NMSGridTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // Fills boxes with num small random boxes in [0, scale], some of them
+  // invalid, i.e. with xmax < xmin.
+  void FillBoxes(const int num, const float scale) {
+    boxes_.resize(num);
+    for (int i = 0; i < num; ++i) {
+      float coords[4];
+      caffe_rng_uniform(2, 0.f, scale, coords);
+      caffe_rng_uniform(2, -0.01f * scale, 0.1f * scale, coords + 2);
+      BBox& box = boxes_[i];
+      box.xmin = coords[0];
+      box.ymin = coords[1];
+      box.xmax = coords[0] + coords[2];
+      box.ymax = coords[1] + coords[3];
+      box.label = 0;
+      box.score = 0;
+      box.size = -1;
+    }
+  }
+
+  // Checks that Query() returns every inserted box whose span, widened by
+  // margin, intersects the span of the queried box.
+  void CheckQuery(const float margin) {
+    NMSGrid grid;
+    grid.Reset(boxes_, boxes_.size(), margin);
+    EXPECT_GT(grid.side(), 1);
+    const int num_kept = boxes_.size() / 2;
+    for (int i = 0; i < num_kept; ++i) {
+      grid.Insert(boxes_[i], i);
+    }
+    vector<int> indices;
+    for (int i = num_kept; i < boxes_.size(); ++i) {
+      grid.Query(boxes_[i], &indices);
+      vector<int> sorted(indices);
+      std::sort(sorted.begin(), sorted.end());
+      EXPECT_TRUE(std::unique(sorted.begin(), sorted.end()) == sorted.end());
+      EXPECT_LT(indices.size(), num_kept);
+      const BBox& box = boxes_[i];
+      for (int j = 0; j < num_kept; ++j) {
+        const BBox& kept = boxes_[j];
+        const bool overlap =
+            std::min(box.xmin, box.xmax) - margin <=
+                std::max(kept.xmin, kept.xmax) &&
+            std::max(box.xmin, box.xmax) + margin >=
+                std::min(kept.xmin, kept.xmax) &&
+            std::min(box.ymin, box.ymax) - margin <=
+                std::max(kept.ymin, kept.ymax) &&
+            std::max(box.ymin, box.ymax) + margin >=
+                std::min(kept.ymin, kept.ymax);
+        if (overlap) {
+          EXPECT_TRUE(std::binary_search(sorted.begin(), sorted.end(), j))
+              << "box " << i << " misses kept box " << j;
+        }
+      }
+    }
+  }
+
+  vector<BBox> boxes_;
+};
+
+TEST_F(NMSGridTest, TestQueryNormalized) {
+  FillBoxes(2000, 1);
+  CheckQuery(0);
+}
+
+TEST_F(NMSGridTest, TestQueryPixels) {
+  FillBoxes(2000, 512);
+  CheckQuery(1);
+}
+
+TEST_F(NMSGridTest, TestSingleCell) {
+  FillBoxes(100, 1);
+  NMSGrid grid;
+  grid.Reset(boxes_, 0);
+  EXPECT_EQ(1, grid.side());
+  for (int i = 0; i < 10; ++i) {
+    grid.Insert(boxes_[i], i);
+  }
+  vector<int> indices;
+  grid.Query(boxes_[50], &indices);
+  ASSERT_EQ(10, indices.size());
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(i, indices[i]);
+  }
+}
+
+TEST_F(NMSGridTest, TestNonFinite) {
+  FillBoxes(2000, 1);
+  boxes_[3].xmax = std::numeric_limits<float>::quiet_NaN();
+  boxes_[1500].ymin = -std::numeric_limits<float>::infinity();
+  NMSGrid grid;
+  grid.Reset(boxes_, boxes_.size());
+  EXPECT_GT(grid.side(), 1);
+  for (int i = 0; i < 1000; ++i) {
+    grid.Insert(boxes_[i], i);
+  }
+  vector<int> indices;
+  // A non-finite kept box is returned for every query ...
+  grid.Query(boxes_[1001], &indices);
+  EXPECT_TRUE(std::find(indices.begin(), indices.end(), 3) != indices.end());
+  // ... and a non-finite query returns every kept box.
+  grid.Query(boxes_[1500], &indices);
+  EXPECT_EQ(1000, indices.size());
+}
+
+}  // namespace caffe
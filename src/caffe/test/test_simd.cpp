@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/simd.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class HWCToCHWTest : public ::testing::Test {
+ protected:
+  HWCToCHWTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // Fills a height x width x channels image whose rows are padded to
+  // src_step bytes with random pixels.
+  void FillImage(const int height, const int src_step) {
+    image_.resize(height * src_step);
+    for (int i = 0; i < image_.size(); ++i) {
+      image_[i] = caffe_rng_rand() % 256;
+    }
+  }
+
+  void CheckLevel(const int height, const int width, const int channels,
+      const bool mirror, const bool subtract_mean, const SimdLevel level) {
+    const int src_step = width * channels + 5;
+    FillImage(height, src_step);
+    const Dtype mean[] = {104, 117, 123, 50};
+    const Dtype scale = 0.017;
+    const Dtype* mean_ptr = subtract_mean ? mean : NULL;
+    vector<Dtype> result(channels * height * width);
+    caffe_cpu_hwc_to_chw(height, width, channels, &image_[0], src_step,
+        mean_ptr, scale, mirror, &result[0], level);
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < height; ++h) {
+        for (int w = 0; w < width; ++w) {
+          const int src_w = mirror ? width - 1 - w : w;
+          const Dtype pixel = image_[h * src_step + src_w * channels + c];
+          const Dtype expected =
+              (pixel - (subtract_mean ? mean[c] : Dtype(0))) * scale;
+          ASSERT_FLOAT_EQ(expected, result[(c * height + h) * width + w])
+              << "c " << c << " h " << h << " w " << w << " width " << width
+              << " level " << level;
+        }
+      }
+    }
+  }
+
+  vector<uint8_t> image_;
+};
+
+TYPED_TEST_CASE(HWCToCHWTest, TestDtypes);
+
+TYPED_TEST(HWCToCHWTest, TestConvert) {
+  const int widths[] = {1, 15, 16, 17, 37, 64};
+  const int channels[] = {1, 3, 4};
+  for (int level = SIMD_SCALAR; level <= caffe_cpu_simd_level(); ++level) {
+    for (int i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+      for (int j = 0; j < sizeof(channels) / sizeof(channels[0]); ++j) {
+        for (int flags = 0; flags < 4; ++flags) {
+          this->CheckLevel(3, widths[i], channels[j], flags & 1, flags & 2,
+              static_cast<SimdLevel>(level));
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(HWCToCHWTest, DISABLED_TestBenchmark) {
+  // The input size of SSD300
+  const int height = 300;
+  const int width = 300;
+  const int channels = 3;
+  const int iterations = 100;
+  this->FillImage(height, width * channels);
+  const TypeParam mean[] = {104, 117, 123};
+  vector<TypeParam> result(channels * height * width);
+  for (int level = SIMD_SCALAR; level <= caffe_cpu_simd_level(); ++level) {
+    CPUTimer timer;
+    timer.Start();
+    for (int i = 0; i < iterations; ++i) {
+      caffe_cpu_hwc_to_chw(height, width, channels, &this->image_[0],
+          width * channels, mean, TypeParam(1), i % 2 == 0, &result[0],
+          static_cast<SimdLevel>(level));
+    }
+    timer.Stop();
+    LOG(INFO) << "HWC to CHW of a " << height << "x" << width << "x"
+        << channels << " image at SIMD level " << level << ": "
+        << timer.MicroSeconds() / iterations << " us per image";
+  }
+}
+
+TEST(JaccardOverlapTest, TestLevels) {
+  Caffe::set_random_seed(1701);
+  // Enough boxes for whole vectors and a remainder at every level.
+  const int n = 45;
+  vector<float> coords(4 * n);
+  caffe_rng_uniform(4 * n, 0.f, 1.f, &coords[0]);
+  vector<float> xmin(n), ymin(n), xmax(n), ymax(n), size(n);
+  for (int i = 0; i < n; ++i) {
+    xmin[i] = std::min(coords[4 * i], coords[4 * i + 2]);
+    ymin[i] = std::min(coords[4 * i + 1], coords[4 * i + 3]);
+    xmax[i] = std::max(coords[4 * i], coords[4 * i + 2]);
+    ymax[i] = std::max(coords[4 * i + 1], coords[4 * i + 3]);
+    size[i] = (xmax[i] - xmin[i]) * (ymax[i] - ymin[i]);
+  }
+  const float box[] = {0.2, 0.3, 0.7, 0.6};
+  const float box_size = (box[2] - box[0]) * (box[3] - box[1]);
+  vector<float> expected(n);
+  caffe_cpu_jaccard_overlap(n, &xmin[0], &ymin[0], &xmax[0], &ymax[0],
+      &size[0], box, box_size, &expected[0], SIMD_SCALAR);
+  int num_overlapped = 0;
+  for (int i = 0; i < n; ++i) {
+    EXPECT_GE(expected[i], 0);
+    EXPECT_LE(expected[i], 1);
+    num_overlapped += expected[i] > 0;
+  }
+  EXPECT_GT(num_overlapped, 0);
+  EXPECT_LT(num_overlapped, n);
+  for (int level = SIMD_SSE41; level <= caffe_cpu_simd_level(); ++level) {
+    vector<float> overlaps(n, -1);
+    caffe_cpu_jaccard_overlap(n, &xmin[0], &ymin[0], &xmax[0], &ymax[0],
+        &size[0], box, box_size, &overlaps[0], static_cast<SimdLevel>(level));
+    for (int i = 0; i < n; ++i) {
+      EXPECT_EQ(expected[i], overlaps[i]) << "box " << i << " level " << level;
+    }
+  }
+}
+
+template <typename Dtype>
+class HeatmapPeaksTest : public ::testing::Test {
+ protected:
+  HeatmapPeaksTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // Fills channels height x width maps with values in [0, 1), rounded to
+  // levels steps when levels > 0 to make plateaus.
+  void FillMaps(const int channels, const int height, const int width,
+      const int levels) {
+    maps_.resize(channels * height * width);
+    caffe_rng_uniform<Dtype>(maps_.size(), 0, 1, &maps_[0]);
+    if (levels > 0) {
+      for (int i = 0; i < maps_.size(); ++i) {
+        maps_[i] = std::floor(maps_[i] * levels) / levels;
+      }
+    }
+  }
+
+  // Peaks found by comparing every value with its neighbors.
+  void ReferencePeaks(const int channels, const int height, const int width,
+      const Dtype threshold, vector<int>* peaks) {
+    peaks->clear();
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < height; ++h) {
+        for (int w = 0; w < width; ++w) {
+          const int index = (c * height + h) * width + w;
+          bool peak = maps_[index] > threshold;
+          for (int dh = -1; dh <= 1; ++dh) {
+            for (int dw = -1; dw <= 1; ++dw) {
+              const int nh = h + dh;
+              const int nw = w + dw;
+              if (nh >= 0 && nh < height && nw >= 0 && nw < width) {
+                peak = peak &&
+                    maps_[(c * height + nh) * width + nw] <= maps_[index];
+              }
+            }
+          }
+          if (peak) {
+            peaks->push_back(index);
+          }
+        }
+      }
+    }
+  }
+
+  vector<Dtype> maps_;
+};
+
+TYPED_TEST_CASE(HeatmapPeaksTest, TestDtypes);
+
+TYPED_TEST(HeatmapPeaksTest, TestPeaks) {
+  const int heights[] = {1, 2, 5, 16};
+  const int widths[] = {1, 3, 8, 17, 37};
+  const int levels[] = {0, 4};
+  const TypeParam thresholds[] = {-1, 0.5};
+  vector<int> expected, peaks;
+  for (int i = 0; i < sizeof(heights) / sizeof(heights[0]); ++i) {
+    for (int j = 0; j < sizeof(widths) / sizeof(widths[0]); ++j) {
+      for (int l = 0; l < 2; ++l) {
+        this->FillMaps(2, heights[i], widths[j], levels[l]);
+        for (int t = 0; t < 2; ++t) {
+          this->ReferencePeaks(2, heights[i], widths[j], thresholds[t],
+              &expected);
+          for (int level = SIMD_SCALAR; level <= caffe_cpu_simd_level();
+               ++level) {
+            // Peaks are appended.
+            peaks.assign(1, -1);
+            caffe_cpu_heatmap_peaks(2, heights[i], widths[j],
+                &this->maps_[0], thresholds[t], &peaks,
+                static_cast<SimdLevel>(level));
+            ASSERT_EQ(expected.size() + 1, peaks.size())
+                << "height " << heights[i] << " width " << widths[j]
+                << " level " << level;
+            for (int k = 0; k < expected.size(); ++k) {
+              EXPECT_EQ(expected[k], peaks[k + 1]);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(HeatmapPeaksTest, DISABLED_TestBenchmark) {
+  // The output size of CenterNet for a 512x512 input, with 1, 2 and the 80
+  // COCO classes.
+  const int height = 128;
+  const int width = 128;
+  const int channels[] = {1, 2, 80};
+  const int iterations = 20;
+  vector<int> peaks;
+  for (int i = 0; i < sizeof(channels) / sizeof(channels[0]); ++i) {
+    this->FillMaps(channels[i], height, width, 0);
+    for (int level = SIMD_SCALAR; level <= caffe_cpu_simd_level(); ++level) {
+      CPUTimer timer;
+      timer.Start();
+      for (int j = 0; j < iterations; ++j) {
+        peaks.clear();
+        caffe_cpu_heatmap_peaks(channels[i], height, width, &this->maps_[0],
+            TypeParam(0.3), &peaks, static_cast<SimdLevel>(level));
+      }
+      timer.Stop();
+      LOG(INFO) << "Peaks of a " << height << "x" << width << "x"
+          << channels[i] << " heatmap at SIMD level " << level << ": "
+          << timer.MicroSeconds() / iterations << " us, " << peaks.size()
+          << " peaks";
+    }
+  }
+}
+
+template <typename Dtype>
+class DepthwiseConvTest : public ::testing::Test {
+ protected:
+  DepthwiseConvTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // Fills the input, weights and biases of a convolution of channels
+  // height x width maps with multiplier kernel_h x kernel_w filters each.
+  void Fill(const int channels, const int height, const int width,
+      const int multiplier, const int kernel_h, const int kernel_w) {
+    input_.resize(channels * height * width);
+    weight_.resize(channels * multiplier * kernel_h * kernel_w);
+    bias_.resize(channels * multiplier);
+    caffe_rng_gaussian<Dtype>(input_.size(), 0, 1, &input_[0]);
+    caffe_rng_gaussian<Dtype>(weight_.size(), 0, 1, &weight_[0]);
+    caffe_rng_gaussian<Dtype>(bias_.size(), 0, 1, &bias_[0]);
+  }
+
+  // Convolves with explicit loops over the outputs and the taps.
+  void ReferenceConv(const int channels, const int height, const int width,
+      const int multiplier, const int kernel_h, const int kernel_w,
+      const int pad, const int stride, const int dilation, const int output_h,
+      const int output_w, vector<Dtype>* output) {
+    output->resize(channels * multiplier * output_h * output_w);
+    for (int c = 0; c < channels * multiplier; ++c) {
+      for (int h = 0; h < output_h; ++h) {
+        for (int w = 0; w < output_w; ++w) {
+          Dtype sum = bias_[c];
+          for (int kh = 0; kh < kernel_h; ++kh) {
+            for (int kw = 0; kw < kernel_w; ++kw) {
+              const int ih = h * stride - pad + kh * dilation;
+              const int iw = w * stride - pad + kw * dilation;
+              if (ih >= 0 && ih < height && iw >= 0 && iw < width) {
+                sum += weight_[(c * kernel_h + kh) * kernel_w + kw] *
+                    input_[((c / multiplier) * height + ih) * width + iw];
+              }
+            }
+          }
+          (*output)[(c * output_h + h) * output_w + w] = sum;
+        }
+      }
+    }
+  }
+
+  vector<Dtype> input_;
+  vector<Dtype> weight_;
+  vector<Dtype> bias_;
+};
+
+TYPED_TEST_CASE(DepthwiseConvTest, TestDtypes);
+
+TYPED_TEST(DepthwiseConvTest, TestLevels) {
+  const int widths[] = {1, 6, 17, 40};
+  const int kernels[] = {1, 3, 5, 4};
+  const int strides[] = {1, 2, 3};
+  const int channels = 2;
+  const int height = 7;
+  vector<TypeParam> expected, output;
+  for (int i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+    for (int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+      for (int s = 0; s < sizeof(strides) / sizeof(strides[0]); ++s) {
+        for (int pad = 0; pad <= kernels[k] / 2; ++pad) {
+          for (int dilation = 1; dilation <= 2; ++dilation) {
+            const int multiplier = 1 + (pad + dilation) % 2;
+            const int extent = dilation * (kernels[k] - 1) + 1;
+            if (widths[i] + 2 * pad < extent || height + 2 * pad < extent) {
+              continue;
+            }
+            const int output_h = (height + 2 * pad - extent) / strides[s] + 1;
+            const int output_w =
+                (widths[i] + 2 * pad - extent) / strides[s] + 1;
+            this->Fill(channels, height, widths[i], multiplier, kernels[k],
+                kernels[k]);
+            this->ReferenceConv(channels, height, widths[i], multiplier,
+                kernels[k], kernels[k], pad, strides[s], dilation, output_h,
+                output_w, &expected);
+            for (int level = SIMD_SCALAR; level <= caffe_cpu_simd_level();
+                 ++level) {
+              output.assign(expected.size(), TypeParam(-1));
+              caffe_cpu_depthwise_conv(&this->input_[0], channels, height,
+                  widths[i], multiplier, kernels[k], kernels[k], pad, pad,
+                  strides[s], strides[s], dilation, dilation,
+                  &this->weight_[0], &this->bias_[0], &output[0],
+                  static_cast<SimdLevel>(level));
+              for (int j = 0; j < expected.size(); ++j) {
+                ASSERT_EQ(expected[j], output[j]) << "width " << widths[i]
+                    << " kernel " << kernels[k] << " stride " << strides[s]
+                    << " pad " << pad << " dilation " << dilation
+                    << " level " << level << " index " << j;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(DepthwiseConvTest, DISABLED_TestBenchmark) {
+  // Depthwise layers of MobileNetV2 for a 300x300 input.
+  const int channels[] = {96, 144, 192, 576};
+  const int sizes[] = {150, 75, 38, 19};
+  const int strides[] = {2, 1, 2, 1};
+  const int iterations = 10;
+  vector<TypeParam> output;
+  for (int i = 0; i < sizeof(channels) / sizeof(channels[0]); ++i) {
+    this->Fill(channels[i], sizes[i], sizes[i], 1, 3, 3);
+    output.resize(channels[i] * sizes[i] * sizes[i]);
+    for (int level = SIMD_SCALAR; level <= caffe_cpu_simd_level(); ++level) {
+      CPUTimer timer;
+      timer.Start();
+      for (int j = 0; j < iterations; ++j) {
+        caffe_cpu_depthwise_conv(&this->input_[0], channels[i], sizes[i],
+            sizes[i], 1, 3, 3, 1, 1, strides[i],
+            strides[i], 1, 1, &this->weight_[0], &this->bias_[0],
+            &output[0], static_cast<SimdLevel>(level));
+      }
+      timer.Stop();
+      LOG(INFO) << "3x3 depthwise convolution of a " << sizes[i] << "x"
+          << sizes[i] << "x" << channels[i] << " input with stride "
+          << strides[i] << " at SIMD level " << level << ": "
+          << timer.MicroSeconds() / iterations << " us";
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,101 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/spsc_queue.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Queue>
+void PushRange(Queue* queue, int count) {
+  for (int i = 0; i < count; ++i) {
+    queue->push(i);
+  }
+}
+
+// Sends count items from a producer thread to the calling thread, checking
+// their order, and returns the elapsed time in milliseconds.
+template <typename Queue>
+float TransferRange(Queue* queue, int count) {
+  CPUTimer timer;
+  timer.Start();
+  boost::thread producer(boost::bind(&PushRange<Queue>, queue, count));
+  int mismatches = 0;
+  for (int i = 0; i < count; ++i) {
+    mismatches += (queue->pop() != i);
+  }
+  producer.join();
+  timer.Stop();
+  EXPECT_EQ(0, mismatches);
+  return timer.MilliSeconds();
+}
+
+class SPSCQueueTest : public ::testing::Test {};
+
+TEST_F(SPSCQueueTest, TestPushPop) {
+  SPSCQueue<int> queue(4);
+  EXPECT_EQ(4, queue.capacity());
+  int t;
+  EXPECT_FALSE(queue.try_pop(&t));
+  EXPECT_FALSE(queue.try_peek(&t));
+  for (int i = 0; i < 4; ++i) {
+    queue.push(i);
+  }
+  EXPECT_EQ(4, queue.size());
+  EXPECT_EQ(0, queue.peek());
+  EXPECT_TRUE(queue.try_peek(&t));
+  EXPECT_EQ(0, t);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(i, queue.pop());
+  }
+  EXPECT_EQ(0, queue.size());
+  EXPECT_FALSE(queue.try_pop(&t));
+}
+
+TEST_F(SPSCQueueTest, TestWrapAround) {
+  SPSCQueue<int> queue(3);
+  for (int i = 0; i < 20; ++i) {
+    queue.push(2 * i);
+    queue.push(2 * i + 1);
+    int t;
+    EXPECT_TRUE(queue.try_pop(&t));
+    EXPECT_EQ(2 * i, t);
+    EXPECT_EQ(2 * i + 1, queue.pop());
+  }
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST_F(SPSCQueueTest, TestProducerConsumer) {
+  // A small capacity makes both sides wait for each other
+  SPSCQueue<int> queue(2);
+  TransferRange(&queue, 100000);
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST_F(SPSCQueueTest, TestInterruptPop) {
+  SPSCQueue<int> queue(1);
+  boost::thread consumer(boost::bind(&SPSCQueue<int>::pop, &queue, ""));
+  consumer.interrupt();
+  consumer.join();
+  queue.push(1);
+  EXPECT_EQ(1, queue.pop());
+}
+
+TEST_F(SPSCQueueTest, DISABLED_TestBenchmark) {
+  const int count = 1000000;
+  const int capacity = 16;
+  SPSCQueue<int> spsc_queue(capacity);
+  BlockingQueue<int> blocking_queue;
+  const float spsc_ms = TransferRange(&spsc_queue, count);
+  const float blocking_ms = TransferRange(&blocking_queue, count);
+  LOG(INFO) << "Transferred " << count << " items: SPSCQueue(" << capacity
+      << ") " << spsc_ms << " ms, BlockingQueue " << blocking_ms << " ms";
+}
+
+}  // namespace caffe
@@ -0,0 +1,64 @@
+#include <boost/thread.hpp>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/stage_stats.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class StageStatsTest : public ::testing::Test {
+ protected:
+  static void Sleep(int milliseconds) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(milliseconds));
+  }
+};
+
+TEST_F(StageStatsTest, TestAddReset) {
+  StageStats stats;
+  EXPECT_EQ("", stats.ToString());
+  stats.Add(StageStats::READ, 3000);
+  stats.Add(StageStats::READ, 1000);
+  stats.Add(StageStats::QUEUE_WAIT, 500);
+  stats.AddBatch();
+  stats.AddBatch();
+  EXPECT_EQ(2, stats.batches());
+  EXPECT_DOUBLE_EQ(4, stats.total_ms(StageStats::READ));
+  EXPECT_DOUBLE_EQ(0, stats.total_ms(StageStats::DECODE));
+  EXPECT_EQ("read 2 ms, queue wait 0.25 ms", stats.ToString());
+  stats.Reset();
+  EXPECT_EQ(0, stats.batches());
+  EXPECT_DOUBLE_EQ(0, stats.total_ms(StageStats::READ));
+}
+
+TEST_F(StageStatsTest, TestNestedTimers) {
+  StageStats stats;
+  {
+    StageTimer crop(&stats, StageStats::CROP);
+    Sleep(20);
+    {
+      StageTimer decode(&stats, StageStats::DECODE);
+      Sleep(40);
+    }
+  }
+  // The decode is not counted as part of the crop
+  EXPECT_GE(stats.total_ms(StageStats::DECODE), 35);
+  EXPECT_GE(stats.total_ms(StageStats::CROP), 15);
+  EXPECT_LT(stats.total_ms(StageStats::CROP), 35);
+}
+
+TEST_F(StageStatsTest, TestNullStats) {
+  StageStats stats;
+  {
+    StageTimer outer(&stats, StageStats::TRANSFORM);
+    StageTimer inner(NULL, StageStats::DECODE);
+    Sleep(5);
+  }
+  EXPECT_DOUBLE_EQ(0, stats.total_ms(StageStats::DECODE));
+  EXPECT_GT(stats.total_ms(StageStats::TRANSFORM), 0);
+}
+
+}  // namespace caffe
@@ -0,0 +1,84 @@
+#include <boost/bind.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {
+ protected:
+  void Record(int index, int worker_id) {
+    visits_[index] += 1;
+    workers_[index] = worker_id;
+    draws_[index] = caffe_rng_rand();
+  }
+
+  void RunPool(ThreadPool* pool, int count) {
+    visits_.assign(count, 0);
+    workers_.assign(count, -1);
+    draws_.assign(count, 0);
+    pool->Run(count, boost::bind(&ThreadPoolTest::Record, this, _1, _2));
+  }
+
+  void RunPool(int num_threads, int count) {
+    ThreadPool pool(num_threads);
+    EXPECT_EQ(num_threads, pool.num_threads());
+    RunPool(&pool, count);
+  }
+
+  vector<int> visits_;
+  vector<int> workers_;
+  vector<unsigned int> draws_;
+};
+
+TEST_F(ThreadPoolTest, TestVisitsEachIndexOnce) {
+  const int count = 37;
+  RunPool(4, count);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(1, visits_[i]);
+    EXPECT_EQ(i % 4, workers_[i]);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestFewerIndicesThanThreads) {
+  RunPool(8, 3);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(1, visits_[i]);
+    EXPECT_EQ(i, workers_[i]);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestRunsRepeatedly) {
+  const int count = 10;
+  vector<int> total(count, 0);
+  ThreadPool pool(3);
+  for (int iter = 0; iter < 5; ++iter) {
+    RunPool(&pool, count);
+    for (int i = 0; i < count; ++i) {
+      total[i] += visits_[i];
+    }
+  }
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(5, total[i]);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestDeterministicRandomStreams) {
+  const int count = 16;
+  Caffe::set_random_seed(1701);
+  RunPool(4, count);
+  vector<unsigned int> first_draws = draws_;
+  Caffe::set_random_seed(1701);
+  RunPool(4, count);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(first_draws[i], draws_[i]);
+  }
+}
+
+}  // namespace caffe
@@ -9,8 +9,11 @@
 #include <vector>
 
 #include "boost/iterator/counting_iterator.hpp"
+#include "boost/ref.hpp"
 
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/nms_grid.hpp"
+#include "caffe/util/simd.hpp"
 
 namespace caffe {
 
@@ -57,6 +60,30 @@ NormalizedBBox UnitBBox() {
   return unit_bbox;
 }
 
+void ToBBox(const NormalizedBBox& bbox, BBox* box) {
+  box->xmin = bbox.xmin();
+  box->ymin = bbox.ymin();
+  box->xmax = bbox.xmax();
+  box->ymax = bbox.ymax();
+  box->label = bbox.label();
+  box->score = bbox.score();
+  box->size = bbox.has_size() ? bbox.size() : -1;
+}
+
+void ToNormalizedBBox(const BBox& box, NormalizedBBox* bbox) {
+  bbox->set_xmin(box.xmin);
+  bbox->set_ymin(box.ymin);
+  bbox->set_xmax(box.xmax);
+  bbox->set_ymax(box.ymax);
+  bbox->set_label(box.label);
+  bbox->set_score(box.score);
+  if (box.size >= 0) {
+    bbox->set_size(box.size);
+  } else {
+    bbox->clear_size();
+  }
+}
+
 bool IsCrossBoundaryBBox(const NormalizedBBox& bbox) {
   return bbox.xmin() < 0 || bbox.xmin() > 1 ||
       bbox.ymin() < 0 || bbox.ymin() > 1 ||
@@ -101,6 +128,24 @@ float BBoxSize(const NormalizedBBox& bbox, const bool normalized) {
   }
 }
 
+float BBoxSize(const BBox& bbox, const bool normalized) {
+  if (bbox.xmax < bbox.xmin || bbox.ymax < bbox.ymin) {
+    // If bbox is invalid (e.g. xmax < xmin or ymax < ymin), return 0.
+    return 0;
+  } else if (bbox.size >= 0) {
+    return bbox.size;
+  } else {
+    float width = bbox.xmax - bbox.xmin;
+    float height = bbox.ymax - bbox.ymin;
+    if (normalized) {
+      return width * height;
+    } else {
+      // If bbox is not within range [0, 1].
+      return (width + 1) * (height + 1);
+    }
+  }
+}
+
 template <typename Dtype>
 Dtype BBoxSize(const Dtype* bbox, const bool normalized) {
   if (bbox[2] < bbox[0] || bbox[3] < bbox[1]) {
@@ -131,6 +176,17 @@ void ClipBBox(const NormalizedBBox& bbox, NormalizedBBox* clip_bbox) {
   clip_bbox->set_difficult(bbox.difficult());
 }
 
+void ClipBBox(const BBox& bbox, BBox* clip_bbox) {
+  clip_bbox->xmin = std::max(std::min(bbox.xmin, 1.f), 0.f);
+  clip_bbox->ymin = std::max(std::min(bbox.ymin, 1.f), 0.f);
+  clip_bbox->xmax = std::max(std::min(bbox.xmax, 1.f), 0.f);
+  clip_bbox->ymax = std::max(std::min(bbox.ymax, 1.f), 0.f);
+  clip_bbox->label = bbox.label;
+  clip_bbox->score = bbox.score;
+  clip_bbox->size = -1;
+  clip_bbox->size = BBoxSize(*clip_bbox);
+}
+
 void ClipBBox(const NormalizedBBox& bbox, const float height, const float width,
               NormalizedBBox* clip_bbox) {
   clip_bbox->set_xmin(std::max(std::min(bbox.xmin(), width), 0.f));
@@ -336,6 +392,32 @@ float JaccardOverlap(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2,
     }
 }
 
+float JaccardOverlap(const BBox& bbox1, const BBox& bbox2,
+                     const bool normalized) {
+    // Same as IntersectBBox, which yields [0, 0, 0, 0] without intersection.
+    float intersect_width = 0;
+    float intersect_height = 0;
+    if (bbox2.xmin <= bbox1.xmax && bbox2.xmax >= bbox1.xmin &&
+        bbox2.ymin <= bbox1.ymax && bbox2.ymax >= bbox1.ymin) {
+        intersect_width = std::min(bbox1.xmax, bbox2.xmax) -
+            std::max(bbox1.xmin, bbox2.xmin);
+        intersect_height = std::min(bbox1.ymax, bbox2.ymax) -
+            std::max(bbox1.ymin, bbox2.ymin);
+    }
+    if (!normalized) {
+        intersect_width += 1;
+        intersect_height += 1;
+    }
+    if (intersect_width > 0 && intersect_height > 0) {
+        float intersect_size = intersect_width * intersect_height;
+        float bbox1_size = BBoxSize(bbox1);
+        float bbox2_size = BBoxSize(bbox2);
+        return intersect_size / (bbox1_size + bbox2_size - intersect_size);
+    } else {
+        return 0.;
+    }
+}
+
 template <typename Dtype>
 Dtype JaccardOverlap(const Dtype* bbox1, const Dtype* bbox2) {
   if (bbox2[0] > bbox1[2] || bbox2[2] < bbox1[0] ||
@@ -361,6 +443,34 @@ Dtype JaccardOverlap(const Dtype* bbox1, const Dtype* bbox2) {
 template float JaccardOverlap(const float* bbox1, const float* bbox2);
 template double JaccardOverlap(const double* bbox1, const double* bbox2);
 
+BBoxArray::BBoxArray(const vector<NormalizedBBox>& bboxes)
+    : xmin(bboxes.size()), ymin(bboxes.size()), xmax(bboxes.size()),
+      ymax(bboxes.size()), size(bboxes.size()) {
+  for (int i = 0; i < bboxes.size(); ++i) {
+    xmin[i] = bboxes[i].xmin();
+    ymin[i] = bboxes[i].ymin();
+    xmax[i] = bboxes[i].xmax();
+    ymax[i] = bboxes[i].ymax();
+    size[i] = BBoxSize(bboxes[i]);
+  }
+}
+
+bool BBoxArray::IsCrossBoundary(const int i) const {
+  return xmin[i] < 0 || xmin[i] > 1 || ymin[i] < 0 || ymin[i] > 1 ||
+      xmax[i] < 0 || xmax[i] > 1 || ymax[i] < 0 || ymax[i] > 1;
+}
+
+void JaccardOverlaps(const BBoxArray& bboxes, const NormalizedBBox& bbox,
+                     float* overlaps) {
+  const float box[4] = {bbox.xmin(), bbox.ymin(), bbox.xmax(), bbox.ymax()};
+  const int count = bboxes.count();
+  if (count > 0) {
+    caffe_cpu_jaccard_overlap(count, &bboxes.xmin[0], &bboxes.ymin[0],
+        &bboxes.xmax[0], &bboxes.ymax[0], &bboxes.size[0], box,
+        BBoxSize(bbox), overlaps);
+  }
+}
+
 float BBoxCoverage(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2) {
     NormalizedBBox intersect_bbox;
     IntersectBBox(bbox1, bbox2, &intersect_bbox);
@@ -524,117 +634,108 @@ void EncodeBBox(
 }
 
 void DecodeBBox(
-    const NormalizedBBox& prior_bbox, const vector<float>& prior_variance,
+    const BBox& prior_bbox, const float* prior_variance,
     const CodeType code_type, const bool variance_encoded_in_target,
-    const bool clip_bbox, const NormalizedBBox& bbox,
-    NormalizedBBox* decode_bbox) {
+    const bool clip_bbox, const BBox& bbox, BBox* decode_bbox) {
     if (code_type == PriorBoxParameter_CodeType_CORNER) {
         if (variance_encoded_in_target) {
             // variance is encoded in target, we simply need to add the offset
             // predictions.
-            decode_bbox->set_xmin(prior_bbox.xmin() + bbox.xmin());
-            decode_bbox->set_ymin(prior_bbox.ymin() + bbox.ymin());
-            decode_bbox->set_xmax(prior_bbox.xmax() + bbox.xmax());
-            decode_bbox->set_ymax(prior_bbox.ymax() + bbox.ymax());
+            decode_bbox->xmin = prior_bbox.xmin + bbox.xmin;
+            decode_bbox->ymin = prior_bbox.ymin + bbox.ymin;
+            decode_bbox->xmax = prior_bbox.xmax + bbox.xmax;
+            decode_bbox->ymax = prior_bbox.ymax + bbox.ymax;
         } else {
             // variance is encoded in bbox, we need to scale the offset accordingly.
-            decode_bbox->set_xmin(
-                prior_bbox.xmin() + prior_variance[0] * bbox.xmin());
-            decode_bbox->set_ymin(
-                prior_bbox.ymin() + prior_variance[1] * bbox.ymin());
-            decode_bbox->set_xmax(
-                prior_bbox.xmax() + prior_variance[2] * bbox.xmax());
-            decode_bbox->set_ymax(
-                prior_bbox.ymax() + prior_variance[3] * bbox.ymax());
+            decode_bbox->xmin = prior_bbox.xmin + prior_variance[0] * bbox.xmin;
+            decode_bbox->ymin = prior_bbox.ymin + prior_variance[1] * bbox.ymin;
+            decode_bbox->xmax = prior_bbox.xmax + prior_variance[2] * bbox.xmax;
+            decode_bbox->ymax = prior_bbox.ymax + prior_variance[3] * bbox.ymax;
         }
     } else if (code_type == PriorBoxParameter_CodeType_CENTER_SIZE) {
-        float prior_width = prior_bbox.xmax() - prior_bbox.xmin();
+        float prior_width = prior_bbox.xmax - prior_bbox.xmin;
         CHECK_GT(prior_width, 0);
-        float prior_height = prior_bbox.ymax() - prior_bbox.ymin();
+        float prior_height = prior_bbox.ymax - prior_bbox.ymin;
         CHECK_GT(prior_height, 0);
-        float prior_center_x = (prior_bbox.xmin() + prior_bbox.xmax()) / 2.;
-        float prior_center_y = (prior_bbox.ymin() + prior_bbox.ymax()) / 2.;
+        float prior_center_x = (prior_bbox.xmin + prior_bbox.xmax) / 2.;
+        float prior_center_y = (prior_bbox.ymin + prior_bbox.ymax) / 2.;
 
         float decode_bbox_center_x, decode_bbox_center_y;
         float decode_bbox_width, decode_bbox_height;
         if (variance_encoded_in_target) {
             // variance is encoded in target, we simply need to retore the offset
             // predictions.
-            decode_bbox_center_x = bbox.xmin() * prior_width + prior_center_x;
-            decode_bbox_center_y = bbox.ymin() * prior_height + prior_center_y;
-            decode_bbox_width = exp(bbox.xmax()) * prior_width;
-            decode_bbox_height = exp(bbox.ymax()) * prior_height;
+            decode_bbox_center_x = bbox.xmin * prior_width + prior_center_x;
+            decode_bbox_center_y = bbox.ymin * prior_height + prior_center_y;
+            decode_bbox_width = exp(bbox.xmax) * prior_width;
+            decode_bbox_height = exp(bbox.ymax) * prior_height;
         } else {
             // variance is encoded in bbox, we need to scale the offset accordingly.
             decode_bbox_center_x =
-                prior_variance[0] * bbox.xmin() * prior_width + prior_center_x;
+                prior_variance[0] * bbox.xmin * prior_width + prior_center_x;
             decode_bbox_center_y =
-                prior_variance[1] * bbox.ymin() * prior_height + prior_center_y;
+                prior_variance[1] * bbox.ymin * prior_height + prior_center_y;
             decode_bbox_width =
-                exp(prior_variance[2] * bbox.xmax()) * prior_width;
+                exp(prior_variance[2] * bbox.xmax) * prior_width;
             decode_bbox_height =
-                exp(prior_variance[3] * bbox.ymax()) * prior_height;
+                exp(prior_variance[3] * bbox.ymax) * prior_height;
         }
 
-        decode_bbox->set_xmin(decode_bbox_center_x - decode_bbox_width / 2.);
-        decode_bbox->set_ymin(decode_bbox_center_y - decode_bbox_height / 2.);
-        decode_bbox->set_xmax(decode_bbox_center_x + decode_bbox_width / 2.);
-        decode_bbox->set_ymax(decode_bbox_center_y + decode_bbox_height / 2.);
+        decode_bbox->xmin = decode_bbox_center_x - decode_bbox_width / 2.;
+        decode_bbox->ymin = decode_bbox_center_y - decode_bbox_height / 2.;
+        decode_bbox->xmax = decode_bbox_center_x + decode_bbox_width / 2.;
+        decode_bbox->ymax = decode_bbox_center_y + decode_bbox_height / 2.;
     } else if (code_type == PriorBoxParameter_CodeType_CORNER_SIZE) {
-        float prior_width = prior_bbox.xmax() - prior_bbox.xmin();
+        float prior_width = prior_bbox.xmax - prior_bbox.xmin;
         CHECK_GT(prior_width, 0);
-        float prior_height = prior_bbox.ymax() - prior_bbox.ymin();
+        float prior_height = prior_bbox.ymax - prior_bbox.ymin;
         CHECK_GT(prior_height, 0);
         if (variance_encoded_in_target) {
         // variance is encoded in target, we simply need to add the offset
         // predictions.
-        decode_bbox->set_xmin(prior_bbox.xmin() + bbox.xmin() * prior_width);
-        decode_bbox->set_ymin(prior_bbox.ymin() + bbox.ymin() * prior_height);
-        decode_bbox->set_xmax(prior_bbox.xmax() + bbox.xmax() * prior_width);
-        decode_bbox->set_ymax(prior_bbox.ymax() + bbox.ymax() * prior_height);
+        decode_bbox->xmin = prior_bbox.xmin + bbox.xmin * prior_width;
+        decode_bbox->ymin = prior_bbox.ymin + bbox.ymin * prior_height;
+        decode_bbox->xmax = prior_bbox.xmax + bbox.xmax * prior_width;
+        decode_bbox->ymax = prior_bbox.ymax + bbox.ymax * prior_height;
         } else {
         // variance is encoded in bbox, we need to scale the offset accordingly.
-        decode_bbox->set_xmin(
-            prior_bbox.xmin() + prior_variance[0] * bbox.xmin() * prior_width);
-        decode_bbox->set_ymin(
-            prior_bbox.ymin() + prior_variance[1] * bbox.ymin() * prior_height);
-        decode_bbox->set_xmax(
-            prior_bbox.xmax() + prior_variance[2] * bbox.xmax() * prior_width);
-        decode_bbox->set_ymax(
-            prior_bbox.ymax() + prior_variance[3] * bbox.ymax() * prior_height);
+        decode_bbox->xmin = prior_bbox.xmin + prior_variance[0] * bbox.xmin * prior_width;
+        decode_bbox->ymin = prior_bbox.ymin + prior_variance[1] * bbox.ymin * prior_height;
+        decode_bbox->xmax = prior_bbox.xmax + prior_variance[2] * bbox.xmax * prior_width;
+        decode_bbox->ymax = prior_bbox.ymax + prior_variance[3] * bbox.ymax * prior_height;
         }
     } else if (code_type == PriorBoxParameter_CodeType_RECEPTIVE_CENTER) {
-        float prior_width = prior_bbox.xmax() - prior_bbox.xmin();
+        float prior_width = prior_bbox.xmax - prior_bbox.xmin;
         CHECK_GT(prior_width, 0);
-        float prior_height = prior_bbox.ymax() - prior_bbox.ymin();
+        float prior_height = prior_bbox.ymax - prior_bbox.ymin;
         CHECK_GT(prior_height, 0);
-        float prior_center_x = (prior_bbox.xmin() + prior_bbox.xmax()) / 2.;
-        float prior_center_y = (prior_bbox.ymin() + prior_bbox.ymax()) / 2.;
+        float prior_center_x = (prior_bbox.xmin + prior_bbox.xmax) / 2.;
+        float prior_center_y = (prior_bbox.ymin + prior_bbox.ymax) / 2.;
 
         float bbox_xmin, bbox_xmax, bbox_ymin, bbox_ymax;
         if (variance_encoded_in_target) {
             // variance is encoded in target, we simply need to retore the offset
             // predictions.
-            bbox_xmin = prior_center_x - bbox.xmin() * prior_width;
-            bbox_ymin = prior_center_y - bbox.ymin() * prior_height;
-            bbox_xmax = prior_center_x - bbox.xmax() * prior_width;
-            bbox_ymax = prior_center_y - bbox.ymax() * prior_height;
+            bbox_xmin = prior_center_x - bbox.xmin * prior_width;
+            bbox_ymin = prior_center_y - bbox.ymin * prior_height;
+            bbox_xmax = prior_center_x - bbox.xmax * prior_width;
+            bbox_ymax = prior_center_y - bbox.ymax * prior_height;
         } else {
             // variance is encoded in bbox, we need to scale the offset accordingly.
-            bbox_xmin = prior_center_x - bbox.xmin() * prior_width * prior_variance[0];
-            bbox_ymin = prior_center_y - bbox.ymin() * prior_height * prior_variance[1];
-            bbox_xmax = prior_center_x - bbox.xmax() * prior_width * prior_variance[2];
-            bbox_ymax = prior_center_y - bbox.ymax() * prior_height * prior_variance[3];
+            bbox_xmin = prior_center_x - bbox.xmin * prior_width * prior_variance[0];
+            bbox_ymin = prior_center_y - bbox.ymin * prior_height * prior_variance[1];
+            bbox_xmax = prior_center_x - bbox.xmax * prior_width * prior_variance[2];
+            bbox_ymax = prior_center_y - bbox.ymax * prior_height * prior_variance[3];
         }
 
-        decode_bbox->set_xmin(bbox_xmin);
-        decode_bbox->set_ymin(bbox_ymin);
-        decode_bbox->set_xmax(bbox_xmax);
-        decode_bbox->set_ymax(bbox_ymax);
+        decode_bbox->xmin = bbox_xmin;
+        decode_bbox->ymin = bbox_ymin;
+        decode_bbox->xmax = bbox_xmax;
+        decode_bbox->ymax = bbox_ymax;
     } else if (code_type == PriorBoxParameter_CodeType_CORNNER_CENTER) {
-        float prior_width = prior_bbox.xmax() - prior_bbox.xmin();
+        float prior_width = prior_bbox.xmax - prior_bbox.xmin;
         CHECK_GT(prior_width, 0);
-        float prior_height = prior_bbox.ymax() - prior_bbox.ymin();
+        float prior_height = prior_bbox.ymax - prior_bbox.ymin;
         CHECK_GT(prior_height, 0);
 
         float bbox_xmin, bbox_ymin;
@@ -642,36 +743,56 @@ void DecodeBBox(
         if (variance_encoded_in_target) {
             // variance is encoded in target, we simply need to retore the offset
             // predictions.
-            bbox_xmin = -bbox.xmin() * prior_width + prior_bbox.xmin();
-            bbox_ymin = -bbox.ymin() * prior_height + prior_bbox.ymin();
-            decode_bbox_width = exp(bbox.xmax()) * prior_width;
-            decode_bbox_height = exp(bbox.ymax()) * prior_height;
+            bbox_xmin = -bbox.xmin * prior_width + prior_bbox.xmin;
+            bbox_ymin = -bbox.ymin * prior_height + prior_bbox.ymin;
+            decode_bbox_width = exp(bbox.xmax) * prior_width;
+            decode_bbox_height = exp(bbox.ymax) * prior_height;
         } else {
             // variance is encoded in bbox, we need to scale the offset accordingly.
             bbox_xmin =
-                -prior_variance[0] * bbox.xmin() * prior_width + prior_bbox.xmin();
+                -prior_variance[0] * bbox.xmin * prior_width + prior_bbox.xmin;
             bbox_ymin =
-                -prior_variance[1] * bbox.ymin() * prior_height + prior_bbox.ymin();
+                -prior_variance[1] * bbox.ymin * prior_height + prior_bbox.ymin;
             decode_bbox_width =
-                exp(prior_variance[2] * bbox.xmax()) * prior_width;
+                exp(prior_variance[2] * bbox.xmax) * prior_width;
             decode_bbox_height =
-                exp(prior_variance[3] * bbox.ymax()) * prior_height;
+                exp(prior_variance[3] * bbox.ymax) * prior_height;
         }
 
-        decode_bbox->set_xmin(bbox_xmin);
-        decode_bbox->set_ymin(bbox_ymin);
-        decode_bbox->set_xmax(bbox_xmin + decode_bbox_width);
-        decode_bbox->set_ymax(bbox_ymin + decode_bbox_height);
+        decode_bbox->xmin = bbox_xmin;
+        decode_bbox->ymin = bbox_ymin;
+        decode_bbox->xmax = bbox_xmin + decode_bbox_width;
+        decode_bbox->ymax = bbox_ymin + decode_bbox_height;
     } else {
         LOG(FATAL) << "Unknown LocLossType.";
     }
-    float bbox_size = BBoxSize(*decode_bbox);
-    decode_bbox->set_size(bbox_size);
+    decode_bbox->label = bbox.label;
+    decode_bbox->score = bbox.score;
+    decode_bbox->size = -1;
+    decode_bbox->size = BBoxSize(*decode_bbox);
     if (clip_bbox) {
         ClipBBox(*decode_bbox, decode_bbox);
     }
 }
 
+void DecodeBBox(
+    const NormalizedBBox& prior_bbox, const vector<float>& prior_variance,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip_bbox, const NormalizedBBox& bbox,
+    NormalizedBBox* decode_bbox) {
+    BBox prior_box, box, decode_box;
+    ToBBox(prior_bbox, &prior_box);
+    ToBBox(bbox, &box);
+    DecodeBBox(prior_box, prior_variance.empty() ? NULL : &prior_variance[0],
+               code_type, variance_encoded_in_target, clip_bbox, box,
+               &decode_box);
+    decode_bbox->set_xmin(decode_box.xmin);
+    decode_bbox->set_ymin(decode_box.ymin);
+    decode_bbox->set_xmax(decode_box.xmax);
+    decode_bbox->set_ymax(decode_box.ymax);
+    decode_bbox->set_size(decode_box.size);
+}
+
 void DecodeBBoxes(
     const vector<NormalizedBBox>& prior_bboxes,
     const vector<vector<float> >& prior_variances,
@@ -725,6 +846,52 @@ void DecodeBBoxesAll(const vector<LabelBBox>& all_loc_preds,
     }
 }
 
+void DecodeBBoxes(
+    const vector<BBox>& prior_bboxes, const vector<float>& prior_variances,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip_bbox, const vector<BBox>& bboxes,
+    vector<BBox>* decode_bboxes) {
+    CHECK_EQ(prior_bboxes.size() * 4, prior_variances.size());
+    CHECK_EQ(prior_bboxes.size(), bboxes.size());
+    int num_bboxes = prior_bboxes.size();
+    decode_bboxes->resize(num_bboxes);
+    for (int i = 0; i < num_bboxes; ++i) {
+        DecodeBBox(prior_bboxes[i], &prior_variances[i * 4], code_type,
+                variance_encoded_in_target, clip_bbox, bboxes[i],
+                &(*decode_bboxes)[i]);
+    }
+}
+
+void DecodeBBoxesAll(const vector<LabelBoxes>& all_loc_preds,
+    const vector<BBox>& prior_bboxes, const vector<float>& prior_variances,
+    const int num, const bool share_location,
+    const int num_loc_classes, const int background_label_id,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip, vector<LabelBoxes>* all_decode_bboxes) {
+    CHECK_EQ(all_loc_preds.size(), num);
+    all_decode_bboxes->clear();
+    all_decode_bboxes->resize(num);
+    for (int i = 0; i < num; ++i) {
+        // Decode predictions into bboxes.
+        LabelBoxes& decode_bboxes = (*all_decode_bboxes)[i];
+        for (int c = 0; c < num_loc_classes; ++c) {
+            int label = share_location ? -1 : c;
+            if (label == background_label_id) {
+                // Ignore background class.
+                continue;
+            }
+            LabelBoxes::const_iterator it = all_loc_preds[i].find(label);
+            if (it == all_loc_preds[i].end()) {
+                // Something bad happened if there are no predictions for current label.
+                LOG(FATAL) << "Could not find location predictions for label " << label;
+            }
+            DecodeBBoxes(prior_bboxes, prior_variances,
+                        code_type, variance_encoded_in_target, clip,
+                        it->second, &(decode_bboxes[label]));
+        }
+    }
+}
+
 
 bool overlap_cmp(const pair<int,float> &p1,const pair<int,float> &p2)
 {
@@ -739,7 +906,28 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
     const bool use_center_locate_match,
     vector<int> bbox_small_list, vector<int> bbox_large_list,
     vector<int> receptive_filed_list, int input_height, int input_width) {
-  int num_pred = pred_bboxes.size();
+  MatchBBox(gt_bboxes, BBoxArray(pred_bboxes), label, match_type,
+            overlap_threshold, ignore_cross_boundary_bbox, match_indices,
+            match_overlaps, use_tiny_box_match, use_center_locate_match,
+            bbox_small_list, bbox_large_list, receptive_filed_list,
+            input_height, input_width);
+}
+
+// Whether an overlap counts as one during matching.
+static inline bool IsOverlap(const float overlap) {
+  return overlap > 1e-6;
+}
+
+void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
+    const BBoxArray& pred_bboxes, const int label,
+    const MatchType match_type, const float overlap_threshold,
+    const bool ignore_cross_boundary_bbox,
+    vector<int>* match_indices, vector<float>* match_overlaps,
+    const bool use_tiny_box_match, const bool use_center_locate_match,
+    const vector<int>& bbox_small_list, const vector<int>& bbox_large_list,
+    const vector<int>& receptive_filed_list, int input_height,
+    int input_width) {
+  int num_pred = pred_bboxes.count();
   match_indices->clear();
   match_indices->resize(num_pred, -1);
   match_overlaps->clear();
@@ -767,20 +955,31 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
   }
   
   vector<int> gt_boxnum(num_gt, 0);
-  // Store the positive overlap between predictions and ground truth.
-  map<int, map<int, float> > overlaps;
+  // The overlaps between predictions and ground truth, one row of num_pred
+  // per ground truth. Only those passing IsOverlap() are used.
+  vector<float> overlaps(num_gt * num_pred);
+  for (int j = 0; j < num_gt; ++j) {
+    JaccardOverlaps(pred_bboxes, gt_bboxes[gt_indices[j]],
+                    &overlaps[j * num_pred]);
+  }
+  // The predictions with a positive overlap, in increasing order.
+  vector<int> overlapped;
   for (int i = 0; i < num_pred; ++i) {
-    if (ignore_cross_boundary_bbox && IsCrossBoundaryBBox(pred_bboxes[i])) {
+    if (ignore_cross_boundary_bbox && pred_bboxes.IsCrossBoundary(i)) {
       (*match_indices)[i] = -2;
       continue;
     }
+    bool has_overlap = false;
     for (int j = 0; j < num_gt; ++j) {
-      float overlap = JaccardOverlap(pred_bboxes[i], gt_bboxes[gt_indices[j]]);
-      if (overlap > 1e-6) {
+      float overlap = overlaps[j * num_pred + i];
+      if (IsOverlap(overlap)) {
         (*match_overlaps)[i] = std::max((*match_overlaps)[i], overlap);
-        overlaps[i][j] = overlap;
+        has_overlap = true;
       }
     }
+    if (has_overlap) {
+      overlapped.push_back(i);
+    }
   }
 
   // Bipartite matching.
@@ -793,26 +992,26 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
     int max_idx = -1;
     int max_gt_idx = -1;
     float max_overlap = -1;
-    for (map<int, map<int, float> >::iterator it = overlaps.begin();
-         it != overlaps.end(); ++it) {
-      int i = it->first;
+    for (int k = 0; k < overlapped.size(); ++k) {
+      int i = overlapped[k];
       if ((*match_indices)[i] != -1) {
         // The prediction already has matched ground truth or is ignored.
         continue;
       }
       for (int p = 0; p < gt_pool.size(); ++p) {
         int j = gt_pool[p];
-        if (it->second.find(j) == it->second.end()) {
+        float overlap = overlaps[j * num_pred + i];
+        if (!IsOverlap(overlap)) {
           // No overlap between the i-th prediction and j-th ground truth.
           continue;
         }
         // Find the maximum overlapped pair.
-        if (it->second[j] > max_overlap) {
+        if (overlap > max_overlap) {
           // If the prediction has not been matched to any ground truth,
           // and the overlap is larger than maximum overlap, update.
           max_idx = i;
           max_gt_idx = j;
-          max_overlap = it->second[j];
+          max_overlap = overlap;
         }
       }
     }
@@ -837,9 +1036,8 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
     case MultiBoxLossParameter_MatchType_PER_PREDICTION: // 为剩余的预测框寻找次级的ground truth box
     {
       // Get most overlaped for the rest prediction bboxes.
-      for (map<int, map<int, float> >::iterator it = overlaps.begin();
-           it != overlaps.end(); ++it) {
-        int i = it->first;
+      for (int k = 0; k < overlapped.size(); ++k) {
+        int i = overlapped[k];
         if ((*match_indices)[i] != -1) {
           // The prediction already has matched ground truth or is ignored.
           continue;
@@ -847,12 +1045,12 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
         int max_gt_idx = -1;
         float max_overlap = -1;
         for (int j = 0; j < num_gt; ++j) {
-          if (it->second.find(j) == it->second.end()) {
+          float overlap = overlaps[j * num_pred + i];
+          if (!IsOverlap(overlap)) {
             // No overlap between the i-th prediction and j-th ground truth.
             continue;
           }
           // Find the maximum overlapped pair.
-          float overlap = it->second[j];
           if (overlap >= overlap_threshold && overlap > max_overlap) {
             // If the prediction has not been matched to any ground truth,
             // and the overlap is larger than maximum overlap, update.
@@ -892,9 +1090,8 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
         if (tiny_gt_num > 0) {
           vector< vector< pair<int, float> > > tiny_overlaps(tiny_gt_num);
           // find tiny overlaps     
-          for (map<int, map<int, float> >::iterator it = overlaps.begin();
-              it != overlaps.end(); ++it) {
-            int i = it->first;
+          for (int k = 0; k < overlapped.size(); ++k) {
+            int i = overlapped[k];
             if ((*match_indices)[i] != -1) {
               // The prediction already has matched ground truth or is ignored.
               continue;
@@ -902,12 +1099,12 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
             int max_gt_idx = -1;
             float max_overlap = -1;
             for (int j = 0; j < tiny_gt_num; ++j) {
-              if (it->second.find(tiny_gt_indices[j]) == it->second.end()) {
+              float overlap = overlaps[tiny_gt_indices[j] * num_pred + i];
+              if (!IsOverlap(overlap)) {
                 // No overlap between the i-th prediction and j-th ground truth.
                 continue;
               }
               // Find the maximum overlapped pair.
-              float overlap = it->second[tiny_gt_indices[j]];
               if (overlap >= 0.1 && overlap > max_overlap) {
                 // If the prediction has not been matched to any ground truth,
                 // and the overlap is larger than maximum overlap, update.
@@ -937,20 +1134,19 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
       }
       if(use_center_locate_match){
         // Get most overlaped for the rest prediction bboxes.
-        for (map<int, map<int, float> >::iterator it = overlaps.begin();
-            it != overlaps.end(); ++it) {
-          int i = it->first;
+        for (int k = 0; k < overlapped.size(); ++k) {
+          int i = overlapped[k];
           if ((*match_indices)[i] != -1) {
             // The prediction already has matched ground truth or is ignored.
             continue;
           }
-          float pred_center_x = float((pred_bboxes[i].xmin() + pred_bboxes[i].xmax()) /2);
-          float pred_center_y = float((pred_bboxes[i].ymin() + pred_bboxes[i].ymax()) /2);
+          float pred_center_x = float((pred_bboxes.xmin[i] + pred_bboxes.xmax[i]) /2);
+          float pred_center_y = float((pred_bboxes.ymin[i] + pred_bboxes.ymax[i]) /2);
           int center_match_gt_idx = -1;
           float center_match_overlap = -1;
           for (int j = 0; j < num_gt; ++j) {
             bool x_inside_gt_box = false, y_inside_gt_box = false;
-            int receptive_filed_ = int ((pred_bboxes[i].xmax() - pred_bboxes[i].xmin()) * input_width);
+            int receptive_filed_ = int ((pred_bboxes.xmax[i] - pred_bboxes.xmin[i]) * input_width);
             int gt_bbox_size_width = int((gt_bboxes[j].xmax() - gt_bboxes[j].xmin()) * input_width);
             int gt_bbox_size_height = int((gt_bboxes[j].ymax() - gt_bboxes[j].ymin()) * input_height);
             int large_side = std::max(gt_bbox_size_height, gt_bbox_size_width);
@@ -975,8 +1171,9 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
               y_inside_gt_box = true;
             }
             if(y_inside_gt_box && x_inside_gt_box){
+              float overlap = overlaps[j * num_pred + i];
               center_match_gt_idx = j;
-              center_match_overlap = it->second[j];
+              center_match_overlap = IsOverlap(overlap) ? overlap : 0;
             }
           }
           if (center_match_gt_idx != -1) {
@@ -997,85 +1194,81 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
   return;
 }
 
-void FindMatches(const vector<LabelBBox>& all_loc_preds,
+// Matches the predictions of one image of a batch, for FindMatches.
+class ImageMatcher {
+ public:
+  ImageMatcher(const vector<LabelBBox>& all_loc_preds,
       const map<int, vector<NormalizedBBox> >& all_gt_bboxes,
       const vector<NormalizedBBox>& prior_bboxes,
       const vector<vector<float> >& prior_variances,
       const MultiBoxLossParameter& multibox_loss_param,
-      vector<map<int, vector<float> > >* all_match_overlaps,
-      vector<map<int, vector<int> > >* all_match_indices) {
-  // all_match_overlaps->clear();
-  // all_match_indices->clear();
-  // Get parameters.
-  CHECK(multibox_loss_param.has_num_classes()) << "Must provide num_classes.";
-  const int num_classes = multibox_loss_param.num_classes();
-  CHECK_GE(num_classes, 1) << "num_classes should not be less than 1.";
-  const bool share_location = multibox_loss_param.share_location();
-  const int loc_classes = share_location ? 1 : num_classes;
-  const MatchType match_type = multibox_loss_param.match_type();
-  const float overlap_threshold = multibox_loss_param.overlap_threshold();
-  const bool use_prior_for_matching =
-      multibox_loss_param.use_prior_for_matching();
-  const int background_label_id = multibox_loss_param.background_label_id();
-  const CodeType code_type = multibox_loss_param.code_type();
-  const bool encode_variance_in_target =
-      multibox_loss_param.encode_variance_in_target();
-  const bool ignore_cross_boundary_bbox =
-      multibox_loss_param.ignore_cross_boundary_bbox();
-  const bool use_tiny_box_to_match = multibox_loss_param.use_tiny_box_match();
-  const bool use_center_to_match = multibox_loss_param.use_center_locate_match();
+      map<int, vector<float> >* all_match_overlaps,
+      map<int, vector<int> >* all_match_indices)
+      : all_loc_preds_(all_loc_preds), all_gt_bboxes_(all_gt_bboxes),
+        prior_bboxes_(prior_bboxes), prior_variances_(prior_variances),
+        param_(multibox_loss_param), all_match_overlaps_(all_match_overlaps),
+        all_match_indices_(all_match_indices) {
+    // Get parameters.
+    CHECK(param_.has_num_classes()) << "Must provide num_classes.";
+    num_classes_ = param_.num_classes();
+    CHECK_GE(num_classes_, 1) << "num_classes should not be less than 1.";
+    share_location_ = param_.share_location();
+    loc_classes_ = share_location_ ? 1 : num_classes_;
+    background_label_id_ = param_.background_label_id();
+
+    num_output_scales_ = 0;
+    net_input_height_ = 0;
+    net_input_width_ = 0;
+    if(param_.has_num_output_scales()){
+      num_output_scales_ = param_.num_output_scales();
+      CHECK_EQ(num_output_scales_, param_.bbox_small_list_size());
+      CHECK_EQ(num_output_scales_, param_.bbox_large_list_size());
+      CHECK_EQ(num_output_scales_, param_.receptive_field_list_size());
+      for(unsigned i = 0; i < num_output_scales_; i++){
+        bbox_small_list_.push_back(param_.bbox_small_list(i));
+        bbox_large_list_.push_back(param_.bbox_large_list(i));
+        receptive_filed_list_.push_back(param_.receptive_field_list(i));
+      }
+      net_input_height_ = param_.net_input_height();
+      net_input_width_ = param_.net_input_width();
+    }
+    if (param_.use_prior_for_matching()) {
+      // All images match the same prior bboxes.
+      prior_array_ = BBoxArray(prior_bboxes_);
+    }
+  }
 
-  vector<int> bbox_small_list_;
-  vector<int> bbox_large_list_;
-  vector<int> receptive_filed_list_;
-  int num_output_scales_ = 0;
-  int net_input_height_ = 0;
-  int net_input_width_ = 0;
-
-  if(multibox_loss_param.has_num_output_scales()){
-    num_output_scales_ = multibox_loss_param.num_output_scales();
-    CHECK_EQ(num_output_scales_, multibox_loss_param.bbox_small_list_size());
-    CHECK_EQ(num_output_scales_, multibox_loss_param.bbox_large_list_size());
-    CHECK_EQ(num_output_scales_, multibox_loss_param.receptive_field_list_size());
-    bbox_small_list_.clear();
-    bbox_large_list_.clear();
-    receptive_filed_list_.clear();
-    for(unsigned i = 0; i < num_output_scales_; i++){
-      bbox_small_list_.push_back(multibox_loss_param.bbox_small_list(i));
-      bbox_large_list_.push_back(multibox_loss_param.bbox_large_list(i));
-      receptive_filed_list_.push_back(multibox_loss_param.receptive_field_list(i));
-    }
-    net_input_height_ = multibox_loss_param.net_input_height();
-    net_input_width_ = multibox_loss_param.net_input_width();
-  }
-  // Find the matches.
-  int num = all_loc_preds.size();
-  for (int i = 0; i < num; ++i) {
-    map<int, vector<int> > match_indices;
-    map<int, vector<float> > match_overlaps;
+  void operator()(int i, int worker_id) const {
+    map<int, vector<int> >& match_indices = all_match_indices_[i];
+    map<int, vector<float> >& match_overlaps = all_match_overlaps_[i];
     // Check if there is ground truth for current image.
-    if (all_gt_bboxes.find(i) == all_gt_bboxes.end()) {
+    if (all_gt_bboxes_.find(i) == all_gt_bboxes_.end()) {
       // There is no gt for current image. All predictions are negative.
-      all_match_indices->push_back(match_indices);
-      all_match_overlaps->push_back(match_overlaps);
-      continue;
-    }
+      return;
+    }
+    const MatchType match_type = param_.match_type();
+    const float overlap_threshold = param_.overlap_threshold();
+    const bool ignore_cross_boundary_bbox =
+        param_.ignore_cross_boundary_bbox();
+    const bool use_tiny_box_to_match = param_.use_tiny_box_match();
+    const bool use_center_to_match = param_.use_center_locate_match();
     // Find match between predictions and ground truth.
-    const vector<NormalizedBBox>& gt_bboxes = all_gt_bboxes.find(i)->second;
-    if (!use_prior_for_matching) {
-      for (int c = 0; c < loc_classes; ++c) {
-        int label = share_location ? -1 : c;
-        if (!share_location && label == background_label_id) {
+    const vector<NormalizedBBox>& gt_bboxes = all_gt_bboxes_.find(i)->second;
+    if (!param_.use_prior_for_matching()) {
+      for (int c = 0; c < loc_classes_; ++c) {
+        int label = share_location_ ? -1 : c;
+        if (!share_location_ && label == background_label_id_) {
           // Ignore background loc predictions.
           continue;
         }
         // Decode the prediction into bbox first.
         vector<NormalizedBBox> loc_bboxes;
         bool clip_bbox = false;
-        DecodeBBoxes(prior_bboxes, prior_variances,
-                     code_type, encode_variance_in_target, clip_bbox,
-                     all_loc_preds[i].find(label)->second, &loc_bboxes);
-        MatchBBox(gt_bboxes, loc_bboxes, label, match_type,
+        DecodeBBoxes(prior_bboxes_, prior_variances_,
+                     param_.code_type(), param_.encode_variance_in_target(),
+                     clip_bbox, all_loc_preds_[i].find(label)->second,
+                     &loc_bboxes);
+        MatchBBox(gt_bboxes, BBoxArray(loc_bboxes), label, match_type,
                   overlap_threshold, ignore_cross_boundary_bbox,
                   &match_indices[label], &match_overlaps[label], use_tiny_box_to_match, use_center_to_match,
                   bbox_small_list_, bbox_large_list_, receptive_filed_list_, net_input_height_,
@@ -1086,12 +1279,12 @@ void FindMatches(const vector<LabelBBox>& all_loc_preds,
       vector<int> temp_match_indices;
       vector<float> temp_match_overlaps;
       const int label = -1;
-      MatchBBox(gt_bboxes, prior_bboxes, label, match_type, overlap_threshold,
+      MatchBBox(gt_bboxes, prior_array_, label, match_type, overlap_threshold,
                 ignore_cross_boundary_bbox, &temp_match_indices,
                 &temp_match_overlaps, use_tiny_box_to_match, use_center_to_match, 
                 bbox_small_list_, bbox_large_list_, receptive_filed_list_, net_input_height_,
                 net_input_width_ );
-      if (share_location) {
+      if (share_location_) {
         match_indices[label] = temp_match_indices;
         match_overlaps[label] = temp_match_overlaps;
       } else {
@@ -1101,8 +1294,8 @@ void FindMatches(const vector<LabelBBox>& all_loc_preds,
           gt_labels.push_back(gt_bboxes[g].label());
         }
         // Distribute the matching results to different loc_class.
-        for (int c = 0; c < loc_classes; ++c) {
-          if (c == background_label_id) {
+        for (int c = 0; c < loc_classes_; ++c) {
+          if (c == background_label_id_) {
             // Ignore background loc predictions.
             continue;
           }
@@ -1120,8 +1313,59 @@ void FindMatches(const vector<LabelBBox>& all_loc_preds,
         }
       }
     }
-    all_match_indices->push_back(match_indices);
-    all_match_overlaps->push_back(match_overlaps);
+  }
+
+ protected:
+  const vector<LabelBBox>& all_loc_preds_;
+  const map<int, vector<NormalizedBBox> >& all_gt_bboxes_;
+  const vector<NormalizedBBox>& prior_bboxes_;
+  const vector<vector<float> >& prior_variances_;
+  const MultiBoxLossParameter& param_;
+  // Results of image i go to element i.
+  map<int, vector<float> >* all_match_overlaps_;
+  map<int, vector<int> >* all_match_indices_;
+
+  int num_classes_;
+  bool share_location_;
+  int loc_classes_;
+  int background_label_id_;
+  vector<int> bbox_small_list_;
+  vector<int> bbox_large_list_;
+  vector<int> receptive_filed_list_;
+  int num_output_scales_;
+  int net_input_height_;
+  int net_input_width_;
+  BBoxArray prior_array_;
+};
+
+void FindMatches(const vector<LabelBBox>& all_loc_preds,
+      const map<int, vector<NormalizedBBox> >& all_gt_bboxes,
+      const vector<NormalizedBBox>& prior_bboxes,
+      const vector<vector<float> >& prior_variances,
+      const MultiBoxLossParameter& multibox_loss_param,
+      vector<map<int, vector<float> > >* all_match_overlaps,
+      vector<map<int, vector<int> > >* all_match_indices,
+      ThreadPool* pool) {
+  // The matches of the batch are appended to the results.
+  CHECK_EQ(all_match_overlaps->size(), all_match_indices->size());
+  const int num = all_loc_preds.size();
+  const int offset = all_match_indices->size();
+  all_match_overlaps->resize(offset + num);
+  all_match_indices->resize(offset + num);
+  if (num == 0) {
+    return;
+  }
+  ImageMatcher matcher(all_loc_preds, all_gt_bboxes, prior_bboxes,
+      prior_variances, multibox_loss_param, &(*all_match_overlaps)[offset],
+      &(*all_match_indices)[offset]);
+  // Find the matches. Images are independent, and each one only writes its
+  // own results.
+  if (pool) {
+    pool->Run(num, boost::ref(matcher));
+  } else {
+    for (int i = 0; i < num; ++i) {
+      matcher(i, 0);
+    }
   }
 }
 
@@ -1546,6 +1790,44 @@ template void GetLocPredictions(const double* loc_data, const int num,
       const int num_preds_per_class, const int num_loc_classes,
       const bool share_location, vector<LabelBBox>* loc_preds);
 
+template <typename Dtype>
+void GetLocPredictions(const Dtype* loc_data, const int num,
+      const int num_preds_per_class, const int num_loc_classes,
+      const bool share_location, vector<LabelBoxes>* loc_preds) {
+  loc_preds->clear();
+  if (share_location) {
+    CHECK_EQ(num_loc_classes, 1);
+  }
+  loc_preds->resize(num);
+  for (int i = 0; i < num; ++i) {
+    LabelBoxes& label_bbox = (*loc_preds)[i];
+    for (int c = 0; c < num_loc_classes; ++c) {
+      int label = share_location ? -1 : c;
+      vector<BBox>& bboxes = label_bbox[label];
+      bboxes.resize(num_preds_per_class);
+      for (int p = 0; p < num_preds_per_class; ++p) {
+        const Dtype* loc = loc_data + (p * num_loc_classes + c) * 4;
+        BBox& bbox = bboxes[p];
+        bbox.xmin = loc[0];
+        bbox.ymin = loc[1];
+        bbox.xmax = loc[2];
+        bbox.ymax = loc[3];
+        bbox.label = label;
+        bbox.score = 0;
+        bbox.size = -1;
+      }
+    }
+    loc_data += num_preds_per_class * num_loc_classes * 4;
+  }
+}
+
+template void GetLocPredictions(const float* loc_data, const int num,
+      const int num_preds_per_class, const int num_loc_classes,
+      const bool share_location, vector<LabelBoxes>* loc_preds);
+template void GetLocPredictions(const double* loc_data, const int num,
+      const int num_preds_per_class, const int num_loc_classes,
+      const bool share_location, vector<LabelBoxes>* loc_preds);
+
 template <typename Dtype>
 void EncodeLocPrediction(const vector<LabelBBox>& all_loc_preds,
       const map<int, vector<NormalizedBBox> >& all_gt_bboxes,
@@ -2103,6 +2385,32 @@ template void GetPriorBBoxes(const double* prior_data, const int num_priors,
       vector<NormalizedBBox>* prior_bboxes,
       vector<vector<float> >* prior_variances);
 
+template <typename Dtype>
+void GetPriorBBoxes(const Dtype* prior_data, const int num_priors,
+      vector<BBox>* prior_bboxes, vector<float>* prior_variances) {
+  prior_bboxes->resize(num_priors);
+  for (int i = 0; i < num_priors; ++i) {
+    const Dtype* prior = prior_data + i * 4;
+    BBox& bbox = (*prior_bboxes)[i];
+    bbox.xmin = prior[0];
+    bbox.ymin = prior[1];
+    bbox.xmax = prior[2];
+    bbox.ymax = prior[3];
+    bbox.label = -1;
+    bbox.score = 0;
+    bbox.size = -1;
+    bbox.size = BBoxSize(bbox);
+  }
+  // The variances follow the priors in the same layout.
+  prior_variances->assign(prior_data + num_priors * 4,
+                          prior_data + num_priors * 8);
+}
+
+template void GetPriorBBoxes(const float* prior_data, const int num_priors,
+      vector<BBox>* prior_bboxes, vector<float>* prior_variances);
+template void GetPriorBBoxes(const double* prior_data, const int num_priors,
+      vector<BBox>* prior_bboxes, vector<float>* prior_variances);
+
 template <typename Dtype>
 void GetDetectionResults(const Dtype* det_data, const int num_det,
       const int background_label_id,
@@ -2321,6 +2629,18 @@ void ApplyNMSFast(const vector<NormalizedBBox>& bboxes,
       const vector<float>& scores, const float score_threshold,
       const float nms_threshold, const float eta, const int top_k,
       vector<int>* indices) {
+  vector<BBox> boxes(bboxes.size());
+  for (int i = 0; i < bboxes.size(); ++i) {
+    ToBBox(bboxes[i], &boxes[i]);
+  }
+  ApplyNMSFast(boxes, scores, score_threshold, nms_threshold, eta, top_k,
+               indices);
+}
+
+void ApplyNMSFast(const vector<BBox>& bboxes,
+      const vector<float>& scores, const float score_threshold,
+      const float nms_threshold, const float eta, const int top_k,
+      vector<int>* indices) {
   // Sanity check.
   CHECK_EQ(bboxes.size(), scores.size())
       << "bboxes and scores have different size.";
@@ -2329,25 +2649,25 @@ void ApplyNMSFast(const vector<NormalizedBBox>& bboxes,
   vector<pair<float, int> > score_index_vec;
   GetMaxScoreIndex(scores, score_threshold, top_k, &score_index_vec);
 
-  // Do nms.
+  // Do nms. Bboxes without overlap never suppress each other, unless the
+  // threshold is negative, so only the kept ones sharing a cell are tested.
+  NMSGrid grid;
+  grid.Reset(bboxes, nms_threshold >= 0 ? score_index_vec.size() : 0);
+  vector<int> neighbors;
   float adaptive_threshold = nms_threshold;
   indices->clear();
-  while (score_index_vec.size() != 0) {
-    const int idx = score_index_vec.front().second;
+  for (int i = 0; i < score_index_vec.size(); ++i) {
+    const int idx = score_index_vec[i].second;
+    grid.Query(bboxes[idx], &neighbors);
     bool keep = true;
-    for (int k = 0; k < indices->size(); ++k) {
-      if (keep) {
-        const int kept_idx = (*indices)[k];
-        float overlap = JaccardOverlap(bboxes[idx], bboxes[kept_idx]);
-        keep = overlap <= adaptive_threshold;
-      } else {
-        break;
-      }
+    for (int k = 0; k < neighbors.size() && keep; ++k) {
+      float overlap = JaccardOverlap(bboxes[idx], bboxes[neighbors[k]]);
+      keep = overlap <= adaptive_threshold;
     }
     if (keep) {
       indices->push_back(idx);
+      grid.Insert(bboxes[idx], idx);
     }
-    score_index_vec.erase(score_index_vec.begin());
     if (keep && eta < 1 && adaptive_threshold > 0.5) {
       adaptive_threshold *= eta;
     }
@@ -2365,22 +2685,17 @@ void ApplyNMSFast(const Dtype* bboxes, const Dtype* scores, const int num,
   // Do nms.
   float adaptive_threshold = nms_threshold;
   indices->clear();
-  while (score_index_vec.size() != 0) {
-    const int idx = score_index_vec.front().second;
+  for (int i = 0; i < score_index_vec.size(); ++i) {
+    const int idx = score_index_vec[i].second;
     bool keep = true;
-    for (int k = 0; k < indices->size(); ++k) {
-      if (keep) {
-        const int kept_idx = (*indices)[k];
-        float overlap = JaccardOverlap(bboxes + idx * 4, bboxes + kept_idx * 4);
-        keep = overlap <= adaptive_threshold;
-      } else {
-        break;
-      }
+    for (int k = 0; k < indices->size() && keep; ++k) {
+      const int kept_idx = (*indices)[k];
+      float overlap = JaccardOverlap(bboxes + idx * 4, bboxes + kept_idx * 4);
+      keep = overlap <= adaptive_threshold;
     }
     if (keep) {
       indices->push_back(idx);
     }
-    score_index_vec.erase(score_index_vec.begin());
     if (keep && eta < 1 && adaptive_threshold > 0.5) {
       adaptive_threshold *= eta;
     }
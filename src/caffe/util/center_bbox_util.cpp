@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <csignal>
 #include <ctime>
 #include <functional>
@@ -9,10 +10,13 @@
 #include <vector>
 
 #include "boost/iterator/counting_iterator.hpp"
+#include "boost/ref.hpp"
 
 #include "caffe/util/bbox_util.hpp"
 #include "caffe/util/center_util.hpp"
 #include "caffe/util/center_bbox_util.hpp"
+#include "caffe/util/nms_grid.hpp"
+#include "caffe/util/simd.hpp"
 
 #define GET_VALID_VALUE(value, min, max) ((((value) >= (min) ? (value) : (min)) < (max) ? ((value) >= (min) ? (value) : (min)): (max)))
 
@@ -21,18 +25,84 @@ int count_gt = 0;
 int count_one = 0;
 namespace caffe {
 template <typename Dtype>
-void _nms_heatmap(const Dtype* conf_data, Dtype* keep_max_data, const int output_height
-                  , const int output_width, const int channels, const int num_batch){
-    int dim = num_batch * channels * output_height * output_width;
-    for(int ii = 0; ii < dim; ii++){
-        keep_max_data[ii] = (keep_max_data[ii] == conf_data[ii]) ? keep_max_data[ii] : Dtype(0.);
-    }
+void _nms_heatmap(const Dtype* conf_data, const int output_height, const int output_width
+                  , const int channels, const int num_batch, Dtype conf_thresh
+                  , std::vector<int>* peaks){
+    peaks->clear();
+    caffe_cpu_heatmap_peaks(num_batch * channels, output_height, output_width, conf_data,
+                            conf_thresh, peaks);
+}
+template void _nms_heatmap(const float* conf_data, const int output_height, const int output_width
+                  , const int channels, const int num_batch, float conf_thresh
+                  , std::vector<int>* peaks);
+template void _nms_heatmap(const double* conf_data, const int output_height, const int output_width
+                  , const int channels, const int num_batch, double conf_thresh
+                  , std::vector<int>* peaks);
+
+
+// Orders bboxes by descending score, and by index among equal scores.
+static inline bool bbox_score_before(const std::vector<BBox>& input, int a, int b){
+    return input[a].score > input[b].score ||
+        (input[a].score == input[b].score && a < b);
 }
-template void _nms_heatmap(const float* conf_data, float* keep_max_data, const int output_height
-                  , const int output_width, const int channels, const int num_batch);
-template void _nms_heatmap(const double* conf_data, double* keep_max_data, const int output_height
-                  , const int output_width, const int channels, const int num_batch);
 
+// Greedy nms of the pixel bboxes in input by descending score, the size of
+// the bboxes holds their area. The bboxes are popped from a heap, so only
+// the ones visited before max_picked bboxes are kept get ordered.
+static void hard_nms_heap(const std::vector<BBox>& input, std::vector<int>* picked,
+                          float nmsthreshold, int type, int max_picked){
+    picked->clear();
+    const int num_boxes = input.size();
+    std::vector<int> heap(num_boxes);
+    for (int i = 0; i < num_boxes; ++i) {
+        heap[i] = i;
+    }
+    // The heap has the first bbox to visit on top.
+    auto after = [&input](int a, int b)
+        {
+            return bbox_score_before(input, b, a);
+        };
+    std::make_heap(heap.begin(), heap.end(), after);
+    // Bboxes more than a pixel apart have no overlap and never suppress each
+    // other, unless the threshold is negative or an overlap is 0 / 0.
+    bool use_grid = nmsthreshold >= 0;
+    for (int i = 0; i < input.size() && use_grid; ++i) {
+        use_grid = input[i].size > 0 && std::isfinite(input[i].size);
+    }
+    NMSGrid grid;
+    grid.Reset(input, use_grid ? num_boxes : 0, 1);
+    std::vector<int> neighbors;
+    while (!heap.empty() && (max_picked < 0 || picked->size() < max_picked)) {
+        std::pop_heap(heap.begin(), heap.end(), after);
+        const int index = heap.back();
+        heap.pop_back();
+        const BBox& box = input[index];
+        grid.Query(box, &neighbors);
+        bool keep = true;
+        for (int k = 0; k < neighbors.size() && keep; ++k) {
+            const BBox& kept = input[neighbors[k]];
+            float maxX = std::max(box.xmin, kept.xmin);
+            float maxY = std::max(box.ymin, kept.ymin);
+            float minX = std::min(box.xmax, kept.xmax);
+            float minY = std::min(box.ymax, kept.ymax);
+            //maxX1 and maxY1 reuse 
+            maxX = ((minX - maxX + 1) > 0) ? (minX - maxX + 1) : 0;
+            maxY = ((minY - maxY + 1) > 0) ? (minY - maxY + 1) : 0;
+            //IOU reuse for the area of two bbox
+            float IOU = maxX * maxY;
+            if (type == NMS_UNION)
+                IOU = IOU / (box.size + kept.size - IOU);
+            else if (type == NMS_MIN) {
+                IOU = IOU / ((box.size < kept.size) ? box.size : kept.size);
+            }
+            keep = IOU <= nmsthreshold;
+        }
+        if (keep) {
+            picked->push_back(index);
+            grid.Insert(box, index);
+        }
+    }
+}
 
 void hard_nms(std::vector<CenterNetInfo>& input, std::vector<CenterNetInfo>* output, float nmsthreshold,int type){
 	if (input.empty()) {
@@ -44,53 +114,30 @@ void hard_nms(std::vector<CenterNetInfo>& input, std::vector<CenterNetInfo>* out
 			return a.score() > b.score();
 		});
 
-	float IOU = 0.f;
-	float maxX = 0.f;
-	float maxY = 0.f;
-	float minX = 0.f;
-	float minY = 0.f;
-	std::vector<int> vPick;
-	std::vector<pair<float, int> > vScores;
 	const int num_boxes = input.size();
+	std::vector<BBox> boxes(num_boxes);
 	for (int i = 0; i < num_boxes; ++i) {
-		vScores.push_back(std::pair<float, int>(input[i].score(), i));
+		boxes[i].xmin = input[i].xmin();
+		boxes[i].ymin = input[i].ymin();
+		boxes[i].xmax = input[i].xmax();
+		boxes[i].ymax = input[i].ymax();
+		boxes[i].label = input[i].class_id();
+		boxes[i].score = input[i].score();
+		boxes[i].size = input[i].area();
 	}
-
-    while (vScores.size() != 0) {
-        const int idx = vScores.front().second;
-        bool keep = true;
-        for (int k = 0; k < vPick.size(); ++k) {
-            if (keep) {
-                const int kept_idx = vPick[k];
-                maxX = std::max(input[idx].xmin(), input[kept_idx].xmin());
-                maxY = std::max(input[idx].ymin(), input[kept_idx].ymin());
-                minX = std::min(input[idx].xmax(), input[kept_idx].xmax());
-                minY = std::min(input[idx].ymax(), input[kept_idx].ymax());
-                //maxX1 and maxY1 reuse 
-                maxX = ((minX - maxX + 1) > 0) ? (minX - maxX + 1) : 0;
-                maxY = ((minY - maxY + 1) > 0) ? (minY - maxY + 1) : 0;
-                //IOU reuse for the area of two bbox
-                IOU = maxX * maxY;
-                if (type==NMS_UNION)
-                    IOU = IOU / (input[idx].area() + input[kept_idx].area() - IOU);
-                else if (type == NMS_MIN) {
-                    IOU = IOU / ((input[idx].area() < input[kept_idx].area()) ? input[idx].area() : input[kept_idx].area());
-                }
-                keep = IOU <= nmsthreshold;
-            } else {
-                break;
-            }
-        }
-        if (keep) {
-            vPick.push_back(idx);
-        }
-        vScores.erase(vScores.begin());
-    }
+	// input is sorted, so the bboxes are visited in order.
+	std::vector<int> vPick;
+	hard_nms_heap(boxes, &vPick, nmsthreshold, type, -1);
 	for (unsigned i = 0; i < vPick.size(); i++) {
 		output->push_back(input[vPick[i]]);
 	}
 }
 
+void hard_nms(const std::vector<BBox>& input, std::vector<int>* picked, float nmsthreshold, int type,
+              int max_picked){
+    hard_nms_heap(input, picked, nmsthreshold, type, max_picked);
+}
+
 
 void soft_nms(std::vector<CenterNetInfo>& input, std::vector<CenterNetInfo>* output, 
                         float sigma, float Nt, 
@@ -465,117 +512,203 @@ template void CopyDiffToBottom(const double* pre_offset_diff, const double* pre_
                                 const std::map<int, vector<std::pair<NormalizedBBox, AnnoFaceLandmarks> > >& all_gt_bboxes);
 
 
+// A detection decoded from one cell of the CenterNet output, in input
+// pixels. loc points at the offset x of the cell, the other channels of the
+// cell follow every dimScale values.
 template <typename Dtype>
-void get_topK(const Dtype* keep_max_data, const Dtype* loc_data, const int output_height
-                  , const int output_width, const int classes, const int num_batch
-                  , std::map<int, std::vector<CenterNetInfo > >* results
-                  , const int loc_channels, bool has_lm,  Dtype conf_thresh, Dtype nms_thresh){
-    std::vector<CenterNetInfo > batch_result;
-    int dim = classes * output_width * output_height;
-    int dimScale = output_width * output_height;
-    if(has_lm){
-        CHECK_EQ(loc_channels, 14);
-    }else{
-        CHECK_EQ(loc_channels, 4);
-    }
-    for(int i = 0; i < num_batch; i++){
-        std::vector<CenterNetInfo > batch_temp;
-        batch_result.clear();
-        for(int c = 0 ; c < classes; c++){
-            for(int h = 0; h < output_height; h++){
-                for(int w = 0; w < output_width; w++){
-                    int index = i * dim + c * dimScale + h * output_width + w;
-                    if(keep_max_data[index] > conf_thresh && keep_max_data[index] < 1){
-                        int x_index = i * loc_channels * dimScale + 0 * dimScale + h * output_width + w;
-                        int y_index = i * loc_channels * dimScale + 1 * dimScale + h * output_width + w;
-                        int w_index = i * loc_channels * dimScale + 2 * dimScale + h * output_width + w;
-                        int h_index = i * loc_channels * dimScale + 3 * dimScale + h * output_width + w;
-                        Dtype center_x = (w + loc_data[x_index]) * 4;
-                        Dtype center_y = (h + loc_data[y_index]) * 4;
-                        Dtype width = std::exp(loc_data[w_index]) * 4 ;
-                        Dtype height = std::exp(loc_data[h_index]) * 4 ;
-                        Dtype xmin = GET_VALID_VALUE((center_x - Dtype(width / 2)), Dtype(0.f), Dtype(4 * output_width));
-                        Dtype xmax = GET_VALID_VALUE((center_x + Dtype(width / 2)), Dtype(0.f), Dtype(4 * output_width));
-                        Dtype ymin = GET_VALID_VALUE((center_y - Dtype(height / 2)), Dtype(0.f), Dtype(4 * output_height));
-                        Dtype ymax = GET_VALID_VALUE((center_y + Dtype(height / 2)), Dtype(0.f), Dtype(4 * output_height));
-
-                        CenterNetInfo temp_result;
-                        temp_result.set_class_id(c);
-                        temp_result.set_score(keep_max_data[index]);
-                        temp_result.set_xmin(xmin);
-                        temp_result.set_xmax(xmax);
-                        temp_result.set_ymin(ymin);
-                        temp_result.set_ymax(ymax);
-                        temp_result.set_area(width * height);
+struct CenterNetCell {
+    Dtype center_x, center_y, width, height;
+    Dtype xmin, ymin, xmax, ymax;
+};
 
-                        if(has_lm){
-                            int le_x_index =  i * loc_channels * dimScale + 4 * dimScale + h * output_width + w;
-                            int le_y_index =  i * loc_channels * dimScale + 5 * dimScale + h * output_width + w;
-                            int re_x_index =  i * loc_channels * dimScale + 6 * dimScale + h * output_width + w;
-                            int re_y_index =  i * loc_channels * dimScale + 7 * dimScale + h * output_width + w;
-                            int no_x_index =  i * loc_channels * dimScale + 8 * dimScale + h * output_width + w;
-                            int no_y_index =  i * loc_channels * dimScale + 9 * dimScale + h * output_width + w;
-                            int lm_x_index =  i * loc_channels * dimScale + 10 * dimScale + h * output_width + w;
-                            int lm_y_index =  i * loc_channels * dimScale + 11 * dimScale + h * output_width + w;
-                            int rm_x_index =  i * loc_channels * dimScale + 12 * dimScale + h * output_width + w;
-                            int rm_y_index =  i * loc_channels * dimScale + 13 * dimScale + h * output_width + w;
-
-                            Dtype bbox_width = xmax - xmin;
-                            Dtype bbox_height = ymax - ymin;
-
-                            Dtype le_x = GET_VALID_VALUE((center_x + loc_data[le_x_index] * bbox_width) * 4, Dtype(0.f), Dtype(4 * output_width));
-                            Dtype le_y = GET_VALID_VALUE((center_y + loc_data[le_y_index] * bbox_height) * 4, Dtype(0.f),Dtype(4 * output_height));
-                            Dtype re_x = GET_VALID_VALUE((center_x + loc_data[re_x_index] * bbox_width) * 4, Dtype(0.f), Dtype(4 * output_width));
-                            Dtype re_y = GET_VALID_VALUE((center_y + loc_data[re_y_index] * bbox_height) * 4, Dtype(0.f),Dtype(4 * output_height));
-                            Dtype no_x = GET_VALID_VALUE((center_x + loc_data[no_x_index] * bbox_width) * 4, Dtype(0.f), Dtype(4 * output_width));
-                            Dtype no_y = GET_VALID_VALUE((center_y + loc_data[no_y_index] * bbox_height) * 4, Dtype(0.f),Dtype(4 * output_height));
-                            Dtype lm_x = GET_VALID_VALUE((center_x + loc_data[lm_x_index] * bbox_width) * 4, Dtype(0.f), Dtype(4 * output_width));
-                            Dtype lm_y = GET_VALID_VALUE((center_y + loc_data[lm_y_index] * bbox_height) * 4, Dtype(0.f),Dtype(4 * output_height));
-                            Dtype rm_x = GET_VALID_VALUE((center_x + loc_data[rm_x_index] * bbox_width) * 4, Dtype(0.f), Dtype(4 * output_width));
-                            Dtype rm_y = GET_VALID_VALUE((center_y + loc_data[rm_y_index] * bbox_height) * 4, Dtype(0.f),Dtype(4 * output_height));
-
-                            temp_result.mutable_marks()->mutable_lefteye()->set_x(le_x);
-                            temp_result.mutable_marks()->mutable_lefteye()->set_y(le_y);
-                            temp_result.mutable_marks()->mutable_righteye()->set_x(re_x);
-                            temp_result.mutable_marks()->mutable_righteye()->set_y(re_y);
-                            temp_result.mutable_marks()->mutable_nose()->set_x(no_x);
-                            temp_result.mutable_marks()->mutable_nose()->set_y(no_y);
-                            temp_result.mutable_marks()->mutable_leftmouth()->set_x(lm_x);
-                            temp_result.mutable_marks()->mutable_leftmouth()->set_y(lm_y);
-                            temp_result.mutable_marks()->mutable_rightmouth()->set_x(rm_x);
-                            temp_result.mutable_marks()->mutable_rightmouth()->set_y(rm_y);
-                        }
-                        batch_temp.push_back(temp_result);
-                    } 
+template <typename Dtype>
+static void DecodeCenterNetCell(const Dtype* loc, const int dimScale, const int h,
+                                const int w, const int output_height, const int output_width,
+                                CenterNetCell<Dtype>* cell){
+    cell->center_x = (w + loc[0]) * 4;
+    cell->center_y = (h + loc[dimScale]) * 4;
+    cell->width = std::exp(loc[2 * dimScale]) * 4 ;
+    cell->height = std::exp(loc[3 * dimScale]) * 4 ;
+    cell->xmin = GET_VALID_VALUE((cell->center_x - Dtype(cell->width / 2)), Dtype(0.f), Dtype(4 * output_width));
+    cell->xmax = GET_VALID_VALUE((cell->center_x + Dtype(cell->width / 2)), Dtype(0.f), Dtype(4 * output_width));
+    cell->ymin = GET_VALID_VALUE((cell->center_y - Dtype(cell->height / 2)), Dtype(0.f), Dtype(4 * output_height));
+    cell->ymax = GET_VALID_VALUE((cell->center_y + Dtype(cell->height / 2)), Dtype(0.f), Dtype(4 * output_height));
+}
+
+// Decodes the detections of the images of a batch, the images are
+// independent and each one only writes its own results.
+template <typename Dtype>
+class CenterNetImageDecoder {
+ public:
+    CenterNetImageDecoder(const Dtype* keep_max_data, const Dtype* loc_data, const int output_height
+                  , const int output_width, const int classes, const int loc_channels, bool has_lm
+                  , Dtype conf_thresh, Dtype nms_thresh, const int top_k, bool nms_heatmap
+                  , std::vector<std::vector<CenterNetInfo> >* batch_results)
+        : keep_max_data_(keep_max_data), loc_data_(loc_data), output_height_(output_height),
+          output_width_(output_width), classes_(classes), loc_channels_(loc_channels),
+          has_lm_(has_lm), conf_thresh_(conf_thresh), nms_thresh_(nms_thresh), top_k_(top_k),
+          nms_heatmap_(nms_heatmap), batch_results_(batch_results) {}
+
+    void operator()(int i, int worker_id) const {
+        const int output_height = output_height_;
+        const int output_width = output_width_;
+        const int classes = classes_;
+        const bool has_lm = has_lm_;
+        const Dtype conf_thresh = conf_thresh_;
+        int dimScale = output_width * output_height;
+        const Dtype* batch_keep_max_data = keep_max_data_ + i * classes * dimScale;
+        const Dtype* batch_loc_data = loc_data_ + i * loc_channels_ * dimScale;
+        // The candidates are kept as plain bboxes with the cell they come from,
+        // only the ones kept by the nms are turned into CenterNetInfo.
+        std::vector<BBox> batch_temp;
+        std::vector<int> batch_cells;
+        std::vector<int> picked;
+        std::vector<CenterNetInfo>& batch_result = (*batch_results_)[i];
+        batch_result.clear();
+        // Indices c * dimScale + h * output_width + w of the candidate cells,
+        // either the 3x3 peaks or every cell above the threshold.
+        std::vector<int> candidates;
+        if(nms_heatmap_){
+            _nms_heatmap(batch_keep_max_data, output_height, output_width, classes, 1,
+                         conf_thresh, &candidates);
+        }else{
+            for(int index = 0; index < classes * dimScale; index++){
+                if(batch_keep_max_data[index] > conf_thresh){
+                    candidates.push_back(index);
                 }
             }
         }
-        
-        hard_nms(batch_temp, &batch_result, nms_thresh);
+        for(int k = 0; k < candidates.size(); k++){
+            const int index = candidates[k];
+            if(batch_keep_max_data[index] < 1){
+                const int c = index / dimScale;
+                const int cell_index = index % dimScale;
+                CenterNetCell<Dtype> cell;
+                DecodeCenterNetCell(batch_loc_data + cell_index, dimScale, cell_index / output_width,
+                                    cell_index % output_width, output_height, output_width, &cell);
+                BBox temp_result;
+                temp_result.label = c;
+                temp_result.score = batch_keep_max_data[index];
+                temp_result.xmin = cell.xmin;
+                temp_result.xmax = cell.xmax;
+                temp_result.ymin = cell.ymin;
+                temp_result.ymax = cell.ymax;
+                temp_result.size = cell.width * cell.height;
+                batch_temp.push_back(temp_result);
+                batch_cells.push_back(cell_index);
+            }
+        }
+
+        // The nms visits the candidates by descending score, so it stops
+        // once the top_k best detections are kept.
+        hard_nms(batch_temp, &picked, nms_thresh_, NMS_UNION, top_k_);
+        batch_result.resize(picked.size());
+        for(unsigned j = 0 ; j < picked.size(); j++){
+            const BBox& bbox = batch_temp[picked[j]];
+            CenterNetInfo& temp_result = batch_result[j];
+            temp_result.set_class_id(bbox.label);
+            temp_result.set_score(bbox.score);
+            temp_result.set_xmin(bbox.xmin);
+            temp_result.set_xmax(bbox.xmax);
+            temp_result.set_ymin(bbox.ymin);
+            temp_result.set_ymax(bbox.ymax);
+            temp_result.set_area(bbox.size);
+            if(has_lm){
+                const int cell_index = batch_cells[picked[j]];
+                const Dtype* cell_loc_data = batch_loc_data + cell_index;
+                CenterNetCell<Dtype> cell;
+                DecodeCenterNetCell(cell_loc_data, dimScale, cell_index / output_width,
+                                    cell_index % output_width, output_height, output_width, &cell);
+                const Dtype center_x = cell.center_x;
+                const Dtype center_y = cell.center_y;
+                Dtype bbox_width = cell.xmax - cell.xmin;
+                Dtype bbox_height = cell.ymax - cell.ymin;
+
+                Dtype le_x = GET_VALID_VALUE((center_x + cell_loc_data[4 * dimScale] * bbox_width) * 4, Dtype(0.f), Dtype(4 * output_width));
+                Dtype le_y = GET_VALID_VALUE((center_y + cell_loc_data[5 * dimScale] * bbox_height) * 4, Dtype(0.f),Dtype(4 * output_height));
+                Dtype re_x = GET_VALID_VALUE((center_x + cell_loc_data[6 * dimScale] * bbox_width) * 4, Dtype(0.f), Dtype(4 * output_width));
+                Dtype re_y = GET_VALID_VALUE((center_y + cell_loc_data[7 * dimScale] * bbox_height) * 4, Dtype(0.f),Dtype(4 * output_height));
+                Dtype no_x = GET_VALID_VALUE((center_x + cell_loc_data[8 * dimScale] * bbox_width) * 4, Dtype(0.f), Dtype(4 * output_width));
+                Dtype no_y = GET_VALID_VALUE((center_y + cell_loc_data[9 * dimScale] * bbox_height) * 4, Dtype(0.f),Dtype(4 * output_height));
+                Dtype lm_x = GET_VALID_VALUE((center_x + cell_loc_data[10 * dimScale] * bbox_width) * 4, Dtype(0.f), Dtype(4 * output_width));
+                Dtype lm_y = GET_VALID_VALUE((center_y + cell_loc_data[11 * dimScale] * bbox_height) * 4, Dtype(0.f),Dtype(4 * output_height));
+                Dtype rm_x = GET_VALID_VALUE((center_x + cell_loc_data[12 * dimScale] * bbox_width) * 4, Dtype(0.f), Dtype(4 * output_width));
+                Dtype rm_y = GET_VALID_VALUE((center_y + cell_loc_data[13 * dimScale] * bbox_height) * 4, Dtype(0.f),Dtype(4 * output_height));
+
+                temp_result.mutable_marks()->mutable_lefteye()->set_x(le_x);
+                temp_result.mutable_marks()->mutable_lefteye()->set_y(le_y);
+                temp_result.mutable_marks()->mutable_righteye()->set_x(re_x);
+                temp_result.mutable_marks()->mutable_righteye()->set_y(re_y);
+                temp_result.mutable_marks()->mutable_nose()->set_x(no_x);
+                temp_result.mutable_marks()->mutable_nose()->set_y(no_y);
+                temp_result.mutable_marks()->mutable_leftmouth()->set_x(lm_x);
+                temp_result.mutable_marks()->mutable_leftmouth()->set_y(lm_y);
+                temp_result.mutable_marks()->mutable_rightmouth()->set_x(rm_x);
+                temp_result.mutable_marks()->mutable_rightmouth()->set_y(rm_y);
+            }
+        }
         for(unsigned j = 0 ; j < batch_result.size(); j++){
             batch_result[j].set_xmin(batch_result[j].xmin() / (4 * output_width));
             batch_result[j].set_xmax(batch_result[j].xmax() / (4 * output_width));
             batch_result[j].set_ymin(batch_result[j].ymin() / (4 * output_height));
             batch_result[j].set_ymax(batch_result[j].ymax() / (4 * output_height));
         }
-        
-        if(batch_result.size() > 0){
-            if(results->find(i) == results->end()){
-                results->insert(std::make_pair(i, batch_result));
-            }else{
+    }
 
-            }
+ protected:
+    const Dtype* keep_max_data_;
+    const Dtype* loc_data_;
+    int output_height_;
+    int output_width_;
+    int classes_;
+    int loc_channels_;
+    bool has_lm_;
+    Dtype conf_thresh_;
+    Dtype nms_thresh_;
+    int top_k_;
+    bool nms_heatmap_;
+    // Results of image i go to element i.
+    std::vector<std::vector<CenterNetInfo> >* batch_results_;
+};
+
+template <typename Dtype>
+void get_topK(const Dtype* keep_max_data, const Dtype* loc_data, const int output_height
+                  , const int output_width, const int classes, const int num_batch
+                  , std::map<int, std::vector<CenterNetInfo > >* results
+                  , const int loc_channels, bool has_lm,  Dtype conf_thresh, Dtype nms_thresh
+                  , const int top_k, ThreadPool* pool, bool nms_heatmap){
+    if(has_lm){
+        CHECK_EQ(loc_channels, 14);
+    }else{
+        CHECK_EQ(loc_channels, 4);
+    }
+    std::vector<std::vector<CenterNetInfo> > batch_results(num_batch);
+    CenterNetImageDecoder<Dtype> decoder(keep_max_data, loc_data, output_height, output_width,
+                                         classes, loc_channels, has_lm, conf_thresh, nms_thresh,
+                                         top_k, nms_heatmap, &batch_results);
+    if(pool){
+        pool->Run(num_batch, boost::ref(decoder));
+    }else{
+        for(int i = 0; i < num_batch; i++){
+            decoder(i, 0);
+        }
+    }
+    for(int i = 0; i < num_batch; i++){
+        if(batch_results[i].size() > 0 && results->find(i) == results->end()){
+            results->insert(std::make_pair(i, batch_results[i]));
         }
     }
 }
 template  void get_topK(const float* keep_max_data, const float* loc_data, const int output_height
                   , const int output_width, const int classes, const int num_batch
                   , std::map<int, std::vector<CenterNetInfo > >* results
-                  , const int loc_channels, bool has_lm, float conf_thresh, float nms_thresh);
+                  , const int loc_channels, bool has_lm, float conf_thresh, float nms_thresh
+                  , const int top_k, ThreadPool* pool, bool nms_heatmap);
 template void get_topK(const double* keep_max_data, const double* loc_data, const int output_height
                   , const int output_width, const int classes, const int num_batch
                   , std::map<int, std::vector<CenterNetInfo > >* results
-                  , const int loc_channels, bool has_lm, double conf_thresh, double nms_thresh);
+                  , const int loc_channels, bool has_lm, double conf_thresh, double nms_thresh
+                  , const int top_k, ThreadPool* pool, bool nms_heatmap);
 
 
 
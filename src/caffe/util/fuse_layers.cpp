@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/fuse_layers.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+namespace caffe {
+
+typedef vector<shared_ptr<Blob<double> > > DoubleBlobs;
+
+// Per channel y = x * scale + shift that the folded layers apply to the
+// output of the convolution.
+struct ChannelAffine {
+  vector<double> scale;
+  vector<double> shift;
+};
+
+// Index of the first layer of param named name, or -1.
+static int FindLayer(const NetParameter& param, const string& name) {
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (param.layer(i).name() == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Whether a layer after layer_id reads blob_name before it is written again.
+static bool ReadLater(const NetParameter& param, const int layer_id,
+    const string& blob_name) {
+  for (int i = layer_id + 1; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    for (int j = 0; j < layer.bottom_size(); ++j) {
+      if (layer.bottom(j) == blob_name) {
+        return true;
+      }
+    }
+    for (int j = 0; j < layer.top_size(); ++j) {
+      if (layer.top(j) == blob_name) {
+        return false;
+      }
+    }
+  }
+  return false;
+}
+
+// Whether layer_id only reads blob_name and is its only reader, so that it
+// can be folded into the layer that writes blob_name.
+static bool OnlyReader(const NetParameter& param, const int layer_id,
+    const string& blob_name) {
+  const LayerParameter& layer = param.layer(layer_id);
+  return layer.bottom_size() == 1 && layer.bottom(0) == blob_name &&
+      layer.top_size() == 1 && layer.include_size() == 0 &&
+      layer.exclude_size() == 0 && layer.loss_weight_size() == 0 &&
+      (layer.top(0) == blob_name || !ReadLater(param, layer_id, blob_name));
+}
+
+static bool LoadBlobs(const NetParameter& weights, const string& layer_name,
+    const int num_blobs, DoubleBlobs* blobs) {
+  const int layer_id = FindLayer(weights, layer_name);
+  if (layer_id < 0 || weights.layer(layer_id).blobs_size() != num_blobs) {
+    return false;
+  }
+  blobs->clear();
+  for (int i = 0; i < num_blobs; ++i) {
+    blobs->push_back(shared_ptr<Blob<double> >(new Blob<double>()));
+    blobs->back()->FromProto(weights.layer(layer_id).blobs(i));
+  }
+  return true;
+}
+
+// Folds (x - mean) / sqrt(variance + eps), with the moving averages stored
+// by BatchNorm and BatchNormScale in their first three blobs.
+static bool FoldBatchNorm(const DoubleBlobs& blobs, const double eps,
+    ChannelAffine* affine) {
+  const int channels = affine->scale.size();
+  if (blobs[0]->count() != channels || blobs[1]->count() != channels ||
+      blobs[2]->count() != 1) {
+    return false;
+  }
+  const double factor = blobs[2]->cpu_data()[0] == 0 ?
+      0 : 1 / blobs[2]->cpu_data()[0];
+  for (int c = 0; c < channels; ++c) {
+    const double mean = blobs[0]->cpu_data()[c] * factor;
+    const double inv_std =
+        1 / std::sqrt(blobs[1]->cpu_data()[c] * factor + eps);
+    affine->scale[c] *= inv_std;
+    affine->shift[c] = (affine->shift[c] - mean) * inv_std;
+  }
+  return true;
+}
+
+// Folds x * scale + bias, either of which may be NULL.
+static void FoldScale(const double* scale, const double* bias,
+    ChannelAffine* affine) {
+  for (int c = 0; c < affine->scale.size(); ++c) {
+    if (scale) {
+      affine->scale[c] *= scale[c];
+      affine->shift[c] *= scale[c];
+    }
+    if (bias) {
+      affine->shift[c] += bias[c];
+    }
+  }
+}
+
+// Folds a per channel affine layer into affine, or returns false if layer
+// is not one.
+static bool FoldAffineLayer(const LayerParameter& layer,
+    const NetParameter& weights, ChannelAffine* affine) {
+  const int channels = affine->scale.size();
+  DoubleBlobs blobs;
+  if (layer.type() == "BatchNorm" || layer.type() == "BatchNormScale") {
+    const BatchNormParameter& bn_param = layer.batch_norm_param();
+    if (bn_param.has_use_global_stats() && !bn_param.use_global_stats()) {
+      return false;
+    }
+    if (layer.type() == "BatchNorm") {
+      return LoadBlobs(weights, layer.name(), 3, &blobs) &&
+          FoldBatchNorm(blobs, bn_param.eps(), affine);
+    }
+    // BatchNormScale only scales the normalized values when in place.
+    if (layer.top(0) != layer.bottom(0) ||
+        !LoadBlobs(weights, layer.name(), 5, &blobs) ||
+        blobs[3]->count() != channels || blobs[4]->count() != channels ||
+        !FoldBatchNorm(blobs, bn_param.eps(), affine)) {
+      return false;
+    }
+    FoldScale(blobs[3]->cpu_data(), blobs[4]->cpu_data(), affine);
+    return true;
+  } else if (layer.type() == "Scale") {
+    const ScaleParameter& scale_param = layer.scale_param();
+    const int num_blobs = 1 + scale_param.bias_term();
+    if (scale_param.axis() != 1 || scale_param.num_axes() != 1 ||
+        !LoadBlobs(weights, layer.name(), num_blobs, &blobs) ||
+        blobs[0]->count() != channels ||
+        blobs[num_blobs - 1]->count() != channels) {
+      return false;
+    }
+    double* scale = blobs[0]->mutable_cpu_data();
+    for (int c = 0; c < channels; ++c) {
+      if (scale_param.has_min_value()) {
+        scale[c] = std::max<double>(scale[c], scale_param.min_value());
+      }
+      if (scale_param.has_max_value()) {
+        scale[c] = std::min<double>(scale[c], scale_param.max_value());
+      }
+    }
+    FoldScale(scale, scale_param.bias_term() ? blobs[1]->cpu_data() : NULL,
+        affine);
+    return true;
+  } else if (layer.type() == "Bias") {
+    const BiasParameter& bias_param = layer.bias_param();
+    if (bias_param.axis() != 1 || bias_param.num_axes() != 1 ||
+        !LoadBlobs(weights, layer.name(), 1, &blobs) ||
+        blobs[0]->count() != channels) {
+      return false;
+    }
+    FoldScale(NULL, blobs[0]->cpu_data(), affine);
+    return true;
+  }
+  return false;
+}
+
+// Sets the activation of conv_param to layer, or returns false if layer is
+// not an activation.
+static bool FoldActivation(const LayerParameter& layer,
+    ConvolutionParameter* conv_param) {
+  if (layer.type() == "ReLU") {
+    conv_param->set_activation(ConvolutionParameter_Activation_RELU);
+    conv_param->set_negative_slope(layer.relu_param().negative_slope());
+    return true;
+  } else if (layer.type() == "ReLU6") {
+    conv_param->set_activation(ConvolutionParameter_Activation_RELU6);
+    conv_param->set_negative_slope(layer.relu6_param().negative_slope());
+    return true;
+  }
+  return false;
+}
+
+static void WriteBlob(const Blob<double>& source, BlobProto* proto) {
+  Blob<float> blob(source.shape());
+  float* data = blob.mutable_cpu_data();
+  for (int i = 0; i < blob.count(); ++i) {
+    data[i] = source.cpu_data()[i];
+  }
+  blob.ToProto(proto);
+}
+
+int FuseLayers(const NetParameter& param, const NetParameter& weights,
+    NetParameter* fused_param, NetParameter* fused_weights) {
+  fused_param->CopyFrom(param);
+  fused_param->clear_layer();
+  fused_param->mutable_state()->set_phase(TEST);
+  set<string> folded_layers;
+  map<string, LayerParameter> fused_convs;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    LayerParameter* fused_layer = fused_param->add_layer();
+    fused_layer->CopyFrom(layer);
+    const ConvolutionParameter& conv_param = layer.convolution_param();
+    const int channels = conv_param.num_output();
+    DoubleBlobs conv_blobs;
+    if (layer.type() != "Convolution" || layer.bottom_size() != 1 ||
+        layer.top_size() != 1 || conv_param.axis() != 1 ||
+        conv_param.activation() != ConvolutionParameter_Activation_NONE ||
+        !LoadBlobs(weights, layer.name(), 1 + conv_param.bias_term(),
+            &conv_blobs) ||
+        conv_blobs[0]->num_axes() < 1 || conv_blobs[0]->shape(0) != channels) {
+      continue;
+    }
+    ChannelAffine affine;
+    affine.scale.assign(channels, 1);
+    affine.shift.assign(channels, 0);
+    ConvolutionParameter* fused_conv_param =
+        fused_layer->mutable_convolution_param();
+    string top = layer.top(0);
+    int last = i;
+    for (int j = i + 1; j < param.layer_size() && OnlyReader(param, j, top);
+         ++j) {
+      const LayerParameter& next = param.layer(j);
+      const bool activation = FoldActivation(next, fused_conv_param);
+      if (!activation && !FoldAffineLayer(next, weights, &affine)) {
+        break;
+      }
+      folded_layers.insert(next.name());
+      top = next.top(0);
+      last = j;
+      if (activation) {
+        break;
+      }
+    }
+    if (last == i) {
+      continue;
+    }
+    LOG(INFO) << "Folding " << last - i << " layers into convolution "
+        << layer.name();
+    i = last;
+    fused_layer->set_top(0, top);
+    fused_conv_param->set_bias_term(true);
+    // Only the Caffe engines apply the activation.
+    if (fused_conv_param->activation() !=
+        ConvolutionParameter_Activation_NONE) {
+      fused_conv_param->clear_engine();
+    }
+    // w' = w * scale and b' = b * scale + shift, per output channel.
+    Blob<double>& weight = *conv_blobs[0];
+    const int weight_dim = weight.count() / channels;
+    vector<int> bias_shape(1, channels);
+    Blob<double> bias(bias_shape);
+    for (int c = 0; c < channels; ++c) {
+      double* weight_data = weight.mutable_cpu_data() + c * weight_dim;
+      for (int k = 0; k < weight_dim; ++k) {
+        weight_data[k] *= affine.scale[c];
+      }
+      const double conv_bias =
+          conv_param.bias_term() ? conv_blobs[1]->cpu_data()[c] : 0;
+      bias.mutable_cpu_data()[c] = conv_bias * affine.scale[c] +
+          affine.shift[c];
+    }
+    LayerParameter& conv_weights = fused_convs[layer.name()];
+    conv_weights.CopyFrom(weights.layer(FindLayer(weights, layer.name())));
+    conv_weights.mutable_convolution_param()->CopyFrom(*fused_conv_param);
+    conv_weights.clear_blobs();
+    WriteBlob(weight, conv_weights.add_blobs());
+    WriteBlob(bias, conv_weights.add_blobs());
+    if (fused_layer->blobs_size()) {
+      fused_layer->clear_blobs();
+      fused_layer->mutable_blobs()->CopyFrom(conv_weights.blobs());
+    }
+  }
+  fused_weights->CopyFrom(weights);
+  fused_weights->clear_layer();
+  for (int i = 0; i < weights.layer_size(); ++i) {
+    const LayerParameter& layer = weights.layer(i);
+    map<string, LayerParameter>::iterator conv = fused_convs.find(layer.name());
+    if (conv != fused_convs.end()) {
+      fused_weights->add_layer()->CopyFrom(conv->second);
+      fused_convs.erase(conv);
+    } else if (!folded_layers.count(layer.name())) {
+      fused_weights->add_layer()->CopyFrom(layer);
+    }
+  }
+  return folded_layers.size();
+}
+
+template <typename Dtype>
+shared_ptr<Net<Dtype> > LoadFusedNet(const string& param_file,
+    const string& trained_filename, const int level,
+    const vector<string>* stages) {
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(param_file, &param);
+  param.mutable_state()->set_phase(TEST);
+  if (stages != NULL) {
+    for (int i = 0; i < stages->size(); i++) {
+      param.mutable_state()->add_stage((*stages)[i]);
+    }
+  }
+  param.mutable_state()->set_level(level);
+  NetParameter filtered_param;
+  Net<Dtype>::FilterNet(param, &filtered_param);
+  // The rules of the remaining layers hold for the state, and would keep
+  // FuseLayers from folding them.
+  for (int i = 0; i < filtered_param.layer_size(); ++i) {
+    filtered_param.mutable_layer(i)->clear_include();
+    filtered_param.mutable_layer(i)->clear_exclude();
+  }
+  NetParameter weights;
+  if (trained_filename.size() >= 3 &&
+      trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
+    Net<Dtype> net(filtered_param);
+    net.CopyTrainedLayersFrom(trained_filename);
+    net.ToProto(&weights);
+  } else {
+    ReadNetParamsFromBinaryFileOrDie(trained_filename, &weights);
+  }
+  NetParameter fused_param, fused_weights;
+  const int num_folded =
+      FuseLayers(filtered_param, weights, &fused_param, &fused_weights);
+  LOG(INFO) << "Folded " << num_folded << " layers of " << param_file;
+  shared_ptr<Net<Dtype> > net(new Net<Dtype>(fused_param));
+  net->CopyTrainedLayersFrom(fused_weights);
+  return net;
+}
+
+template shared_ptr<Net<float> > LoadFusedNet(const string& param_file,
+    const string& trained_filename, const int level,
+    const vector<string>* stages);
+template shared_ptr<Net<double> > LoadFusedNet(const string& param_file,
+    const string& trained_filename, const int level,
+    const vector<string>* stages);
+
+}  // namespace caffe
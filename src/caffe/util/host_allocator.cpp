@@ -0,0 +1,258 @@
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "caffe/util/host_allocator.hpp"
+
+namespace caffe {
+
+static const size_t kAlignment = 64;
+// Blocks of each class and bytes a thread caches before returning the blocks
+// it frees to the shared pool.
+static const size_t kThreadCacheBlocks = 4;
+static const size_t kThreadCacheBytes = size_t(64) << 20;
+
+void* SystemHostAllocator::Allocate(size_t size) {
+  void* ptr = malloc(size);
+  CHECK(ptr) << "host allocation of size " << size << " failed";
+  return ptr;
+}
+
+void SystemHostAllocator::Free(void* ptr, size_t size) {
+  free(ptr);
+}
+
+size_t PoolingHostAllocator::BlockSize(size_t size) {
+  if (size <= kAlignment) {
+    return kAlignment;
+  }
+  // 2^p < size <= 2^(p + 1), rounded up to a quarter of 2^p, and at least to
+  // the alignment.
+  int p = 0;
+  while ((size - 1) >> (p + 1)) {
+    ++p;
+  }
+  const size_t step = std::max(kAlignment, size_t(1) << (p - 2));
+  return (size + step - 1) / step * step;
+}
+
+typedef std::map<size_t, std::vector<void*> > BlockLists;
+
+class PoolingHostAllocator::Pool {
+ public:
+  Pool(size_t max_cached_bytes, size_t max_block_size)
+      : max_cached_bytes_(max_cached_bytes), max_block_size_(max_block_size),
+        pooled_bytes_(0), current_bytes_(0), peak_bytes_(0), cached_bytes_(0),
+        allocations_(0), hits_(0) {}
+  ~Pool() {
+    Trim();
+  }
+
+  // Takes a pooled block of block_size, or returns NULL.
+  void* Take(size_t block_size) {
+    boost::mutex::scoped_lock lock(mutex_);
+    BlockLists::iterator it = blocks_.find(block_size);
+    if (it == blocks_.end() || it->second.empty()) {
+      return NULL;
+    }
+    void* ptr = it->second.back();
+    it->second.pop_back();
+    pooled_bytes_ -= block_size;
+    return ptr;
+  }
+
+  // Pools a block, unless the pool is full.
+  bool Put(void* ptr, size_t block_size) {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (pooled_bytes_ + block_size > max_cached_bytes_) {
+      return false;
+    }
+    blocks_[block_size].push_back(ptr);
+    pooled_bytes_ += block_size;
+    return true;
+  }
+
+  void Trim() {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (BlockLists::iterator it = blocks_.begin(); it != blocks_.end();
+         ++it) {
+      for (int i = 0; i < it->second.size(); ++i) {
+        free(it->second[i]);
+      }
+      cached_bytes_ -= it->first * it->second.size();
+    }
+    blocks_.clear();
+    pooled_bytes_ = 0;
+  }
+
+  const size_t max_cached_bytes_;
+  const size_t max_block_size_;
+
+  boost::mutex mutex_;
+  BlockLists blocks_;
+  size_t pooled_bytes_;
+
+  boost::atomic<size_t> current_bytes_;
+  boost::atomic<size_t> peak_bytes_;
+  boost::atomic<size_t> cached_bytes_;
+  boost::atomic<uint64_t> allocations_;
+  boost::atomic<uint64_t> hits_;
+};
+
+class PoolingHostAllocator::ThreadCaches {
+ public:
+  // The blocks a thread freed and reuses without locking. On thread exit they
+  // go back to the pool, which the cache keeps alive.
+  struct Cache {
+    explicit Cache(const shared_ptr<Pool>& pool)
+        : pool(pool), bytes(0) {}
+    ~Cache() {
+      Flush();
+    }
+
+    void* Take(size_t block_size) {
+      BlockLists::iterator it = blocks.find(block_size);
+      if (it == blocks.end() || it->second.empty()) {
+        return NULL;
+      }
+      void* ptr = it->second.back();
+      it->second.pop_back();
+      bytes -= block_size;
+      return ptr;
+    }
+
+    bool Put(void* ptr, size_t block_size) {
+      std::vector<void*>& list = blocks[block_size];
+      if (list.size() >= kThreadCacheBlocks ||
+          bytes + block_size > kThreadCacheBytes) {
+        return false;
+      }
+      list.push_back(ptr);
+      bytes += block_size;
+      return true;
+    }
+
+    void Flush() {
+      for (BlockLists::iterator it = blocks.begin(); it != blocks.end(); ++it) {
+        for (int i = 0; i < it->second.size(); ++i) {
+          if (!pool->Put(it->second[i], it->first)) {
+            free(it->second[i]);
+            pool->cached_bytes_ -= it->first;
+          }
+        }
+      }
+      blocks.clear();
+      bytes = 0;
+    }
+
+    shared_ptr<Pool> pool;
+    BlockLists blocks;
+    size_t bytes;
+  };
+
+  Cache* Get(const shared_ptr<Pool>& pool) {
+    Cache* cache = cache_.get();
+    // A cache left by a destroyed allocator at the same address belongs to
+    // another pool.
+    if (!cache || cache->pool != pool) {
+      cache = new Cache(pool);
+      cache_.reset(cache);
+    }
+    return cache;
+  }
+
+ private:
+  boost::thread_specific_ptr<Cache> cache_;
+};
+
+PoolingHostAllocator::PoolingHostAllocator(size_t max_cached_bytes,
+    size_t max_block_size)
+    : pool_(new Pool(max_cached_bytes, max_block_size)),
+      caches_(new ThreadCaches()) {
+}
+
+PoolingHostAllocator::~PoolingHostAllocator() {
+  Trim();
+}
+
+void* PoolingHostAllocator::Allocate(size_t size) {
+  const size_t block_size = BlockSize(size);
+  ++pool_->allocations_;
+  void* ptr = NULL;
+  if (block_size <= pool_->max_block_size_) {
+    ptr = caches_->Get(pool_)->Take(block_size);
+    if (!ptr) {
+      ptr = pool_->Take(block_size);
+    }
+    if (ptr) {
+      ++pool_->hits_;
+      pool_->cached_bytes_ -= block_size;
+    }
+  }
+  if (!ptr) {
+    CHECK_EQ(posix_memalign(&ptr, kAlignment, block_size), 0)
+        << "host allocation of size " << size << " failed";
+  }
+  const size_t current = (pool_->current_bytes_ += block_size);
+  size_t peak = pool_->peak_bytes_.load();
+  while (current > peak &&
+         !pool_->peak_bytes_.compare_exchange_weak(peak, current)) {
+  }
+  return ptr;
+}
+
+void PoolingHostAllocator::Free(void* ptr, size_t size) {
+  const size_t block_size = BlockSize(size);
+  pool_->current_bytes_ -= block_size;
+  if (block_size <= pool_->max_block_size_) {
+    pool_->cached_bytes_ += block_size;
+    if (caches_->Get(pool_)->Put(ptr, block_size) ||
+        pool_->Put(ptr, block_size)) {
+      return;
+    }
+    pool_->cached_bytes_ -= block_size;
+  }
+  free(ptr);
+}
+
+HostAllocatorStats PoolingHostAllocator::stats() const {
+  HostAllocatorStats stats;
+  stats.current_bytes = pool_->current_bytes_;
+  stats.peak_bytes = pool_->peak_bytes_;
+  stats.cached_bytes = pool_->cached_bytes_;
+  stats.allocations = pool_->allocations_;
+  stats.hits = pool_->hits_;
+  return stats;
+}
+
+void PoolingHostAllocator::Trim() {
+  caches_->Get(pool_)->Flush();
+  pool_->Trim();
+}
+
+// Neither the installed allocators nor the default one are ever destroyed,
+// so memory can be freed during static destruction.
+static boost::atomic<HostAllocator*> host_allocator_(NULL);
+
+void SetHostAllocator(const shared_ptr<HostAllocator>& allocator) {
+  static boost::mutex* mutex = new boost::mutex();
+  static std::vector<shared_ptr<HostAllocator> >* installed =
+      new std::vector<shared_ptr<HostAllocator> >();
+  boost::mutex::scoped_lock lock(*mutex);
+  if (allocator) {
+    installed->push_back(allocator);
+  }
+  host_allocator_.store(allocator.get());
+}
+
+HostAllocator* GetHostAllocator() {
+  static HostAllocator* system_allocator = new SystemHostAllocator();
+  HostAllocator* allocator = host_allocator_.load();
+  return allocator ? allocator : system_allocator;
+}
+
+}  // namespace caffe
@@ -768,49 +768,155 @@ void RandomOrderChannels(const cv::Mat& in_img, cv::Mat* out_img,
   }
 }
 
-cv::Mat ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param) {
-  cv::Mat out_img = in_img;
-  float prob;
-  caffe_rng_uniform(1, 0.f, 1.f, &prob);
-
-  if (prob > 0.5) {
-    // Do random brightness distortion.
-    RandomBrightness(out_img, &out_img, param.brightness_prob(),
-                     param.brightness_delta());
-
-    // Do random contrast distortion.
-    RandomContrast(out_img, &out_img, param.contrast_prob(),
-                   param.contrast_lower(), param.contrast_upper());
+// Draws whether to apply a distortion with probability prob, taking the same
+// random number as the Random* functions above.
+static bool DrawDistortion(const float prob) {
+  float draw;
+  caffe_rng_uniform(1, 0.f, 1.f, &draw);
+  return draw < prob;
+}
 
-    // Do random saturation distortion.
-    RandomSaturation(out_img, &out_img, param.saturation_prob(),
-                     param.saturation_lower(), param.saturation_upper());
+// Draws a factor from [lower, upper] with probability prob. As in
+// RandomContrast and RandomSaturation, the bounds are only checked when the
+// distortion is drawn.
+static void DrawFactor(const float prob, const float lower, const float upper,
+    const char* name, float* value) {
+  if (DrawDistortion(prob)) {
+    CHECK_GE(upper, lower) << name << " upper must be >= lower.";
+    CHECK_GE(lower, 0) << name << " lower must be non-negative.";
+    caffe_rng_uniform(1, lower, upper, value);
+  }
+}
 
-    // Do random hue distortion.
-    RandomHue(out_img, &out_img, param.hue_prob(), param.hue_delta());
+// Draws a shift from [-delta, delta] with probability prob, checking delta
+// only when the distortion is drawn.
+static void DrawDelta(const float prob, const float delta, const char* name,
+    float* value) {
+  if (DrawDistortion(prob)) {
+    CHECK_GE(delta, 0) << name << " must be non-negative.";
+    caffe_rng_uniform(1, -delta, delta, value);
+  }
+}
 
-    // Do random reordering of the channels.
-    RandomOrderChannels(out_img, &out_img, param.random_order_prob());
-  } else {
-    // Do random brightness distortion.
-    RandomBrightness(out_img, &out_img, param.brightness_prob(),
-                     param.brightness_delta());
+// Applies lut to every channel of in_img, or copies it if lut is NULL.
+static void ApplyLUT(const cv::Mat& in_img, const uchar* lut,
+    cv::Mat* out_img) {
+  if (lut) {
+    cv::LUT(in_img, cv::Mat(1, 256, CV_8U, const_cast<uchar*>(lut)), *out_img);
+  } else if (out_img->data != in_img.data) {
+    in_img.copyTo(*out_img);
+  }
+}
 
-    // Do random saturation distortion.
-    RandomSaturation(out_img, &out_img, param.saturation_prob(),
-                     param.saturation_lower(), param.saturation_upper());
+// Scales saturation and shifts hue in a single round trip through HSV.
+static void AdjustSaturationHue(const cv::Mat& in_img, const float saturation,
+    const float hue, cv::Mat* out_img) {
+  cv::cvtColor(in_img, *out_img, CV_BGR2HSV);
+  uchar lut[256][3];
+  for (int i = 0; i < 256; ++i) {
+    lut[i][0] = cv::saturate_cast<uchar>(i + hue);
+    lut[i][1] = cv::saturate_cast<uchar>(i * saturation);
+    lut[i][2] = i;
+  }
+  cv::LUT(*out_img, cv::Mat(1, 256, CV_8UC3, lut), *out_img);
+  cv::cvtColor(*out_img, *out_img, CV_HSV2BGR);
+}
 
-    // Do random hue distortion.
-    RandomHue(out_img, &out_img, param.hue_prob(), param.hue_delta());
+// Sets channel c of out_img to channel order[c] of in_img, which may be the
+// same image.
+static void PermuteChannels(const cv::Mat& in_img, const int* order,
+    cv::Mat* out_img) {
+  CHECK_EQ(in_img.channels(), 3);
+  out_img->create(in_img.size(), in_img.type());
+  for (int h = 0; h < in_img.rows; ++h) {
+    const uchar* in = in_img.ptr<uchar>(h);
+    uchar* out = out_img->ptr<uchar>(h);
+    for (int w = 0; w < in_img.cols; ++w, in += 3, out += 3) {
+      const uchar pixel[3] = {in[0], in[1], in[2]};
+      out[0] = pixel[order[0]];
+      out[1] = pixel[order[1]];
+      out[2] = pixel[order[2]];
+    }
+  }
+}
 
-    // Do random contrast distortion.
-    RandomContrast(out_img, &out_img, param.contrast_prob(),
-                   param.contrast_lower(), param.contrast_upper());
+void ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param,
+    cv::Mat* out_img) {
+  CHECK_EQ(in_img.depth(), CV_8U) << "Only 8-bit images can be distorted.";
 
-    // Do random reordering of the channels.
-    RandomOrderChannels(out_img, &out_img, param.random_order_prob());
+  // Draw all distortions first, in the order the separate Random* calls
+  // would draw them, then apply them in as few passes as possible.
+  float prob;
+  caffe_rng_uniform(1, 0.f, 1.f, &prob);
+  const bool contrast_first = prob > 0.5;
+  float brightness = 0, contrast = 1, saturation = 1, hue = 0;
+  DrawDelta(param.brightness_prob(), param.brightness_delta(),
+      "brightness_delta", &brightness);
+  if (contrast_first) {
+    DrawFactor(param.contrast_prob(), param.contrast_lower(),
+        param.contrast_upper(), "contrast", &contrast);
+  }
+  DrawFactor(param.saturation_prob(), param.saturation_lower(),
+      param.saturation_upper(), "saturation", &saturation);
+  DrawDelta(param.hue_prob(), param.hue_delta(), "hue_delta", &hue);
+  if (!contrast_first) {
+    DrawFactor(param.contrast_prob(), param.contrast_lower(),
+        param.contrast_upper(), "contrast", &contrast);
+  }
+  int order[3] = {0, 1, 2};
+  const bool do_order = DrawDistortion(param.random_order_prob());
+  if (do_order) {
+    std::random_shuffle(order, order + 3);
+  }
+
+  // Same thresholds as AdjustBrightness, AdjustContrast and AdjustHue.
+  const bool do_brightness = fabs(brightness) > 0;
+  const bool do_contrast = fabs(contrast - 1.f) > 1e-3;
+  const bool do_hsv = saturation != 1.f || fabs(hue) > 0;
+  uchar brightness_lut[256], contrast_lut[256];
+  for (int i = 0; i < 256; ++i) {
+    const uchar bright = do_brightness ?
+        cv::saturate_cast<uchar>(i + brightness) : i;
+    brightness_lut[i] = bright;
+    contrast_lut[i] = cv::saturate_cast<uchar>(
+        (contrast_first ? bright : i) * contrast);
+  }
+
+  // Every pass writes to out_img, reading from in_img only in the first one.
+  const cv::Mat* src = &in_img;
+  if (contrast_first) {
+    if (do_brightness || do_contrast) {
+      ApplyLUT(*src, do_contrast ? contrast_lut : brightness_lut, out_img);
+      src = out_img;
+    }
+    if (do_hsv) {
+      AdjustSaturationHue(*src, saturation, hue, out_img);
+      src = out_img;
+    }
+  } else {
+    if (do_brightness) {
+      ApplyLUT(*src, brightness_lut, out_img);
+      src = out_img;
+    }
+    if (do_hsv) {
+      AdjustSaturationHue(*src, saturation, hue, out_img);
+      src = out_img;
+    }
+    if (do_contrast) {
+      ApplyLUT(*src, contrast_lut, out_img);
+      src = out_img;
+    }
+  }
+  if (do_order) {
+    PermuteChannels(*src, order, out_img);
+  } else {
+    ApplyLUT(*src, NULL, out_img);
   }
+}
 
+cv::Mat ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param) {
+  cv::Mat out_img;
+  ApplyDistort(in_img, param, &out_img);
   return out_img;
 }
 #endif  // USE_OPENCV
@@ -0,0 +1,81 @@
+#ifdef USE_OPENCV
+#include <boost/thread.hpp>
+#include <string>
+
+#include "caffe/util/image_cache.hpp"
+
+namespace caffe {
+
+DecodedImageCache::DecodedImageCache(size_t max_bytes)
+    : max_bytes_(max_bytes), bytes_(0), hits_(0), misses_(0),
+      mutex_(new boost::mutex()) {
+}
+
+bool DecodedImageCache::Get(const string& key, cv::Mat* img) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  map<string, EntryList::iterator>::iterator it = index_.find(key);
+  if (it == index_.end()) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  entries_.splice(entries_.begin(), entries_, it->second);
+  *img = it->second->img;
+  return true;
+}
+
+void DecodedImageCache::Put(const string& key, const cv::Mat& img) {
+  const size_t img_bytes = img.total() * img.elemSize();
+  boost::mutex::scoped_lock lock(*mutex_);
+  map<string, EntryList::iterator>::iterator it = index_.find(key);
+  if (it != index_.end()) {
+    bytes_ -= it->second->bytes;
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+  if (img_bytes > max_bytes_) {
+    return;
+  }
+  Evict(img_bytes);
+  Entry entry;
+  entry.key = key;
+  // Keep a continuous copy only if img is a view into a larger buffer, so
+  // that the budget accounts for all memory the entry holds on to.
+  entry.img = img.isContinuous() ? img : img.clone();
+  entry.bytes = img_bytes;
+  entries_.push_front(entry);
+  index_[key] = entries_.begin();
+  bytes_ += img_bytes;
+}
+
+void DecodedImageCache::Evict(size_t needed) {
+  while (!entries_.empty() && bytes_ + needed > max_bytes_) {
+    const Entry& oldest = entries_.back();
+    bytes_ -= oldest.bytes;
+    index_.erase(oldest.key);
+    entries_.pop_back();
+  }
+}
+
+size_t DecodedImageCache::size() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return entries_.size();
+}
+
+size_t DecodedImageCache::bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return bytes_;
+}
+
+uint64_t DecodedImageCache::hits() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return hits_;
+}
+
+uint64_t DecodedImageCache::misses() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return misses_;
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -14,6 +14,9 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/highgui/highgui_c.h>
 #include <opencv2/imgproc/imgproc.hpp>
+#if CV_VERSION_MAJOR >= 3
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#endif
 #endif  // USE_OPENCV
 #include <sstream>
 #include <iostream>
@@ -21,6 +24,7 @@
 #include <stdint.h>
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
+#include <iterator>
 #include <map>
 #include <vector>
 
@@ -149,6 +153,126 @@ cv::Mat ReadImageToCVMat(const string& filename) {
   return ReadImageToCVMat(filename, 0, 0, true);
 }
 
+// Reads the height, width and number of components from the frame header of
+// a baseline or progressive JPEG without decoding it.
+static bool ReadJPEGHeader(const string& data, int* height, int* width,
+    int* channels) {
+  const unsigned char* buf = reinterpret_cast<const unsigned char*>(
+      data.data());
+  const size_t size = data.size();
+  if (size < 4 || buf[0] != 0xFF || buf[1] != 0xD8) {
+    return false;
+  }
+  size_t pos = 2;
+  while (pos + 4 <= size) {
+    if (buf[pos] != 0xFF) {
+      return false;
+    }
+    const unsigned char marker = buf[pos + 1];
+    if (marker == 0xFF) {
+      // Fill byte
+      ++pos;
+      continue;
+    }
+    pos += 2;
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+      // Markers without a segment
+      continue;
+    }
+    if (marker == 0xD9 || marker == 0xDA) {
+      // End of image or start of scan before any frame header
+      return false;
+    }
+    const size_t length = (buf[pos] << 8) | buf[pos + 1];
+    if (length < 2 || pos + length > size) {
+      return false;
+    }
+    // SOF0 to SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC) {
+      if (length < 8) {
+        return false;
+      }
+      *height = (buf[pos + 3] << 8) | buf[pos + 4];
+      *width = (buf[pos + 5] << 8) | buf[pos + 6];
+      *channels = buf[pos + 7];
+      return *height > 0 && *width > 0;
+    }
+    pos += length;
+  }
+  return false;
+}
+
+int GetJPEGReducedScale(const string& data, const int min_height,
+    const int min_width, const bool exact) {
+#if CV_VERSION_MAJOR >= 3
+  int height, width, channels;
+  if (min_height <= 0 || min_width <= 0 ||
+      !ReadJPEGHeader(data, &height, &width, &channels)) {
+    return 1;
+  }
+  for (int scale = 8; scale > 1; scale /= 2) {
+    // libjpeg rounds the reduced size up
+    const int reduced_height = (height + scale - 1) / scale;
+    const int reduced_width = (width + scale - 1) / scale;
+    if (reduced_height >= min_height && reduced_width >= min_width &&
+        (!exact || (height % scale == 0 && width % scale == 0))) {
+      return scale;
+    }
+  }
+#endif
+  return 1;
+}
+
+// The imread/imdecode flag that decodes at 1/scale of the original size.
+static int ReducedReadFlag(const int scale, const bool is_color) {
+#if CV_VERSION_MAJOR >= 3
+  switch (scale) {
+  case 1:
+    break;
+  case 2:
+    return is_color ? cv::IMREAD_REDUCED_COLOR_2 :
+        cv::IMREAD_REDUCED_GRAYSCALE_2;
+  case 4:
+    return is_color ? cv::IMREAD_REDUCED_COLOR_4 :
+        cv::IMREAD_REDUCED_GRAYSCALE_4;
+  case 8:
+    return is_color ? cv::IMREAD_REDUCED_COLOR_8 :
+        cv::IMREAD_REDUCED_GRAYSCALE_8;
+  default:
+    LOG(FATAL) << "Unsupported decode scale: " << scale;
+  }
+#else
+  CHECK_EQ(scale, 1) << "Reduced decoding requires OpenCV 3 or later.";
+#endif
+  return is_color ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE;
+}
+
+cv::Mat ReadImageToCVMatReduced(const string& filename,
+    const int height, const int width, const bool is_color) {
+  if (height <= 0 || width <= 0) {
+    return ReadImageToCVMat(filename, height, width, is_color);
+  }
+  string data;
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  if (file.is_open()) {
+    data.assign(std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>());
+  }
+  // The image is warped to height x width anyway, so any scale will do.
+  const int scale = GetJPEGReducedScale(data, height, width, false);
+  cv::Mat cv_img_origin = cv::imdecode(
+      cv::Mat(1, data.size(), CV_8UC1, const_cast<char*>(data.data())),
+      ReducedReadFlag(scale, is_color));
+  if (!cv_img_origin.data) {
+    LOG(ERROR) << "Could not decode file " << filename;
+    return cv_img_origin;
+  }
+  cv::Mat cv_img;
+  cv::resize(cv_img_origin, cv_img, cv::Size(width, height));
+  return cv_img;
+}
+
 // Do the file extension and encoding match?
 static bool matchExt(const std::string & fn,
                      std::string en) {
@@ -885,25 +1009,43 @@ bool MapLabelToDisplayName(const LabelMap& map, const bool strict_check,
 }
 
 #ifdef USE_OPENCV
+// Wraps the encoded bytes of a datum for cv::imdecode, which only reads them,
+// without copying them into a temporary buffer.
+static cv::Mat EncodedDatumBuffer(const Datum& datum) {
+  const string& data = datum.data();
+  return cv::Mat(1, data.size(), CV_8UC1, const_cast<char*>(data.data()));
+}
+
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum) {
+  return DecodeDatumToCVMatNative(datum, 1);
+}
+cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
+  return DecodeDatumToCVMat(datum, is_color, 1);
+}
+
+cv::Mat DecodeDatumToCVMatNative(const Datum& datum, const int scale) {
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
-  const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
-  cv_img = cv::imdecode(vec_data, -1);
+  int cv_read_flag = -1;
+  int height, width, channels;
+  // The reduced flags always convert to gray or BGR, so only use them when
+  // that is the native format anyway.
+  if (scale > 1 && ReadJPEGHeader(datum.data(), &height, &width, &channels)
+      && (channels == 1 || channels == 3)) {
+    cv_read_flag = ReducedReadFlag(scale, channels == 3);
+  }
+  cv_img = cv::imdecode(EncodedDatumBuffer(datum), cv_read_flag);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
   return cv_img;
 }
-cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
+cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color,
+    const int scale) {
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
-  const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
-  int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
-    CV_LOAD_IMAGE_GRAYSCALE);
-  cv_img = cv::imdecode(vec_data, cv_read_flag);
+  cv_img = cv::imdecode(EncodedDatumBuffer(datum),
+      ReducedReadFlag(scale, is_color));
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/util/nms_grid.hpp"
+
+namespace caffe {
+
+// Candidates per cell a grid is sized for, and the most cells per side.
+static const int kBoxesPerCell = 16;
+static const int kMaxSide = 64;
+
+static inline bool IsFinite(const BBox& box) {
+  return std::isfinite(box.xmin) && std::isfinite(box.ymin) &&
+      std::isfinite(box.xmax) && std::isfinite(box.ymax);
+}
+
+NMSGrid::NMSGrid()
+    : xmin_(0), ymin_(0), cell_width_(1), cell_height_(1), margin_(0),
+      side_(1), stamp_(0) {
+}
+
+void NMSGrid::Reset(const vector<BBox>& boxes, const int num_candidates,
+    const float margin) {
+  margin_ = margin;
+  float xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+  bool empty = true;
+  for (int i = 0; i < boxes.size(); ++i) {
+    const BBox& box = boxes[i];
+    if (!IsFinite(box)) {
+      continue;
+    }
+    const float box_xmin = std::min(box.xmin, box.xmax);
+    const float box_ymin = std::min(box.ymin, box.ymax);
+    const float box_xmax = std::max(box.xmin, box.xmax);
+    const float box_ymax = std::max(box.ymin, box.ymax);
+    if (empty) {
+      xmin = box_xmin;
+      ymin = box_ymin;
+      xmax = box_xmax;
+      ymax = box_ymax;
+      empty = false;
+    } else {
+      xmin = std::min(xmin, box_xmin);
+      ymin = std::min(ymin, box_ymin);
+      xmax = std::max(xmax, box_xmax);
+      ymax = std::max(ymax, box_ymax);
+    }
+  }
+  side_ = static_cast<int>(std::sqrt(
+      static_cast<float>(num_candidates) / kBoxesPerCell));
+  side_ = std::max(1, std::min(side_, kMaxSide));
+  xmin_ = xmin;
+  ymin_ = ymin;
+  cell_width_ = std::max(xmax - xmin, 1e-6f) / side_;
+  cell_height_ = std::max(ymax - ymin, 1e-6f) / side_;
+  cells_.resize(side_ * side_);
+  for (int i = 0; i < cells_.size(); ++i) {
+    cells_[i].clear();
+  }
+  unbounded_.clear();
+  stamps_.assign(boxes.size(), 0);
+  stamp_ = 0;
+}
+
+bool NMSGrid::CellRange(const BBox& box, const float margin, int* x0,
+    int* y0, int* x1, int* y1) const {
+  if (!IsFinite(box)) {
+    return false;
+  }
+  // Clamping the cells of boxes outside the extent keeps the order of the
+  // cells, so intersecting spans still share one.
+  const float last = side_ - 1;
+  *x0 = std::max(0.f, std::min(last, std::floor(
+      (std::min(box.xmin, box.xmax) - margin - xmin_) / cell_width_)));
+  *y0 = std::max(0.f, std::min(last, std::floor(
+      (std::min(box.ymin, box.ymax) - margin - ymin_) / cell_height_)));
+  *x1 = std::max(0.f, std::min(last, std::floor(
+      (std::max(box.xmin, box.xmax) + margin - xmin_) / cell_width_)));
+  *y1 = std::max(0.f, std::min(last, std::floor(
+      (std::max(box.ymin, box.ymax) + margin - ymin_) / cell_height_)));
+  return true;
+}
+
+void NMSGrid::Insert(const BBox& box, const int index) {
+  int x0, y0, x1, y1;
+  if (!CellRange(box, 0, &x0, &y0, &x1, &y1)) {
+    unbounded_.push_back(index);
+    return;
+  }
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      cells_[y * side_ + x].push_back(index);
+    }
+  }
+}
+
+void NMSGrid::Query(const BBox& box, vector<int>* indices) {
+  indices->clear();
+  int x0, y0, x1, y1;
+  if (!CellRange(box, margin_, &x0, &y0, &x1, &y1)) {
+    x0 = 0;
+    y0 = 0;
+    x1 = side_ - 1;
+    y1 = side_ - 1;
+  }
+  if (x0 == x1 && y0 == y1) {
+    // A single cell holds no duplicates.
+    const vector<int>& cell = cells_[y0 * side_ + x0];
+    indices->assign(cell.begin(), cell.end());
+  } else {
+    ++stamp_;
+    for (int y = y0; y <= y1; ++y) {
+      for (int x = x0; x <= x1; ++x) {
+        const vector<int>& cell = cells_[y * side_ + x];
+        for (int i = 0; i < cell.size(); ++i) {
+          if (stamps_[cell[i]] != stamp_) {
+            stamps_[cell[i]] = stamp_;
+            indices->push_back(cell[i]);
+          }
+        }
+      }
+    }
+  }
+  indices->insert(indices->end(), unbounded_.begin(), unbounded_.end());
+}
+
+}  // namespace caffe
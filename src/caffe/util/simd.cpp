@@ -0,0 +1,704 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/simd.hpp"
+
+// The vectorized kernels are compiled for their instruction set with target
+// attributes and only called after checking the CPU, so the rest of the
+// build keeps its baseline flags.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CAFFE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace caffe {
+
+static SimdLevel DetectSimdLevel() {
+#ifdef CAFFE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SIMD_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return SIMD_SSE41;
+  }
+#endif
+  return SIMD_SCALAR;
+}
+
+SimdLevel caffe_cpu_simd_level() {
+  static const SimdLevel level = DetectSimdLevel();
+  return level;
+}
+
+// Converts pixels [begin, width) of a row; plane is the distance between two
+// channels in dst.
+template <typename Dtype>
+static inline void HWCToCHWRow(const uint8_t* src, const int begin,
+    const int width, const int channels, const Dtype* mean, const Dtype scale,
+    const bool mirror, Dtype* dst, const int plane) {
+  for (int w = begin; w < width; ++w) {
+    const int out = mirror ? width - 1 - w : w;
+    for (int c = 0; c < channels; ++c) {
+      const Dtype pixel = static_cast<Dtype>(src[w * channels + c]);
+      dst[c * plane + out] = (pixel - (mean ? mean[c] : Dtype(0))) * scale;
+    }
+  }
+}
+
+#ifdef CAFFE_X86_SIMD
+// Byte shuffles gathering channel c of 16 interleaved 3-channel pixels from
+// each of the three 16-byte blocks holding them.
+static const int8_t kDeinterleave3[3][3][16] = {
+  {{0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13}},
+  {{1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14}},
+  {{2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15}}
+};
+
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128i Shuffle(const __m128i v, const int8_t* mask) {
+  return _mm_shuffle_epi8(v, _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(mask)));
+}
+
+// Splits 16 pixels of 3 channels into 16 bytes per channel.
+__attribute__((target("sse4.1"), always_inline))
+static inline void Deinterleave3(const uint8_t* src, __m128i* planes) {
+  const __m128i* in = reinterpret_cast<const __m128i*>(src);
+  const __m128i a = _mm_loadu_si128(in);
+  const __m128i b = _mm_loadu_si128(in + 1);
+  const __m128i c = _mm_loadu_si128(in + 2);
+  for (int ch = 0; ch < 3; ++ch) {
+    planes[ch] = _mm_or_si128(_mm_or_si128(
+        Shuffle(a, kDeinterleave3[ch][0]), Shuffle(b, kDeinterleave3[ch][1])),
+        Shuffle(c, kDeinterleave3[ch][2]));
+  }
+}
+
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128 Convert4(const __m128i v, const __m128 mean,
+    const __m128 scale) {
+  return _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(v)), mean),
+      scale);
+}
+
+// Writes the 16 converted bytes of v to dst[0, 16), in reverse if mirror.
+__attribute__((target("sse4.1"), always_inline))
+static inline void Store16(const __m128i v, const __m128 mean,
+    const __m128 scale, const bool mirror, float* dst) {
+  __m128 f[4];
+  f[0] = Convert4(v, mean, scale);
+  f[1] = Convert4(_mm_srli_si128(v, 4), mean, scale);
+  f[2] = Convert4(_mm_srli_si128(v, 8), mean, scale);
+  f[3] = Convert4(_mm_srli_si128(v, 12), mean, scale);
+  for (int i = 0; i < 4; ++i) {
+    if (mirror) {
+      _mm_storeu_ps(dst + 12 - 4 * i,
+          _mm_shuffle_ps(f[i], f[i], _MM_SHUFFLE(0, 1, 2, 3)));
+    } else {
+      _mm_storeu_ps(dst + 4 * i, f[i]);
+    }
+  }
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256 Convert8(const __m128i v, const __m256 mean,
+    const __m256 scale) {
+  return _mm256_mul_ps(_mm256_sub_ps(
+      _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)), mean), scale);
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void Store16(const __m128i v, const __m256 mean,
+    const __m256 scale, const bool mirror, float* dst) {
+  const __m256 lo = Convert8(v, mean, scale);
+  const __m256 hi = Convert8(_mm_srli_si128(v, 8), mean, scale);
+  if (mirror) {
+    const __m256i reverse = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    _mm256_storeu_ps(dst, _mm256_permutevar8x32_ps(hi, reverse));
+    _mm256_storeu_ps(dst + 8, _mm256_permutevar8x32_ps(lo, reverse));
+  } else {
+    _mm256_storeu_ps(dst, lo);
+    _mm256_storeu_ps(dst + 8, hi);
+  }
+}
+
+// Both kernels convert blocks of 16 pixels and leave the rest of the row to
+// HWCToCHWRow. Vec is the float vector type of the instruction set.
+#define HWC_TO_CHW_ROW_KERNEL(Name, Target, Vec, set1) \
+__attribute__((target(Target))) \
+static void Name(const uint8_t* src, const int width, const int channels, \
+    const float* mean, const float scale, const bool mirror, float* dst, \
+    const int plane) { \
+  const Vec vscale = set1(scale); \
+  Vec vmean[3]; \
+  for (int c = 0; c < 3; ++c) { \
+    vmean[c] = set1(mean && c < channels ? mean[c] : 0.f); \
+  } \
+  int w = 0; \
+  if (channels == 1) { \
+    for (; w + 16 <= width; w += 16) { \
+      Store16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + w)), \
+          vmean[0], vscale, mirror, dst + (mirror ? width - w - 16 : w)); \
+    } \
+  } else if (channels == 3) { \
+    for (; w + 16 <= width; w += 16) { \
+      __m128i planes[3]; \
+      Deinterleave3(src + 3 * w, planes); \
+      const int out = mirror ? width - w - 16 : w; \
+      for (int c = 0; c < 3; ++c) { \
+        Store16(planes[c], vmean[c], vscale, mirror, dst + c * plane + out); \
+      } \
+    } \
+  } \
+  HWCToCHWRow(src, w, width, channels, mean, scale, mirror, dst, plane); \
+}
+
+HWC_TO_CHW_ROW_KERNEL(HWCToCHWRowSSE41, "sse4.1", __m128, _mm_set1_ps)
+HWC_TO_CHW_ROW_KERNEL(HWCToCHWRowAVX2, "avx2", __m256, _mm256_set1_ps)
+#undef HWC_TO_CHW_ROW_KERNEL
+#endif  // CAFFE_X86_SIMD
+
+template <typename Dtype>
+static void HWCToCHW(const int height, const int width, const int channels,
+    const uint8_t* src, const int src_step, const Dtype* mean,
+    const Dtype scale, const bool mirror, Dtype* dst,
+    const SimdLevel max_level) {
+  for (int h = 0; h < height; ++h) {
+    HWCToCHWRow(src + h * src_step, 0, width, channels, mean, scale, mirror,
+        dst + h * width, height * width);
+  }
+}
+
+static void HWCToCHW(const int height, const int width, const int channels,
+    const uint8_t* src, const int src_step, const float* mean,
+    const float scale, const bool mirror, float* dst,
+    const SimdLevel max_level) {
+  const SimdLevel level = std::min(max_level, caffe_cpu_simd_level());
+  const int plane = height * width;
+  for (int h = 0; h < height; ++h) {
+    const uint8_t* src_row = src + h * src_step;
+    float* dst_row = dst + h * width;
+    switch (level) {
+#ifdef CAFFE_X86_SIMD
+    case SIMD_AVX2:
+      HWCToCHWRowAVX2(src_row, width, channels, mean, scale, mirror, dst_row,
+          plane);
+      break;
+    case SIMD_SSE41:
+      HWCToCHWRowSSE41(src_row, width, channels, mean, scale, mirror,
+          dst_row, plane);
+      break;
+#endif
+    default:
+      HWCToCHWRow(src_row, 0, width, channels, mean, scale, mirror, dst_row,
+          plane);
+    }
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_hwc_to_chw(const int height, const int width,
+    const int channels, const uint8_t* src, const int src_step,
+    const Dtype* mean, const Dtype scale, const bool mirror, Dtype* dst,
+    const SimdLevel max_level) {
+  CHECK_GE(src_step, width * channels);
+  HWCToCHW(height, width, channels, src, src_step, mean, scale, mirror, dst,
+      max_level);
+}
+
+template void caffe_cpu_hwc_to_chw<float>(const int height, const int width,
+    const int channels, const uint8_t* src, const int src_step,
+    const float* mean, const float scale, const bool mirror, float* dst,
+    const SimdLevel max_level);
+template void caffe_cpu_hwc_to_chw<double>(const int height, const int width,
+    const int channels, const uint8_t* src, const int src_step,
+    const double* mean, const double scale, const bool mirror, double* dst,
+    const SimdLevel max_level);
+
+// Overlaps [begin, n) of caffe_cpu_jaccard_overlap.
+static inline void JaccardOverlapRange(const int begin, const int n,
+    const float* xmin, const float* ymin, const float* xmax,
+    const float* ymax, const float* size, const float* box,
+    const float box_size, float* overlaps) {
+  for (int i = begin; i < n; ++i) {
+    const float width = std::min(xmax[i], box[2]) - std::max(xmin[i], box[0]);
+    const float height =
+        std::min(ymax[i], box[3]) - std::max(ymin[i], box[1]);
+    if (width > 0 && height > 0) {
+      const float intersect = width * height;
+      overlaps[i] = intersect / (size[i] + box_size - intersect);
+    } else {
+      overlaps[i] = 0;
+    }
+  }
+}
+
+#ifdef CAFFE_X86_SIMD
+// Both kernels compute whole vectors of overlaps and leave the rest to
+// JaccardOverlapRange. Lanes without an intersection may divide by zero,
+// their result is masked out.
+#define JACCARD_OVERLAP_KERNEL(Name, Target, Vec, kWidth, set1, load, store, \
+    add, sub, mul, div, min, max, and_, gt) \
+__attribute__((target(Target))) \
+static void Name(const int n, const float* xmin, const float* ymin, \
+    const float* xmax, const float* ymax, const float* size, \
+    const float* box, const float box_size, float* overlaps) { \
+  const Vec box_xmin = set1(box[0]); \
+  const Vec box_ymin = set1(box[1]); \
+  const Vec box_xmax = set1(box[2]); \
+  const Vec box_ymax = set1(box[3]); \
+  const Vec vbox_size = set1(box_size); \
+  const Vec zero = set1(0.f); \
+  int i = 0; \
+  for (; i + kWidth <= n; i += kWidth) { \
+    const Vec width = sub(min(load(xmax + i), box_xmax), \
+        max(load(xmin + i), box_xmin)); \
+    const Vec height = sub(min(load(ymax + i), box_ymax), \
+        max(load(ymin + i), box_ymin)); \
+    const Vec intersect = mul(width, height); \
+    const Vec overlap = div(intersect, \
+        sub(add(load(size + i), vbox_size), intersect)); \
+    store(overlaps + i, and_(and_(gt(width, zero), gt(height, zero)), \
+        overlap)); \
+  } \
+  JaccardOverlapRange(i, n, xmin, ymin, xmax, ymax, size, box, box_size, \
+      overlaps); \
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256 GreaterThan8(const __m256 a, const __m256 b) {
+  return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+}
+
+JACCARD_OVERLAP_KERNEL(JaccardOverlapSSE41, "sse4.1", __m128, 4, _mm_set1_ps,
+    _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _mm_sub_ps, _mm_mul_ps,
+    _mm_div_ps, _mm_min_ps, _mm_max_ps, _mm_and_ps, _mm_cmpgt_ps)
+JACCARD_OVERLAP_KERNEL(JaccardOverlapAVX2, "avx2", __m256, 8, _mm256_set1_ps,
+    _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, _mm256_sub_ps,
+    _mm256_mul_ps, _mm256_div_ps, _mm256_min_ps, _mm256_max_ps,
+    _mm256_and_ps, GreaterThan8)
+#undef JACCARD_OVERLAP_KERNEL
+#endif  // CAFFE_X86_SIMD
+
+void caffe_cpu_jaccard_overlap(const int n, const float* xmin,
+    const float* ymin, const float* xmax, const float* ymax,
+    const float* size, const float* box, const float box_size,
+    float* overlaps, const SimdLevel max_level) {
+  switch (std::min(max_level, caffe_cpu_simd_level())) {
+#ifdef CAFFE_X86_SIMD
+  case SIMD_AVX2:
+    JaccardOverlapAVX2(n, xmin, ymin, xmax, ymax, size, box, box_size,
+        overlaps);
+    break;
+  case SIMD_SSE41:
+    JaccardOverlapSSE41(n, xmin, ymin, xmax, ymax, size, box, box_size,
+        overlaps);
+    break;
+#endif
+  default:
+    JaccardOverlapRange(0, n, xmin, ymin, xmax, ymax, size, box, box_size,
+        overlaps);
+  }
+}
+
+// a > b ? a : b, which is what the max instructions compute when a value is
+// NaN, so that every kernel finds the same peaks.
+template <typename Dtype>
+static inline Dtype Max(const Dtype a, const Dtype b) {
+  return a > b ? a : b;
+}
+
+// Sets out[w] to the max of padded[w], padded[w + 1] and padded[w + 2], for
+// w in [begin, width).
+template <typename Dtype>
+static inline void RowMax3Range(const int begin, const int width,
+    const Dtype* padded, Dtype* out) {
+  for (int w = begin; w < width; ++w) {
+    out[w] = Max(Max(padded[w], padded[w + 1]), padded[w + 2]);
+  }
+}
+
+// Appends offset + w for the w in [begin, width) where row[w] is above
+// threshold and equal to the max of above[w], center[w] and below[w].
+template <typename Dtype>
+static inline void PeakRowRange(const int begin, const int width,
+    const Dtype* row, const Dtype* above, const Dtype* center,
+    const Dtype* below, const Dtype threshold, const int offset,
+    std::vector<int>* peaks) {
+  for (int w = begin; w < width; ++w) {
+    const Dtype pooled = Max(Max(above[w], center[w]), below[w]);
+    if (row[w] > threshold && row[w] == pooled) {
+      peaks->push_back(offset + w);
+    }
+  }
+}
+
+#ifdef CAFFE_X86_SIMD
+// The kernels process whole vectors and leave the rest of the row to the
+// ranges above. The peaks of a vector are read from its comparison mask, so
+// vectors without peaks, most of a heatmap, cost no branch per value.
+#define HEATMAP_PEAKS_KERNELS(RowMax3Name, PeakRowName, Target, Vec, kWidth, \
+    set1, load, store, max, and_, eq, gt, movemask) \
+__attribute__((target(Target))) \
+static void RowMax3Name(const int width, const float* padded, float* out) { \
+  int w = 0; \
+  for (; w + kWidth <= width; w += kWidth) { \
+    store(out + w, max(max(load(padded + w), load(padded + w + 1)), \
+        load(padded + w + 2))); \
+  } \
+  RowMax3Range(w, width, padded, out); \
+} \
+\
+__attribute__((target(Target))) \
+static void PeakRowName(const int width, const float* row, \
+    const float* above, const float* center, const float* below, \
+    const float threshold, const int offset, std::vector<int>* peaks) { \
+  const Vec vthreshold = set1(threshold); \
+  int w = 0; \
+  for (; w + kWidth <= width; w += kWidth) { \
+    const Vec value = load(row + w); \
+    const Vec pooled = max(max(load(above + w), load(center + w)), \
+        load(below + w)); \
+    int mask = movemask(and_(gt(value, vthreshold), eq(value, pooled))); \
+    while (mask) { \
+      peaks->push_back(offset + w + __builtin_ctz(mask)); \
+      mask &= mask - 1; \
+    } \
+  } \
+  PeakRowRange(w, width, row, above, center, below, threshold, offset, \
+      peaks); \
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256 Equal8(const __m256 a, const __m256 b) {
+  return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);
+}
+
+HEATMAP_PEAKS_KERNELS(RowMax3SSE41, PeakRowSSE41, "sse4.1", __m128, 4,
+    _mm_set1_ps, _mm_loadu_ps, _mm_storeu_ps, _mm_max_ps, _mm_and_ps,
+    _mm_cmpeq_ps, _mm_cmpgt_ps, _mm_movemask_ps)
+HEATMAP_PEAKS_KERNELS(RowMax3AVX2, PeakRowAVX2, "avx2", __m256, 8,
+    _mm256_set1_ps, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_max_ps,
+    _mm256_and_ps, Equal8, GreaterThan8, _mm256_movemask_ps)
+#undef HEATMAP_PEAKS_KERNELS
+#endif  // CAFFE_X86_SIMD
+
+template <typename Dtype>
+static void RowMax3Scalar(const int width, const Dtype* padded, Dtype* out) {
+  RowMax3Range(0, width, padded, out);
+}
+
+template <typename Dtype>
+static void PeakRowScalar(const int width, const Dtype* row,
+    const Dtype* above, const Dtype* center, const Dtype* below,
+    const Dtype threshold, const int offset, std::vector<int>* peaks) {
+  PeakRowRange(0, width, row, above, center, below, threshold, offset, peaks);
+}
+
+template <typename Dtype>
+struct HeatmapPeaksKernels {
+  void (*row_max3)(const int width, const Dtype* padded, Dtype* out);
+  void (*peak_row)(const int width, const Dtype* row, const Dtype* above,
+      const Dtype* center, const Dtype* below, const Dtype threshold,
+      const int offset, std::vector<int>* peaks);
+};
+
+template <typename Dtype>
+static void GetHeatmapPeaksKernels(const SimdLevel max_level,
+    HeatmapPeaksKernels<Dtype>* kernels) {
+  kernels->row_max3 = RowMax3Scalar<Dtype>;
+  kernels->peak_row = PeakRowScalar<Dtype>;
+}
+
+static void GetHeatmapPeaksKernels(const SimdLevel max_level,
+    HeatmapPeaksKernels<float>* kernels) {
+  switch (std::min(max_level, caffe_cpu_simd_level())) {
+#ifdef CAFFE_X86_SIMD
+  case SIMD_AVX2:
+    kernels->row_max3 = RowMax3AVX2;
+    kernels->peak_row = PeakRowAVX2;
+    break;
+  case SIMD_SSE41:
+    kernels->row_max3 = RowMax3SSE41;
+    kernels->peak_row = PeakRowSSE41;
+    break;
+#endif
+  default:
+    kernels->row_max3 = RowMax3Scalar<float>;
+    kernels->peak_row = PeakRowScalar<float>;
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_heatmap_peaks(const int channels, const int height,
+    const int width, const Dtype* data, const Dtype threshold,
+    std::vector<int>* peaks, const SimdLevel max_level) {
+  if (height <= 0 || width <= 0) {
+    return;
+  }
+  HeatmapPeaksKernels<Dtype> kernels;
+  GetHeatmapPeaksKernels(max_level, &kernels);
+  // padded holds a row with its border values repeated, row_max the row
+  // maxima of three consecutive rows, reused as the window slides down.
+  std::vector<Dtype> padded(width + 2);
+  std::vector<Dtype> row_max(3 * width);
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* map = data + c * height * width;
+    for (int h = 0; h <= height; ++h) {
+      if (h < height) {
+        const Dtype* row = map + h * width;
+        std::copy(row, row + width, padded.begin() + 1);
+        padded[0] = row[0];
+        padded[width + 1] = row[width - 1];
+        kernels.row_max3(width, &padded[0], &row_max[(h % 3) * width]);
+      }
+      if (h == 0) {
+        continue;
+      }
+      // Row h - 1 is complete, its missing neighbors are itself.
+      const int center = h - 1;
+      const Dtype* center_max = &row_max[(center % 3) * width];
+      const Dtype* above_max =
+          center > 0 ? &row_max[((center - 1) % 3) * width] : center_max;
+      const Dtype* below_max =
+          center < height - 1 ? &row_max[(h % 3) * width] : center_max;
+      kernels.peak_row(width, map + center * width, above_max, center_max,
+          below_max, threshold, c * height * width + center * width, peaks);
+    }
+  }
+}
+
+template void caffe_cpu_heatmap_peaks<float>(const int channels,
+    const int height, const int width, const float* data,
+    const float threshold, std::vector<int>* peaks,
+    const SimdLevel max_level);
+template void caffe_cpu_heatmap_peaks<double>(const int channels,
+    const int height, const int width, const double* data,
+    const double threshold, std::vector<int>* peaks,
+    const SimdLevel max_level);
+
+// The geometry of the rows of a depthwise convolution.
+struct DepthwiseConvGeometry {
+  int width;
+  int kernel_h;
+  int kernel_w;
+  int pad_w;
+  int stride_w;
+  int dilation_w;
+  int output_w;
+};
+
+// Computes columns [begin, end) of an output row. rows[kh] is the input row
+// under kernel row kh, or NULL where it is padding.
+template <typename Dtype>
+static inline void DepthwiseConvRange(const int begin, const int end,
+    const DepthwiseConvGeometry& geometry, const Dtype* const* rows,
+    const Dtype* weight, const Dtype bias, Dtype* out) {
+  for (int w = begin; w < end; ++w) {
+    const int offset = w * geometry.stride_w - geometry.pad_w;
+    Dtype sum = bias;
+    for (int kh = 0; kh < geometry.kernel_h; ++kh) {
+      if (!rows[kh]) {
+        continue;
+      }
+      for (int kw = 0; kw < geometry.kernel_w; ++kw) {
+        const int iw = offset + kw * geometry.dilation_w;
+        if (iw >= 0 && iw < geometry.width) {
+          sum += weight[kh * geometry.kernel_w + kw] * rows[kh][iw];
+        }
+      }
+    }
+    out[w] = sum;
+  }
+}
+
+#ifdef CAFFE_X86_SIMD
+// Loads the even elements of in[0, 8) and in[0, 16), the inputs of
+// consecutive output columns at stride 2.
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128 LoadEven4(const float* in) {
+  return _mm_shuffle_ps(_mm_loadu_ps(in), _mm_loadu_ps(in + 4),
+      _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256 LoadEven8(const float* in) {
+  // Even elements of each 128-bit lane, then the 64-bit halves in order.
+  const __m256 even = _mm256_shuffle_ps(_mm256_loadu_ps(in),
+      _mm256_loadu_ps(in + 8), _MM_SHUFFLE(2, 0, 2, 0));
+  return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even),
+      _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+// The kernels compute whole vectors of the columns whose taps, and the
+// elements loaded for them, are all inside the input row, and leave the
+// borders to DepthwiseConvRange. kStride and kKernelW are the stride and
+// the kernel width, or 0 for the kernel width of geometry; fixing them
+// unrolls the taps of the common 3x3 and 5x5 kernels.
+#define DEPTHWISE_CONV_ROW_KERNEL(Name, Target, Vec, kWidth, set1, load, \
+    load_even, store, add, mul) \
+template <int kStride, int kKernelW> \
+__attribute__((target(Target))) \
+static void Name##Stride(const DepthwiseConvGeometry& geometry, \
+    const float* const* rows, const float* weight, const float bias, \
+    float* out) { \
+  const int kernel_w = kKernelW ? kKernelW : geometry.kernel_w; \
+  const int extent = (kernel_w - 1) * geometry.dilation_w; \
+  int begin = 0; \
+  while (begin < geometry.output_w && begin * kStride < geometry.pad_w) { \
+    ++begin; \
+  } \
+  DepthwiseConvRange(0, begin, geometry, rows, weight, bias, out); \
+  int w = begin; \
+  for (; w + kWidth <= geometry.output_w && \
+       (w + kWidth) * kStride - geometry.pad_w + extent <= geometry.width; \
+       w += kWidth) { \
+    const int offset = w * kStride - geometry.pad_w; \
+    Vec sum = set1(bias); \
+    for (int kh = 0; kh < geometry.kernel_h; ++kh) { \
+      if (!rows[kh]) { \
+        continue; \
+      } \
+      const float* in = rows[kh] + offset; \
+      const float* kernel = weight + kh * kernel_w; \
+      for (int kw = 0; kw < kernel_w; ++kw) { \
+        const float* tap = in + kw * geometry.dilation_w; \
+        sum = add(sum, mul(set1(kernel[kw]), \
+            kStride == 1 ? load(tap) : load_even(tap))); \
+      } \
+    } \
+    store(out + w, sum); \
+  } \
+  DepthwiseConvRange(w, geometry.output_w, geometry, rows, weight, bias, \
+      out); \
+} \
+\
+__attribute__((target(Target))) \
+static void Name(const DepthwiseConvGeometry& geometry, \
+    const float* const* rows, const float* weight, const float bias, \
+    float* out) { \
+  const int kernel_w = geometry.kernel_w; \
+  if (geometry.stride_w == 1) { \
+    if (kernel_w == 3) { \
+      Name##Stride<1, 3>(geometry, rows, weight, bias, out); \
+    } else if (kernel_w == 5) { \
+      Name##Stride<1, 5>(geometry, rows, weight, bias, out); \
+    } else { \
+      Name##Stride<1, 0>(geometry, rows, weight, bias, out); \
+    } \
+  } else if (geometry.stride_w == 2) { \
+    if (kernel_w == 3) { \
+      Name##Stride<2, 3>(geometry, rows, weight, bias, out); \
+    } else if (kernel_w == 5) { \
+      Name##Stride<2, 5>(geometry, rows, weight, bias, out); \
+    } else { \
+      Name##Stride<2, 0>(geometry, rows, weight, bias, out); \
+    } \
+  } else { \
+    DepthwiseConvRange(0, geometry.output_w, geometry, rows, weight, bias, \
+        out); \
+  } \
+}
+
+DEPTHWISE_CONV_ROW_KERNEL(DepthwiseConvRowSSE41, "sse4.1", __m128, 4,
+    _mm_set1_ps, _mm_loadu_ps, LoadEven4, _mm_storeu_ps, _mm_add_ps,
+    _mm_mul_ps)
+DEPTHWISE_CONV_ROW_KERNEL(DepthwiseConvRowAVX2, "avx2", __m256, 8,
+    _mm256_set1_ps, _mm256_loadu_ps, LoadEven8, _mm256_storeu_ps,
+    _mm256_add_ps, _mm256_mul_ps)
+#undef DEPTHWISE_CONV_ROW_KERNEL
+#endif  // CAFFE_X86_SIMD
+
+template <typename Dtype>
+static void DepthwiseConvRowScalar(const DepthwiseConvGeometry& geometry,
+    const Dtype* const* rows, const Dtype* weight, const Dtype bias,
+    Dtype* out) {
+  DepthwiseConvRange(0, geometry.output_w, geometry, rows, weight, bias, out);
+}
+
+template <typename Dtype>
+struct DepthwiseConvKernel {
+  void (*row)(const DepthwiseConvGeometry& geometry, const Dtype* const* rows,
+      const Dtype* weight, const Dtype bias, Dtype* out);
+};
+
+template <typename Dtype>
+static void GetDepthwiseConvKernel(const SimdLevel max_level,
+    DepthwiseConvKernel<Dtype>* kernel) {
+  kernel->row = DepthwiseConvRowScalar<Dtype>;
+}
+
+static void GetDepthwiseConvKernel(const SimdLevel max_level,
+    DepthwiseConvKernel<float>* kernel) {
+  switch (std::min(max_level, caffe_cpu_simd_level())) {
+#ifdef CAFFE_X86_SIMD
+  case SIMD_AVX2:
+    kernel->row = DepthwiseConvRowAVX2;
+    break;
+  case SIMD_SSE41:
+    kernel->row = DepthwiseConvRowSSE41;
+    break;
+#endif
+  default:
+    kernel->row = DepthwiseConvRowScalar<float>;
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_depthwise_conv(const Dtype* input, const int channels,
+    const int height, const int width, const int multiplier,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const Dtype* weight, const Dtype* bias,
+    Dtype* output, const SimdLevel max_level) {
+  DepthwiseConvGeometry geometry;
+  geometry.width = width;
+  geometry.kernel_h = kernel_h;
+  geometry.kernel_w = kernel_w;
+  geometry.pad_w = pad_w;
+  geometry.stride_w = stride_w;
+  geometry.dilation_w = dilation_w;
+  geometry.output_w =
+      (width + 2 * pad_w - (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  const int output_h =
+      (height + 2 * pad_h - (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  DepthwiseConvKernel<Dtype> kernel;
+  GetDepthwiseConvKernel(max_level, &kernel);
+  std::vector<const Dtype*> rows(kernel_h);
+  for (int c = 0; c < channels * multiplier; ++c) {
+    const Dtype* map = input + (c / multiplier) * height * width;
+    const Dtype* filter = weight + c * kernel_h * kernel_w;
+    const Dtype channel_bias = bias ? bias[c] : Dtype(0);
+    for (int h = 0; h < output_h; ++h) {
+      for (int kh = 0; kh < kernel_h; ++kh) {
+        const int ih = h * stride_h - pad_h + kh * dilation_h;
+        rows[kh] = ih >= 0 && ih < height ? map + ih * width : NULL;
+      }
+      kernel.row(geometry, &rows[0], filter, channel_bias,
+          output + (c * output_h + h) * geometry.output_w);
+    }
+  }
+}
+
+template void caffe_cpu_depthwise_conv<float>(const float* input,
+    const int channels, const int height, const int width,
+    const int multiplier, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const float* weight,
+    const float* bias, float* output, const SimdLevel max_level);
+template void caffe_cpu_depthwise_conv<double>(const double* input,
+    const int channels, const int height, const int width,
+    const int multiplier, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const double* weight,
+    const double* bias, double* output, const SimdLevel max_level);
+
+}  // namespace caffe
@@ -0,0 +1,157 @@
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/spsc_queue.hpp"
+
+namespace caffe {
+
+// A waiting side polls kSpinPolls times, then yields for kYieldPolls more
+// polls before it parks.
+static const int kSpinPolls = 64;
+static const int kYieldPolls = 64;
+
+template<typename T>
+class SPSCQueue<T>::sync {
+ public:
+  explicit sync(size_t capacity)
+      : slots_(capacity), head_(0), tail_(0),
+        consumer_parked_(false), producer_parked_(false) {}
+
+  // Only valid on the consumer, respectively producer side.
+  inline bool can_pop() const {
+    return head_.load(boost::memory_order_relaxed) !=
+        tail_.load(boost::memory_order_acquire);
+  }
+  inline bool can_push() const {
+    return tail_.load(boost::memory_order_relaxed) -
+        head_.load(boost::memory_order_acquire) < slots_.size();
+  }
+
+  void wait(bool consumer, const string& log_on_wait);
+  void wake(bool consumer);
+
+  vector<T> slots_;
+  // Producer and consumer counters live on separate cache lines, so that
+  // pushing does not invalidate the line the consumer polls and vice versa.
+  boost::atomic<size_t> head_;
+  char pad_head_[64];
+  boost::atomic<size_t> tail_;
+  char pad_tail_[64];
+
+  boost::atomic<bool> consumer_parked_;
+  boost::atomic<bool> producer_parked_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+template<typename T>
+void SPSCQueue<T>::sync::wait(bool consumer, const string& log_on_wait) {
+  for (int i = 0; i < kSpinPolls + kYieldPolls; ++i) {
+    if (consumer ? can_pop() : can_push()) {
+      return;
+    }
+    if (i >= kSpinPolls) {
+      boost::this_thread::yield();
+    }
+  }
+  boost::atomic<bool>& parked = consumer ? consumer_parked_ : producer_parked_;
+  boost::mutex::scoped_lock lock(mutex_);
+  parked.store(true, boost::memory_order_relaxed);
+  // Pairs with the fence in wake(): either the other side sees the flag, or
+  // this side sees its update.
+  boost::atomic_thread_fence(boost::memory_order_seq_cst);
+  while (!(consumer ? can_pop() : can_push())) {
+    if (!log_on_wait.empty()) {
+      LOG_EVERY_N(INFO, 1000)<< log_on_wait;
+    }
+    condition_.wait(lock);
+  }
+  parked.store(false, boost::memory_order_relaxed);
+}
+
+template<typename T>
+void SPSCQueue<T>::sync::wake(bool consumer) {
+  boost::atomic_thread_fence(boost::memory_order_seq_cst);
+  const boost::atomic<bool>& parked =
+      consumer ? consumer_parked_ : producer_parked_;
+  if (parked.load(boost::memory_order_relaxed)) {
+    boost::mutex::scoped_lock lock(mutex_);
+    condition_.notify_all();
+  }
+}
+
+template<typename T>
+SPSCQueue<T>::SPSCQueue(size_t capacity)
+    : capacity_(capacity), sync_(new sync(capacity)) {
+  CHECK_GT(capacity_, 0) << "SPSCQueue capacity must be positive.";
+}
+
+template<typename T>
+void SPSCQueue<T>::push(const T& t) {
+  if (!sync_->can_push()) {
+    sync_->wait(false, "");
+  }
+  const size_t tail = sync_->tail_.load(boost::memory_order_relaxed);
+  sync_->slots_[tail % capacity_] = t;
+  sync_->tail_.store(tail + 1, boost::memory_order_release);
+  sync_->wake(true);
+}
+
+template<typename T>
+bool SPSCQueue<T>::try_pop(T* t) {
+  if (!sync_->can_pop()) {
+    return false;
+  }
+  const size_t head = sync_->head_.load(boost::memory_order_relaxed);
+  *t = sync_->slots_[head % capacity_];
+  sync_->head_.store(head + 1, boost::memory_order_release);
+  sync_->wake(false);
+  return true;
+}
+
+template<typename T>
+T SPSCQueue<T>::pop(const string& log_on_wait) {
+  if (!sync_->can_pop()) {
+    sync_->wait(true, log_on_wait);
+  }
+  T t;
+  try_pop(&t);
+  return t;
+}
+
+template<typename T>
+bool SPSCQueue<T>::try_peek(T* t) {
+  if (!sync_->can_pop()) {
+    return false;
+  }
+  *t = sync_->slots_[sync_->head_.load(boost::memory_order_relaxed)
+      % capacity_];
+  return true;
+}
+
+template<typename T>
+T SPSCQueue<T>::peek() {
+  if (!sync_->can_pop()) {
+    sync_->wait(true, "");
+  }
+  T t;
+  try_peek(&t);
+  return t;
+}
+
+template<typename T>
+size_t SPSCQueue<T>::size() const {
+  const size_t head = sync_->head_.load(boost::memory_order_acquire);
+  return sync_->tail_.load(boost::memory_order_acquire) - head;
+}
+
+template class SPSCQueue<int>;
+template class SPSCQueue<Batch<float>*>;
+template class SPSCQueue<Batch<double>*>;
+template class SPSCQueue<pairBatch<float>*>;
+template class SPSCQueue<pairBatch<double>*>;
+
+}  // namespace caffe
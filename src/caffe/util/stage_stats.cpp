@@ -0,0 +1,99 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "caffe/util/stage_stats.hpp"
+
+namespace caffe {
+
+static const char* kStageNames[StageStats::NUM_STAGES] = {
+  "read", "decode", "sample", "distort", "expand", "crop", "transform",
+  "queue wait"
+};
+
+// The innermost running StageTimer of each thread. Timers are owned by the
+// stack, so nothing is deleted on thread exit.
+static void KeepTimer(StageTimer*) {}
+static boost::thread_specific_ptr<StageTimer> current_timer_(&KeepTimer);
+
+StageStats::StageStats()
+    : batches_(0), mutex_(new boost::mutex()) {
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    total_us_[i] = 0;
+  }
+}
+
+void StageStats::Add(Stage stage, double microseconds) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  total_us_[stage] += microseconds;
+}
+
+void StageStats::AddBatch() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  ++batches_;
+}
+
+void StageStats::Reset() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    total_us_[i] = 0;
+  }
+  batches_ = 0;
+}
+
+const char* StageStats::StageName(Stage stage) {
+  CHECK_GE(stage, 0);
+  CHECK_LT(stage, NUM_STAGES);
+  return kStageNames[stage];
+}
+
+double StageStats::total_ms(Stage stage) const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return total_us_[stage] / 1000;
+}
+
+int StageStats::batches() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return batches_;
+}
+
+string StageStats::ToString() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  std::ostringstream stream;
+  stream.precision(3);
+  const int batches = std::max(batches_, 1);
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    if (total_us_[i] > 0) {
+      if (stream.tellp() > 0) {
+        stream << ", ";
+      }
+      stream << kStageNames[i] << " " << total_us_[i] / 1000 / batches
+          << " ms";
+    }
+  }
+  return stream.str();
+}
+
+StageTimer::StageTimer(StageStats* stats, StageStats::Stage stage)
+    : stats_(stats), stage_(stage), parent_(NULL), nested_us_(0) {
+  if (stats_) {
+    parent_ = current_timer_.get();
+    current_timer_.reset(this);
+    timer_.Start();
+  }
+}
+
+StageTimer::~StageTimer() {
+  if (stats_) {
+    const double elapsed_us = timer_.MicroSeconds();
+    stats_->Add(stage_, elapsed_us - nested_us_);
+    if (parent_) {
+      parent_->nested_us_ += elapsed_us;
+    }
+    current_timer_.reset(parent_);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,70 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/spsc_queue.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::Worker : public InternalThread {
+ public:
+  Worker(ThreadPool* pool, int id) : jobs_(1), pool_(pool), id_(id) {}
+  virtual ~Worker() { StopInternalThread(); }
+
+  // Run() is the only producer, and waits for each job before the next one
+  SPSCQueue<int> jobs_;
+
+ protected:
+  virtual void InternalThreadEntry() {
+    try {
+      while (!must_stop()) {
+        jobs_.pop();
+        pool_->RunShare(id_);
+        pool_->done_.push(id_);
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  ThreadPool* pool_;
+  const int id_;
+};
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(num_threads), done_(), fn_(NULL), count_(0) {
+  CHECK_GE(num_threads_, 1) << "A thread pool needs at least one thread.";
+  // Worker 0 is the caller of Run(), only the others get their own thread.
+  for (int i = 1; i < num_threads_; ++i) {
+    workers_.push_back(shared_ptr<Worker>(new Worker(this, i)));
+    workers_.back()->StartInternalThread();
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  workers_.clear();
+}
+
+void ThreadPool::Run(int count, const boost::function<void(int, int)>& fn) {
+  fn_ = &fn;
+  count_ = count;
+  const int num_busy = std::min(num_threads_, count) - 1;
+  for (int i = 0; i < num_busy; ++i) {
+    workers_[i]->jobs_.push(count);
+  }
+  RunShare(0);
+  for (int i = 0; i < num_busy; ++i) {
+    done_.pop();
+  }
+  fn_ = NULL;
+}
+
+void ThreadPool::RunShare(int worker_id) {
+  for (int i = worker_id; i < count_; i += num_threads_) {
+    (*fn_)(i, worker_id);
+  }
+}
+
+}  // namespace caffe
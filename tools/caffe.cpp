@@ -13,6 +13,7 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/fuse_layers.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -54,6 +55,13 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_bool(fuse, false,
+    "Optional; fold the BatchNorm, Scale, Bias and ReLU layers that follow "
+    "convolutions into them when loading the net for 'test' or 'time'. "
+    "Needs the weights and the TEST phase.");
+DEFINE_bool(host_memory_pool, false,
+    "Optional; cache the freed host memory of blobs for reuse instead of "
+    "returning it to the system.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -280,8 +288,15 @@ int test() {
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
-  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  shared_ptr<Net<float> > net;
+  if (FLAGS_fuse) {
+    net = caffe::LoadFusedNet<float>(FLAGS_model, FLAGS_weights, FLAGS_level,
+        &stages);
+  } else {
+    net.reset(new Net<float>(FLAGS_model, caffe::TEST, FLAGS_level, &stages));
+    net->CopyTrainedLayersFrom(FLAGS_weights);
+  }
+  Net<float>& caffe_net = *net;
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
   vector<int> test_score_output_id;
@@ -333,7 +348,10 @@ RegisterBrewFunction(test);
 // Time: benchmark the execution time of a model.
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
-  caffe::Phase phase = get_phase_from_flags(caffe::TRAIN);
+  caffe::Phase phase =
+      get_phase_from_flags(FLAGS_fuse ? caffe::TEST : caffe::TRAIN);
+  CHECK(!FLAGS_fuse || (phase == caffe::TEST && FLAGS_weights.size()))
+      << "Fusing needs the TEST phase and the weights.";
   vector<string> stages = get_stages_from_flags();
 
   // Set device id and mode
@@ -348,7 +366,14 @@ int time() {
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, phase, FLAGS_level, &stages);
+  shared_ptr<Net<float> > net;
+  if (FLAGS_fuse) {
+    net = caffe::LoadFusedNet<float>(FLAGS_model, FLAGS_weights, FLAGS_level,
+        &stages);
+  } else {
+    net.reset(new Net<float>(FLAGS_model, phase, FLAGS_level, &stages));
+  }
+  Net<float>& caffe_net = *net;
 
   // Do a clean forward and backward pass, so that memory allocation are done
   // and future iterations will be more stable.
@@ -436,11 +461,23 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  shared_ptr<caffe::PoolingHostAllocator> host_allocator;
+  if (FLAGS_host_memory_pool) {
+    host_allocator.reset(new caffe::PoolingHostAllocator());
+    caffe::SetHostAllocator(host_allocator);
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
 #endif
-      return GetBrewFunction(caffe::string(argv[1]))();
+      const int status = GetBrewFunction(caffe::string(argv[1]))();
+      if (host_allocator) {
+        const caffe::HostAllocatorStats stats = host_allocator->stats();
+        LOG(INFO) << "Host memory pool: peak " << stats.peak_bytes
+            << " bytes, " << stats.hits << " of " << stats.allocations
+            << " allocations reused a cached block.";
+      }
+      return status;
 #ifdef WITH_PYTHON_LAYER
     } catch (bp::error_already_set) {
       PyErr_Print();
@@ -68,7 +68,7 @@ int main(int argc, char** argv) {
   LOG(INFO) << "Starting Iteration";
   while (cursor->valid()) {
     Datum datum;
-    datum.ParseFromString(cursor->value());
+    datum.ParseFromArray(cursor->value_data(), cursor->value_size());
     DecodeDatumNative(&datum);
 
     const std::string& data = datum.data();
@@ -0,0 +1,36 @@
+// This is a script to fold the BatchNorm, Scale, Bias and ReLU layers of a
+// deploy net into its convolutions.
+// Usage:
+//    fuse_net net_proto_file_in weights_file_in \
+//        net_proto_file_out weights_file_out
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/fuse_layers.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 5) {
+    LOG(ERROR) << "Usage: fuse_net net_proto_file_in weights_file_in "
+        << "net_proto_file_out weights_file_out";
+    return 1;
+  }
+
+  NetParameter net_param, weights, fused_net_param, fused_weights;
+  ReadNetParamsFromTextFileOrDie(string(argv[1]), &net_param);
+  ReadNetParamsFromBinaryFileOrDie(string(argv[2]), &weights);
+  const int num_folded =
+      FuseLayers(net_param, weights, &fused_net_param, &fused_weights);
+
+  WriteProtoToTextFile(fused_net_param, argv[3]);
+  WriteProtoToBinaryFile(fused_weights, argv[4]);
+  LOG(INFO) << "Folded " << num_folded << " layers; wrote " << argv[3]
+      << " and " << argv[4];
+  return 0;
+}